@@ -1,8 +1,9 @@
 #version 450
 
-layout(location = 0) in vec2 inPosition;
-layout(location = 1) in vec4 inColor;
-layout(location = 2) in vec2 inTexCoord;
+// One instance per quad, expanded from the two triangles of a unit quad
+layout(location = 0) in vec4 inRect;     // x, y, width, height
+layout(location = 1) in vec4 inUV;       // u, v at (x, y), then at (x + width, y + height)
+layout(location = 2) in vec4 inColor;    // sRGB encoded, alpha linear
 
 layout(push_constant) uniform PushConstants2D {
     mat4 projection;
@@ -11,8 +12,19 @@ layout(push_constant) uniform PushConstants2D {
 layout(location = 0) out vec4 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
+const vec2 corners[6] = vec2[](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+vec3 srgb_to_linear(vec3 c) {
+    return mix(c / 12.92, pow((c + 0.055) / 1.055, vec3(2.4)), greaterThan(c, vec3(0.04045)));
+}
+
 void main() {
-    gl_Position = pc.projection * vec4(inPosition, 0.0, 1.0);
-    fragColor = inColor;
-    fragTexCoord = inTexCoord;
+    vec2 corner = corners[gl_VertexIndex];
+    
+    gl_Position = pc.projection * vec4(inRect.xy + corner * inRect.zw, 0.0, 1.0);
+    fragColor = vec4(srgb_to_linear(inColor.rgb), inColor.a);
+    fragTexCoord = mix(inUV.xy, inUV.zw, corner);
 }
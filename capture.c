@@ -0,0 +1,335 @@
+#include "capture.h"
+#include "common.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+static CaptureSlot slots[CAPTURE_RING_SIZE];
+static uint32_t nextSlot = 0;
+
+// FIFO of READY slot indices consumed by the workers
+static int jobs[CAPTURE_RING_SIZE];
+static uint32_t jobHead = 0;
+static uint32_t jobCount = 0;
+
+static pthread_t workers[CAPTURE_WORKER_COUNT];
+static pthread_mutex_t captureMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t captureCond = PTHREAD_COND_INITIALIZER;
+static bool quitWorkers = false;
+static bool captureInitialized = false;
+
+static VkFormat captureFormat;
+
+static bool screenshotPending = false;
+static char screenshotFilename[256];
+
+static bool sequenceActive = false;
+static char sequencePrefix[200];
+static uint32_t sequenceFrame = 0;
+static uint32_t sequenceDropped = 0;
+
+static void push_job(int slot) {
+    jobs[(jobHead + jobCount) % CAPTURE_RING_SIZE] = slot;
+    jobCount++;
+    slots[slot].state = CAPTURE_SLOT_READY;
+    pthread_cond_signal(&captureCond);
+}
+
+static void* capture_worker(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&captureMutex);
+        while (jobCount == 0 && !quitWorkers) {
+            pthread_cond_wait(&captureCond, &captureMutex);
+        }
+        if (jobCount == 0 && quitWorkers) {
+            pthread_mutex_unlock(&captureMutex);
+            return NULL;
+        }
+
+        int index = jobs[jobHead];
+        jobHead = (jobHead + 1) % CAPTURE_RING_SIZE;
+        jobCount--;
+
+        CaptureSlot *slot = &slots[index];
+        slot->state = CAPTURE_SLOT_ENCODING;
+        uint32_t width = slot->width;
+        uint32_t height = slot->height;
+        char filename[256];
+        memcpy(filename, slot->filename, sizeof(filename));
+        pthread_mutex_unlock(&captureMutex);
+
+        // Pull the pixels out of the readback buffer first so the slot can be
+        // reused while the (slow) PNG compression runs
+        uint8_t *rgba = malloc((size_t)width * height * 4);
+        if (rgba) {
+            const uint8_t *src = slot->mapped;
+            bool bgra = captureFormat == VK_FORMAT_B8G8R8A8_SRGB ||
+                        captureFormat == VK_FORMAT_B8G8R8A8_UNORM;
+
+            if (bgra) {
+                for (uint32_t i = 0; i < width * height; ++i) {
+                    rgba[i * 4 + 0] = src[i * 4 + 2];
+                    rgba[i * 4 + 1] = src[i * 4 + 1];
+                    rgba[i * 4 + 2] = src[i * 4 + 0];
+                    rgba[i * 4 + 3] = src[i * 4 + 3];
+                }
+            } else {
+                memcpy(rgba, src, (size_t)width * height * 4);
+            }
+        }
+
+        pthread_mutex_lock(&captureMutex);
+        slot->state = CAPTURE_SLOT_FREE;
+        pthread_mutex_unlock(&captureMutex);
+
+        if (!rgba) {
+            fprintf(stderr, "Failed to allocate memory for capture '%s'\n", filename);
+            continue;
+        }
+
+        if (!stbi_write_png(filename, width, height, 4, rgba, width * 4)) {
+            fprintf(stderr, "Failed to write capture '%s'\n", filename);
+        }
+        free(rgba);
+    }
+}
+
+void capture_init(VulkanContext *context) {
+    VkExtent2D extent = context->swapChainExtent;
+    VkDeviceSize imageSize = (VkDeviceSize)extent.width * extent.height * 4;
+
+    captureFormat = context->swapChainImageFormat;
+
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++) {
+        CaptureSlot *slot = &slots[i];
+
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = imageSize,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+
+        if (vkCreateBuffer(context->device, &bufferInfo, NULL, &slot->buffer) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create capture buffer\n");
+            exit(EXIT_FAILURE);
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(context->device, slot->buffer, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = memRequirements.size,
+            .memoryTypeIndex = findMemoryType(context->physicalDevice, memRequirements.memoryTypeBits,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+        };
+
+        if (vkAllocateMemory(context->device, &allocInfo, NULL, &slot->memory) != VK_SUCCESS) {
+            fprintf(stderr, "Failed to allocate capture buffer memory\n");
+            exit(EXIT_FAILURE);
+        }
+        vkBindBufferMemory(context->device, slot->buffer, slot->memory, 0);
+        vkMapMemory(context->device, slot->memory, 0, imageSize, 0, &slot->mapped);
+
+        slot->width = extent.width;
+        slot->height = extent.height;
+        slot->state = CAPTURE_SLOT_FREE;
+    }
+
+    quitWorkers = false;
+    for (uint32_t i = 0; i < CAPTURE_WORKER_COUNT; i++) {
+        if (pthread_create(&workers[i], NULL, capture_worker, NULL) != 0) {
+            fprintf(stderr, "Failed to create capture worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    captureInitialized = true;
+}
+
+void capture_shutdown(VulkanContext *context) {
+    if (!captureInitialized) return;
+
+    if (sequenceActive) capture_stop_sequence();
+
+    // The device is idle here, so every recorded copy has landed
+    pthread_mutex_lock(&captureMutex);
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++) {
+        if (slots[i].state == CAPTURE_SLOT_IN_FLIGHT) push_job(i);
+    }
+    quitWorkers = true;
+    pthread_cond_broadcast(&captureCond);
+    pthread_mutex_unlock(&captureMutex);
+
+    for (uint32_t i = 0; i < CAPTURE_WORKER_COUNT; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++) {
+        CaptureSlot *slot = &slots[i];
+        if (slot->mapped) vkUnmapMemory(context->device, slot->memory);
+        if (slot->buffer) vkDestroyBuffer(context->device, slot->buffer, NULL);
+        if (slot->memory) vkFreeMemory(context->device, slot->memory, NULL);
+        memset(slot, 0, sizeof(*slot));
+    }
+
+    captureInitialized = false;
+}
+
+void capture_screenshot(const char *filename) {
+    strncpy(screenshotFilename, filename, sizeof(screenshotFilename) - 1);
+    screenshotFilename[sizeof(screenshotFilename) - 1] = '\0';
+    screenshotPending = true;
+}
+
+void capture_start_sequence(const char *prefix) {
+    strncpy(sequencePrefix, prefix, sizeof(sequencePrefix) - 1);
+    sequencePrefix[sizeof(sequencePrefix) - 1] = '\0';
+    sequenceFrame = 0;
+    sequenceDropped = 0;
+    sequenceActive = true;
+    printf("Capture sequence started: %s_*.png\n", sequencePrefix);
+}
+
+void capture_stop_sequence() {
+    if (!sequenceActive) return;
+    sequenceActive = false;
+    printf("Capture sequence stopped: %u frames captured, %u dropped\n",
+           sequenceFrame, sequenceDropped);
+}
+
+void capture_toggle_sequence(const char *prefix) {
+    if (sequenceActive) {
+        capture_stop_sequence();
+    } else {
+        capture_start_sequence(prefix);
+    }
+}
+
+bool capture_sequence_active() {
+    return sequenceActive;
+}
+
+// Grab a free slot without blocking, returns -1 when every buffer is busy
+static int acquire_slot() {
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++) {
+        uint32_t index = (nextSlot + i) % CAPTURE_RING_SIZE;
+        if (slots[index].state == CAPTURE_SLOT_FREE) {
+            nextSlot = (index + 1) % CAPTURE_RING_SIZE;
+            return index;
+        }
+    }
+    return -1;
+}
+
+void capture_record(VkCommandBuffer cmd, uint32_t imageIndex, uint32_t frameIndex) {
+    if (!captureInitialized || (!screenshotPending && !sequenceActive)) return;
+
+    VkExtent2D extent = context.swapChainExtent;
+
+    pthread_mutex_lock(&captureMutex);
+    int index = acquire_slot();
+    if (index >= 0 && (slots[index].width != extent.width || slots[index].height != extent.height)) {
+        // Readback buffers are sized for the swapchain they were created with
+        index = -1;
+    }
+    if (index < 0) {
+        pthread_mutex_unlock(&captureMutex);
+        if (sequenceActive) sequenceDropped++;
+        return;
+    }
+
+    CaptureSlot *slot = &slots[index];
+    if (screenshotPending) {
+        memcpy(slot->filename, screenshotFilename, sizeof(slot->filename));
+        screenshotPending = false;
+    } else {
+        snprintf(slot->filename, sizeof(slot->filename), "%s_%06u.png",
+                 sequencePrefix, sequenceFrame++);
+    }
+    slot->frameIndex = frameIndex;
+    slot->state = CAPTURE_SLOT_IN_FLIGHT;
+    pthread_mutex_unlock(&captureMutex);
+
+    VkImage image = context.swapChainImages[imageIndex];
+    VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    VkImageMemoryBarrier toTransfer = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = range,
+    };
+    vkCmdPipelineBarrier(cmd,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &toTransfer);
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {extent.width, extent.height, 1},
+    };
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+    // Hand the image back to the presentation engine and make the copy
+    // visible to the host once the frame fence signals
+    VkImageMemoryBarrier toPresent = toTransfer;
+    toPresent.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toPresent.dstAccessMask = 0;
+    toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkBufferMemoryBarrier toHost = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = slot->buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+    vkCmdPipelineBarrier(cmd,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, NULL, 1, &toHost, 1, &toPresent);
+}
+
+void capture_poll(uint32_t frameIndex) {
+    if (!captureInitialized) return;
+
+    pthread_mutex_lock(&captureMutex);
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++) {
+        if (slots[i].state == CAPTURE_SLOT_IN_FLIGHT && slots[i].frameIndex == frameIndex) {
+            push_job(i);
+        }
+    }
+    pthread_mutex_unlock(&captureMutex);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "context.h"
+#include <stdbool.h>
+
+// Async frame readback: copies are recorded into the frame's own command
+// buffer, picked up once that frame's fence has signaled and encoded to PNG
+// on worker threads, so taking a screenshot never stalls the render loop.
+
+#define CAPTURE_RING_SIZE    6  // Host-visible readback buffers
+#define CAPTURE_WORKER_COUNT 3  // PNG encoder threads
+
+typedef enum {
+    CAPTURE_SLOT_FREE,
+    CAPTURE_SLOT_IN_FLIGHT,  // Copy recorded, GPU may still be writing
+    CAPTURE_SLOT_READY,      // Copy finished, waiting for a worker
+    CAPTURE_SLOT_ENCODING    // A worker is reading the pixels
+} CaptureSlotState;
+
+typedef struct {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    void *mapped;            // Persistently mapped
+    uint32_t width, height;
+    uint32_t frameIndex;     // Frame in flight that recorded the copy
+    char filename[256];
+    CaptureSlotState state;
+} CaptureSlot;
+
+void capture_init(VulkanContext *context);
+void capture_shutdown(VulkanContext *context);
+
+// Request a single screenshot of the next rendered frame
+void capture_screenshot(const char *filename);
+
+// Continuous capture, writes <prefix>_000000.png, <prefix>_000001.png, ...
+void capture_start_sequence(const char *prefix);
+void capture_stop_sequence();
+void capture_toggle_sequence(const char *prefix);
+bool capture_sequence_active();
+
+// Call after vkCmdEndRenderPass, the image must be in PRESENT_SRC_KHR
+void capture_record(VkCommandBuffer cmd, uint32_t imageIndex, uint32_t frameIndex);
+
+// Call right after waiting on inFlightFences[frameIndex], hands every copy
+// recorded by the previous use of that fence over to the encoder threads
+void capture_poll(uint32_t frameIndex);
@@ -142,3 +142,21 @@ Color hexToColor(const char *hex) {
     
     return (Color){rf, gf, bf, af};
 }
+
+// Linear to sRGB encoded 8 bit, the inverse of hexToColor() so theme colors
+// round trip exactly. Alpha stays linear.
+static uint32_t encode_srgb8(float c) {
+    if (c <= 0.0f) return 0;
+    if (c >= 1.0f) return 255;
+    c = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+    return (uint32_t)(c * 255.0f + 0.5f);
+}
+
+uint32_t colorToRGBA8(Color color) {
+    float a = color.a < 0.0f ? 0.0f : (color.a > 1.0f ? 1.0f : color.a);
+    
+    return encode_srgb8(color.r)
+         | encode_srgb8(color.g) << 8
+         | encode_srgb8(color.b) << 16
+         | (uint32_t)(a * 255.0f + 0.5f) << 24;
+}
@@ -21,6 +21,8 @@ typedef struct {
 
 
 Color hexToColor(const char *hex);
+// R in the low byte, sRGB encoded, for R8G8B8A8 vertex attributes
+uint32_t colorToRGBA8(Color color);
 
 
 
@@ -5,6 +5,16 @@
 
 #include "common.h"
 
+// Variants of the 3D mesh pipelines. The first three are specialization
+// constants, the rest are fixed-function state.
+#define PIPELINE_VARIANT_UNLIT       (1 << 0)
+#define PIPELINE_VARIANT_ALPHA_MASK  (1 << 1)
+#define PIPELINE_VARIANT_AO          (1 << 2)
+#define PIPELINE_VARIANT_CULL_BACK   (1 << 3)  // Single-sided material
+#define PIPELINE_VARIANT_DEPTH_EQUAL (1 << 4)  // Color pass after a depth pre-pass
+#define PIPELINE_VARIANT_PACKED      (1 << 5)  // PackedVertex input, packed.vert
+#define PIPELINE_VARIANT_COUNT       64
+
 typedef struct {
     GLFWwindow *window;
     VkInstance instance;
@@ -44,6 +54,7 @@ typedef struct {
 
     // Texture rendering pipeline
     VkPipeline graphicsPipelineTextured2D;   // For textured shapes
+    VkPipeline graphicsPipelineTextured2DSDF; // Same, for SDF font pages
 
     // 2D vertex buffer
     VkBuffer vertexBuffer2D;
@@ -65,6 +76,21 @@ typedef struct {
     VkPipeline graphicsPipelineBlend;
     VkPipeline graphicsPipelineTextured3DBlend;
 
+    // graphicsPipeline and graphicsPipelineTextured3D alias the
+    // PIPELINE_VARIANT_AO entry of these arrays
+    VkPipeline graphicsPipelineVariants[PIPELINE_VARIANT_COUNT];
+    VkPipeline graphicsPipelineTextured3DVariants[PIPELINE_VARIANT_COUNT];
+
+    // Depth-only variants, only the ALPHA_MASK, CULL_BACK and PACKED entries exist
+    VkPipeline depthPrepassPipelineVariants[PIPELINE_VARIANT_COUNT];
+    VkPipeline depthPrepassTextured3DVariants[PIPELINE_VARIANT_COUNT];
+
+    // Lit textured 3D for SDF font pages, without and with AO
+    VkPipeline graphicsPipelineTextured3DSDF[2];
+
+    // Fragment shader invocation counter, one query per frame in flight
+    VkQueryPool overdrawQueryPool;
+
     Color clearColor;
 } VulkanContext;
 
@@ -1,9 +1,21 @@
 #include "font.h"
+#include "utf8.h"
+#include "font_cache.h"
 #include "context.h"
+#include "stb_image_write.h"
+#include FT_MODULE_H
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Sparse texture extensions - Use Vulkan sparse textures (only allocate used regions)
 // Load only codepoints visible in kink window
@@ -15,239 +27,975 @@ void init_free_type() {
         fprintf(stderr, "Could not init FreeType Library\n");
         exit(1);
     }
+    
+    // Module wide, so it's set once before any worker renders with it
+    FT_Int spread = FONT_SDF_SPREAD;
+    FT_Property_Set(ft, "sdf", "spread", &spread);
+    FT_Property_Set(ft, "bsdf", "spread", &spread);
 }
 
-// Simple hash function for codepoints
-static inline unsigned int hash_codepoint(uint32_t codepoint) {
-    return (codepoint * 2654435761u) % FONT_HASH_SIZE;
+#define GLYPH_SLOT_FREE UINT32_MAX  // glyph_codepoints entry of an evicted slot
+#define GLYPH_NO_PAGE (UINT32_MAX - 1)  // Character.page of a blank glyph (space), it has no bitmap
+#define TEXT_BATCH      64          // Codepoints decoded and looked up at a time
+
+// Multiplicative hash, capacity is a power of two
+static inline uint32_t hash_codepoint(uint32_t codepoint, uint32_t capacity) {
+    return (codepoint * 2654435761u) & (capacity - 1);
 }
 
-// Get character from hash table
-static Character* get_cached_character(Font* font, uint32_t codepoint) {
-    unsigned int hash = hash_codepoint(codepoint);
-    CharNode *node = font->char_table[hash];
+// Glyph index of a loaded codepoint, 0 if not loaded
+static uint32_t find_glyph(const Font* font, uint32_t codepoint) {
+    if (codepoint < FONT_DIRECT_GLYPHS) return font->direct[codepoint];
+    if (!font->table) return 0;
     
-    while (node) {
-        if (node->codepoint == codepoint) {
-            return &node->character;
-        }
-        node = node->next;
+    uint32_t mask = font->table_capacity - 1;
+    for (uint32_t i = hash_codepoint(codepoint, font->table_capacity); ; i = (i + 1) & mask) {
+        const FontGlyphSlot* slot = &font->table[i];
+        if (slot->glyph == 0) return 0;
+        if (slot->codepoint == codepoint) return slot->glyph;
     }
-    
-    return NULL;
 }
 
-// Add character to hash table
-static void cache_character(Font* font, uint32_t codepoint, Character ch) {
-    unsigned int hash = hash_codepoint(codepoint);
+// Codepoint must not be in the table yet
+static void table_insert(FontGlyphSlot* table, uint32_t capacity, uint32_t codepoint, uint32_t glyph) {
+    uint32_t mask = capacity - 1;
+    uint32_t i = hash_codepoint(codepoint, capacity);
+    while (table[i].glyph != 0) i = (i + 1) & mask;
+    table[i] = (FontGlyphSlot){codepoint, glyph};
+}
+
+// Refill the open addressing table from the live glyphs, also how slots
+// are removed since linear probing can't just clear them
+static bool rebuild_table(Font* font, uint32_t capacity) {
+    FontGlyphSlot* table = calloc(capacity, sizeof(FontGlyphSlot));
+    if (!table) {
+        fprintf(stderr, "Memory allocation failed for glyph table\n");
+        return false;
+    }
+    
+    uint32_t count = 0;
+    for (uint32_t i = 1; i < font->glyph_count; i++) {
+        uint32_t codepoint = font->glyph_codepoints[i];
+        if (codepoint == GLYPH_SLOT_FREE || codepoint < FONT_DIRECT_GLYPHS) continue;
+        table_insert(table, capacity, codepoint, i);
+        count++;
+    }
     
-    CharNode *node = (CharNode*)malloc(sizeof(CharNode));
-    node->codepoint = codepoint;
-    node->character = ch;
-    node->next = font->char_table[hash];
-    font->char_table[hash] = node;
+    free(font->table);
+    font->table = table;
+    font->table_capacity = capacity;
+    font->table_count = count;
+    return true;
 }
 
-// Grow the atlas to accommodate more glyphs
-static bool grow_atlas(Font* font) {
-    unsigned int new_width = font->width;
-    unsigned int new_height = font->height * 2; // Double the height
-    unsigned int old_height = font->height;
+// Room for count more glyphs without moving the store
+static bool reserve_glyphs(Font* font, uint32_t count) {
+    uint32_t reused = count < font->free_glyph_count ? count : font->free_glyph_count;
+    uint32_t needed = font->glyph_count + count - reused;
+    if (needed <= font->glyph_capacity) return true;
+    
+    uint32_t capacity = font->glyph_capacity ? font->glyph_capacity * 2 : 256;
+    while (capacity < needed) capacity *= 2;
+    
+    Character* glyphs = realloc(font->glyphs, capacity * sizeof(Character));
+    if (glyphs) font->glyphs = glyphs;
+    uint32_t* codepoints = realloc(font->glyph_codepoints, capacity * sizeof(uint32_t));
+    if (codepoints) font->glyph_codepoints = codepoints;
+    uint32_t* free_glyphs = realloc(font->free_glyphs, capacity * sizeof(uint32_t));
+    if (free_glyphs) font->free_glyphs = free_glyphs;
     
-    // Cap at 16384x16384 (256MB RGBA) - most modern GPUs support this
-    // If you need more, consider multiple atlases or a different approach
-    if (new_height > 16384) {
-        fprintf(stderr, "Font atlas reached maximum size (16384x16384)!\n");
-        fprintf(stderr, "Consider using a smaller font size or fewer unique glyphs.\n");
+    if (!glyphs || !codepoints || !free_glyphs) {
+        fprintf(stderr, "Memory allocation failed for glyph store\n");
         return false;
     }
+    font->glyph_capacity = capacity;
+    return true;
+}
+
+// Add a loaded glyph, returns its index or 0 when out of memory
+static uint32_t store_glyph(Font* font, uint32_t codepoint, const Character* ch) {
+    if (!reserve_glyphs(font, 1)) return 0;
     
-    // Warn when getting large
-    if (new_height >= 8192) {
-        fprintf(stderr, "Warning: Font atlas is getting very large (%ux%u)\n", 
-                new_width, new_height);
+    if (codepoint >= FONT_DIRECT_GLYPHS && (font->table_count + 1) * 4 > font->table_capacity * 3) {
+        uint32_t capacity = font->table_capacity ? font->table_capacity * 2 : FONT_GLYPH_TABLE_MIN;
+        if (!rebuild_table(font, capacity)) return 0;
     }
     
-    fprintf(stderr, "Growing font atlas from %ux%u to %ux%u\n", 
-            font->width, font->height, new_width, new_height);
+    uint32_t index = font->free_glyph_count ? font->free_glyphs[--font->free_glyph_count]
+                                            : font->glyph_count++;
+    font->glyphs[index] = *ch;
+    font->glyph_codepoints[index] = codepoint;
     
-    // Allocate new larger buffer
-    unsigned char *new_buffer = (unsigned char*)calloc(new_width * new_height * 4, sizeof(unsigned char));
-    if (!new_buffer) {
-        fprintf(stderr, "Failed to allocate memory for larger atlas\n");
-        return false;
+    if (codepoint < FONT_DIRECT_GLYPHS) {
+        font->direct[codepoint] = index;
+    } else {
+        table_insert(font->table, font->table_capacity, codepoint, index);
+        font->table_count++;
+    }
+    return index;
+}
+
+// Frame counter for page LRU, see font_next_frame()
+static uint64_t glyphFrame = 1;
+
+#define ATLAS_TEXEL_SIZE 1  // Coverage only, see load_texture_from_coverage()
+
+// Fonts whose dirty pages fonts_record_uploads() visits
+static Font* liveFonts[MAX_FONTS];
+static uint32_t liveFontCount = 0;
+
+// Per frame in flight, persistently mapped
+static VkBuffer uploadBuffers[MAX_FRAMES_IN_FLIGHT];
+static VkDeviceMemory uploadMemories[MAX_FRAMES_IN_FLIGHT];
+static VkDeviceSize uploadSizes[MAX_FRAMES_IN_FLIGHT];
+static unsigned char* uploadMapped[MAX_FRAMES_IN_FLIGHT];
+
+// Bounding box of the page's dirty rects, it must have at least one
+static FontDirtyRect dirty_bounds(const FontAtlasPage* page) {
+    uint32_t x0 = UINT32_MAX, y0 = UINT32_MAX, x1 = 0, y1 = 0;
+    for (uint32_t i = 0; i < page->dirty_count; i++) {
+        const FontDirtyRect* rect = &page->dirty[i];
+        if (rect->x < x0) x0 = rect->x;
+        if (rect->y < y0) y0 = rect->y;
+        if (rect->x + rect->width > x1) x1 = rect->x + rect->width;
+        if (rect->y + rect->height > y1) y1 = rect->y + rect->height;
     }
+    return (FontDirtyRect){x0, y0, x1 - x0, y1 - y0};
+}
+
+static void mark_dirty(FontAtlasPage* page, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    // Out of rects, collapse everything into one bounding box first
+    if (page->dirty_count == FONT_MAX_DIRTY_RECTS) {
+        page->dirty[0] = dirty_bounds(page);
+        page->dirty_count = 1;
+    }
+    page->dirty[page->dirty_count++] = (FontDirtyRect){x, y, width, height};
+}
+
+static FontAtlasPage* create_page(Font* font) {
+    FontAtlasPage* page = &font->pages[font->page_count];
     
-    // Copy old content to new buffer
-    for (unsigned int y = 0; y < font->height; y++) {
-        memcpy(new_buffer + (y * new_width * 4),
-               font->atlas_buffer + (y * font->width * 4),
-               font->width * 4);
+    page->buffer = (unsigned char*)calloc(font->width * font->height * ATLAS_TEXEL_SIZE, sizeof(unsigned char));
+    if (!page->buffer) {
+        fprintf(stderr, "Memory allocation failed for texture atlas\n");
+        return NULL;
     }
     
-    // Free old buffer and update
-    free(font->atlas_buffer);
-    font->atlas_buffer = new_buffer;
-    font->height = new_height;
+    if (!load_texture_from_coverage(&context, page->buffer, font->width, font->height, &page->texture)) {
+        fprintf(stderr, "Failed to create Vulkan texture from font atlas\n");
+        free(page->buffer);
+        page->buffer = NULL;
+        return NULL;
+    }
     
-    // FIX: Update all cached character UV coordinates for new atlas dimensions
-    // When height doubles, all ty coordinates need to be scaled by old_height/new_height
-    float height_scale = (float)old_height / (float)new_height;
+    page->texture.sdf = font->sdf;
+    skyline_init(&page->skyline, font->width, font->height);
+    page->last_used = glyphFrame;
+    page->dirty_count = 0;
+    font->page_count++;
+    return page;
+}
+
+static void destroy_page(FontAtlasPage* page) {
+    free(page->buffer);
+    page->buffer = NULL;
+    skyline_destroy(&page->skyline);
+    destroy_texture(&context, &page->texture);
+}
+
+// Empty the least recently used page that nothing drew from this frame.
+// Its glyphs leave the cache and load again (elsewhere) when next needed.
+static FontAtlasPage* recycle_page(Font* font) {
+    FontAtlasPage* oldest = NULL;
+    for (uint32_t i = 0; i < font->page_count; i++) {
+        FontAtlasPage* page = &font->pages[i];
+        if (page->last_used < glyphFrame && (!oldest || page->last_used < oldest->last_used)) {
+            oldest = page;
+        }
+    }
+    if (!oldest) return NULL;
     
-    for (int i = 0; i < FONT_HASH_SIZE; i++) {
-        CharNode *node = font->char_table[i];
-        while (node) {
-            // Scale ty coordinate proportionally
-            node->character.ty *= height_scale;
-            node = node->next;
+    uint32_t index = oldest - font->pages;
+    uint32_t evicted = 0;
+    bool tableEvicted = false;
+    for (uint32_t i = 1; i < font->glyph_count; i++) {
+        uint32_t codepoint = font->glyph_codepoints[i];
+        const Character* ch = &font->glyphs[i];
+        if (codepoint == GLYPH_SLOT_FREE || ch->page != index) continue;
+        
+        font->glyph_codepoints[i] = GLYPH_SLOT_FREE;
+        font->free_glyphs[font->free_glyph_count++] = i;
+        if (codepoint < FONT_DIRECT_GLYPHS) {
+            font->direct[codepoint] = 0;
+        } else {
+            tableEvicted = true;
         }
+        evicted++;
     }
+    // Same capacity, the allocation can't fail worse than leaving stale
+    // entries, so fall back to dropping the table whole
+    if (tableEvicted && !rebuild_table(font, font->table_capacity)) {
+        free(font->table);
+        font->table = NULL;
+        font->table_capacity = 0;
+        font->table_count = 0;
+    }
+    font->glyph_generation++;
     
-    // Recreate Vulkan texture with new size
-    destroy_texture(&context, &font->texture);
-    if (!load_texture_from_rgba(&context, font->atlas_buffer, font->width, font->height, &font->texture)) {
-        fprintf(stderr, "Failed to recreate texture after atlas growth\n");
-        return false;
+    memset(oldest->buffer, 0, font->width * font->height * ATLAS_TEXEL_SIZE);
+    skyline_reset(&oldest->skyline);
+    oldest->dirty_count = 0;
+    mark_dirty(oldest, 0, 0, font->width, font->height);
+    
+    // Retained 2D layers may still point into the page
+    renderer2D_invalidate_layers();
+    
+    fprintf(stderr, "Recycled font atlas page %u, evicted %u glyphs\n", index, evicted);
+    return oldest;
+}
+
+// Find room for a width x height bitmap: free space in any page, then a
+// new page, then a recycled one
+static FontAtlasPage* reserve_glyph(Font* font, uint32_t width, uint32_t height, uint32_t* x, uint32_t* y) {
+    for (uint32_t i = 0; i < font->page_count; i++) {
+        if (skyline_pack(&font->pages[i].skyline, width, height, x, y)) {
+            return &font->pages[i];
+        }
     }
     
-    font->needs_update = false;
-    return true;
+    FontAtlasPage* page = NULL;
+    if (font->page_count < FONT_MAX_PAGES) {
+        page = create_page(font);
+    } else {
+        page = recycle_page(font);
+    }
+    
+    if (page && skyline_pack(&page->skyline, width, height, x, y)) {
+        return page;
+    }
+    return NULL;
 }
 
-// Load a single glyph into the atlas
-static bool load_glyph(Font* font, uint32_t codepoint, Character *out_char) {
-    if (FT_Load_Char(font->face, codepoint, FT_LOAD_RENDER)) {
+// Load and render codepoint into face->glyph. Shared by the render thread
+// and the rasterization worker, each with its own face.
+static bool rasterize_glyph(FT_Face face, bool sdf, uint32_t codepoint) {
+    if (FT_Load_Char(face, codepoint, sdf ? FT_LOAD_DEFAULT : FT_LOAD_RENDER)) {
         fprintf(stderr, "Failed to load glyph for codepoint U+%04X\n", codepoint);
         return false;
     }
     
-    FT_GlyphSlot glyph = font->face->glyph;
+    FT_GlyphSlot glyph = face->glyph;
     
-    // Check if we need to move to next row
-    if (font->atlas_x + glyph->bitmap.width + 1 >= font->width) {
-        font->atlas_y += font->row_height;
-        font->row_height = 0;
-        font->atlas_x = 0;
+    // The SDF bitmap grows by the spread on every side, bitmap_left and
+    // bitmap_top account for it. Empty outlines (space) have nothing to render.
+    if (sdf && glyph->format == FT_GLYPH_FORMAT_OUTLINE && glyph->outline.n_contours > 0 &&
+        FT_Render_Glyph(glyph, FT_RENDER_MODE_SDF)) {
+        fprintf(stderr, "Failed to render SDF glyph for codepoint U+%04X\n", codepoint);
+        return false;
     }
-    
-    // Check if atlas is full - try to grow it
-    if (font->atlas_y + glyph->bitmap.rows >= font->height) {
-        if (!grow_atlas(font)) {
-            fprintf(stderr, "Cannot load glyph U+%04X - atlas full and cannot grow\n", codepoint);
+    return true;
+}
+
+// Pack a width x rows coverage bitmap into the atlas and fill in where it
+// went, the rest of out is left alone
+static bool place_glyph(Font* font, uint32_t codepoint, const unsigned char* bitmap, int pitch,
+                        uint32_t width, uint32_t rows, Character* out) {
+    // Blank glyphs (space) only need their metrics
+    uint32_t atlas_x = 0, atlas_y = 0;
+    uint32_t page_index = GLYPH_NO_PAGE;
+    if (width > 0 && rows > 0) {
+        FontAtlasPage* page = reserve_glyph(font,
+                                            width + FONT_GLYPH_PADDING,
+                                            rows + FONT_GLYPH_PADDING,
+                                            &atlas_x, &atlas_y);
+        if (!page) {
+            fprintf(stderr, "Cannot load glyph U+%04X - atlas full\n", codepoint);
             return false;
         }
-        // After growing, we have more space, continue with current position
+        page_index = page - font->pages;
+        
+        // Copy glyph coverage to atlas, rows flipped vertically
+        for (uint32_t y = 0; y < rows; y++) {
+            int glyph_y = rows - 1 - y;
+            memcpy(page->buffer + (atlas_x + (size_t)(atlas_y + y) * font->width) * ATLAS_TEXEL_SIZE,
+                   bitmap + glyph_y * pitch,
+                   width);
+        }
+        mark_dirty(page, atlas_x, atlas_y, width, rows);
     }
     
-    // Copy glyph to atlas (convert grayscale to RGBA)
-    for (unsigned int y = 0; y < glyph->bitmap.rows; y++) {
-        for (unsigned int x = 0; x < glyph->bitmap.width; x++) {
-            int atlas_y = font->atlas_y + y;
-            int glyph_y = glyph->bitmap.rows - 1 - y; // Flip vertically
-            unsigned char value = glyph->bitmap.buffer[x + glyph_y * glyph->bitmap.pitch];
-            
-            int atlas_idx = ((font->atlas_x + x) + (atlas_y * font->width)) * 4;
-            font->atlas_buffer[atlas_idx + 0] = 255;      // R
-            font->atlas_buffer[atlas_idx + 1] = 255;      // G
-            font->atlas_buffer[atlas_idx + 2] = 255;      // B
-            font->atlas_buffer[atlas_idx + 3] = value;    // A
-        }
+    out->bw = width;
+    out->bh = rows;
+    out->tx = atlas_x / (float)font->width;
+    out->ty = atlas_y / (float)font->height;
+    out->page = page_index;
+    return true;
+}
+
+// Load a single glyph into the atlas
+static bool load_glyph(Font* font, uint32_t codepoint, Character *out_char) {
+    if (!rasterize_glyph(font->face, font->sdf, codepoint)) return false;
+    
+    FT_GlyphSlot glyph = font->face->glyph;
+    if (!place_glyph(font, codepoint, glyph->bitmap.buffer, glyph->bitmap.pitch,
+                     glyph->bitmap.width, glyph->bitmap.rows, out_char)) {
+        return false;
     }
     
     // Store character info
     out_char->ax = glyph->advance.x >> 6;
     out_char->ay = glyph->advance.y >> 6;
-    out_char->bw = glyph->bitmap.width;
-    out_char->bh = glyph->bitmap.rows;
     out_char->bl = glyph->bitmap_left;
     out_char->bt = glyph->bitmap_top;
-    out_char->tx = font->atlas_x / (float)font->width;
-    out_char->ty = font->atlas_y / (float)font->height;
+    return true;
+}
+
+/// BACKGROUND RASTERIZATION
+
+// Past the frame's budget, a glyph seen for the first time is rendered by a
+// worker thread. Its slot is stored at once as pending, so it's queued only
+// once, draws nothing and keeps the runs it's in out of the run cache. The
+// finished bitmaps are packed into the atlas at the next frame boundary and
+// upload with that frame's dirty rects.
+
+#define FONT_GLYPH_PENDING UINT32_MAX  // Character.page of a glyph still with the worker
+
+typedef struct {
+    Font* font;
+    uint32_t codepoint;
+} RasterJob;
+
+typedef struct {
+    Font* font;
+    uint32_t codepoint;
+    bool ok;
+    Character metrics;          // Advance, bearing and bitmap size, not placed yet
+    unsigned char* bitmap;      // bw x bh coverage, top row first, NULL when blank
+} RasterResult;
+
+FontRasterStats fontRasterStats;
+
+// FIFOs shared with the worker under rasterMutex, which also serializes
+// FT_New_Face and FT_Done_Face on the shared FT_Library
+static RasterJob rasterJobs[FONT_RASTER_QUEUE];
+static uint32_t rasterJobHead = 0;
+static uint32_t rasterJobCount = 0;
+static RasterResult rasterResults[FONT_RASTER_QUEUE];
+static uint32_t rasterResultHead = 0;
+static uint32_t rasterResultCount = 0;
+
+static pthread_t rasterThread;
+static pthread_mutex_t rasterMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rasterCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t rasterIdleCond = PTHREAD_COND_INITIALIZER;
+static Font* rasterBusyFont = NULL;     // Font of the glyph being rendered outside the lock
+static bool rasterRunning = false;
+static bool rasterUnavailable = false;  // No thread, every glyph loads inline
+static bool rasterQuit = false;
+
+// Render thread only
+static uint32_t rasterOutstanding = 0;  // Queued, rendering or finished, up to FONT_RASTER_QUEUE
+static uint32_t rasterBudgetUsed = 0;   // Glyphs loaded inline this frame
+
+static FT_Error open_face(const char* fontPath, int fontSize, FT_Face* face) {
+    pthread_mutex_lock(&rasterMutex);
+    FT_Error error = FT_New_Face(ft, fontPath, 0, face);
+    pthread_mutex_unlock(&rasterMutex);
+    if (!error) FT_Set_Pixel_Sizes(*face, 0, fontSize);
+    return error;
+}
+
+static void close_face(FT_Face face) {
+    pthread_mutex_lock(&rasterMutex);
+    FT_Done_Face(face);
+    pthread_mutex_unlock(&rasterMutex);
+}
+
+static void* raster_worker(void* arg) {
+    (void)arg;
     
-    font->row_height = fmax(font->row_height, glyph->bitmap.rows);
-    font->atlas_x += glyph->bitmap.width + 1;
+    for (;;) {
+        pthread_mutex_lock(&rasterMutex);
+        while (rasterJobCount == 0 && !rasterQuit) {
+            pthread_cond_wait(&rasterCond, &rasterMutex);
+        }
+        if (rasterQuit) {
+            pthread_mutex_unlock(&rasterMutex);
+            return NULL;
+        }
+        
+        RasterJob job = rasterJobs[rasterJobHead];
+        rasterJobHead = (rasterJobHead + 1) % FONT_RASTER_QUEUE;
+        rasterJobCount--;
+        rasterBusyFont = job.font;
+        
+        Font* font = job.font;
+        if (!font->raster_face) {
+            if (FT_New_Face(ft, font->path, 0, &font->raster_face)) {
+                fprintf(stderr, "Failed to open %s for glyph rasterization\n", font->path);
+                font->raster_face = NULL;
+            } else {
+                FT_Set_Pixel_Sizes(font->raster_face, 0, font->size);
+            }
+        }
+        FT_Face face = font->raster_face;
+        pthread_mutex_unlock(&rasterMutex);
+        
+        RasterResult result = {.font = font, .codepoint = job.codepoint};
+        if (face && rasterize_glyph(face, font->sdf, job.codepoint)) {
+            FT_GlyphSlot glyph = face->glyph;
+            uint32_t width = glyph->bitmap.width;
+            uint32_t rows = glyph->bitmap.rows;
+            
+            result.metrics = (Character){
+                .ax = glyph->advance.x >> 6,
+                .ay = glyph->advance.y >> 6,
+                .bw = width,
+                .bh = rows,
+                .bl = glyph->bitmap_left,
+                .bt = glyph->bitmap_top,
+            };
+            result.ok = true;
+            
+            if (width > 0 && rows > 0) {
+                result.bitmap = malloc((size_t)width * rows);
+                if (result.bitmap) {
+                    for (uint32_t y = 0; y < rows; y++) {
+                        memcpy(result.bitmap + (size_t)y * width,
+                               glyph->bitmap.buffer + (int)y * glyph->bitmap.pitch, width);
+                    }
+                } else {
+                    result.ok = false;
+                }
+            }
+        }
+        
+        // Never full, a result's job was counted in rasterOutstanding
+        pthread_mutex_lock(&rasterMutex);
+        rasterResults[(rasterResultHead + rasterResultCount) % FONT_RASTER_QUEUE] = result;
+        rasterResultCount++;
+        rasterBusyFont = NULL;
+        pthread_cond_broadcast(&rasterIdleCond);
+        pthread_mutex_unlock(&rasterMutex);
+    }
+}
+
+static bool raster_start(void) {
+    if (rasterRunning) return true;
+    if (rasterUnavailable) return false;
+    
+    rasterQuit = false;
+    if (pthread_create(&rasterThread, NULL, raster_worker, NULL) != 0) {
+        fprintf(stderr, "Failed to create glyph rasterization thread, glyphs load inline\n");
+        rasterUnavailable = true;
+        return false;
+    }
+    rasterRunning = true;
+    return true;
+}
+
+// Store codepoint as pending and hand it to the worker, false when the
+// queue is full or there is no worker
+static bool raster_enqueue(Font* font, uint32_t codepoint) {
+    if (rasterOutstanding == FONT_RASTER_QUEUE || !raster_start()) return false;
+    
+    Character pending = {.page = FONT_GLYPH_PENDING};
+    if (!store_glyph(font, codepoint, &pending)) return false;
     
-    font->needs_update = true;
+    pthread_mutex_lock(&rasterMutex);
+    rasterJobs[(rasterJobHead + rasterJobCount) % FONT_RASTER_QUEUE] = (RasterJob){font, codepoint};
+    rasterJobCount++;
+    pthread_cond_signal(&rasterCond);
+    pthread_mutex_unlock(&rasterMutex);
     
+    rasterOutstanding++;
+    fontRasterStats.queued++;
+    fontRasterStats.pending = rasterOutstanding;
     return true;
 }
 
+static bool glyph_pending(const Font* font, uint32_t codepoint) {
+    uint32_t index = find_glyph(font, codepoint);
+    return index && font->glyphs[index].page == FONT_GLYPH_PENDING;
+}
+
+// Pack up to FONT_MERGE_BUDGET finished glyphs into their pending slots
+static void raster_merge(void) {
+    if (rasterOutstanding == 0) return;
+    
+    RasterResult batch[FONT_MERGE_BUDGET];
+    uint32_t count = 0;
+    pthread_mutex_lock(&rasterMutex);
+    while (count < FONT_MERGE_BUDGET && rasterResultCount > 0) {
+        batch[count++] = rasterResults[rasterResultHead];
+        rasterResultHead = (rasterResultHead + 1) % FONT_RASTER_QUEUE;
+        rasterResultCount--;
+    }
+    pthread_mutex_unlock(&rasterMutex);
+    rasterOutstanding -= count;
+    fontRasterStats.pending = rasterOutstanding;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        RasterResult* result = &batch[i];
+        Font* font = result->font;
+        
+        // Still pending, slots of pending glyphs are never evicted and a
+        // destroyed font's results are dropped with it
+        uint32_t index = find_glyph(font, result->codepoint);
+        
+        Character ch = result->metrics;
+        if (!result->ok || !place_glyph(font, result->codepoint, result->bitmap, (int)ch.bw,
+                                        ch.bw, ch.bh, &ch)) {
+            // Like an inline load failure, the replacement glyph stands in
+            uint32_t fallback = find_glyph(font, 0xFFFD);
+            bool usable = fallback && font->glyphs[fallback].page != FONT_GLYPH_PENDING;
+            ch = usable ? font->glyphs[fallback] : (Character){.page = GLYPH_NO_PAGE};
+            fontRasterStats.failed++;
+        }
+        font->glyphs[index] = ch;
+        free(result->bitmap);
+        fontRasterStats.merged++;
+    }
+    
+    // Retained 2D layers were recorded without these glyphs
+    if (count > 0) renderer2D_invalidate_layers();
+}
+
+// Drop a font's queued and finished glyphs and close its worker face,
+// waiting out a glyph the worker is rendering for it
+static void raster_forget(Font* font) {
+    pthread_mutex_lock(&rasterMutex);
+    while (rasterBusyFont == font) {
+        pthread_cond_wait(&rasterIdleCond, &rasterMutex);
+    }
+    
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < rasterJobCount; i++) {
+        RasterJob job = rasterJobs[(rasterJobHead + i) % FONT_RASTER_QUEUE];
+        if (job.font != font) rasterJobs[(rasterJobHead + kept++) % FONT_RASTER_QUEUE] = job;
+    }
+    rasterOutstanding -= rasterJobCount - kept;
+    rasterJobCount = kept;
+    
+    kept = 0;
+    for (uint32_t i = 0; i < rasterResultCount; i++) {
+        RasterResult result = rasterResults[(rasterResultHead + i) % FONT_RASTER_QUEUE];
+        if (result.font != font) {
+            rasterResults[(rasterResultHead + kept++) % FONT_RASTER_QUEUE] = result;
+        } else {
+            free(result.bitmap);
+        }
+    }
+    rasterOutstanding -= rasterResultCount - kept;
+    rasterResultCount = kept;
+    
+    if (font->raster_face) {
+        FT_Done_Face(font->raster_face);
+        font->raster_face = NULL;
+    }
+    pthread_mutex_unlock(&rasterMutex);
+    fontRasterStats.pending = rasterOutstanding;
+}
+
+static void raster_shutdown(void) {
+    if (rasterRunning) {
+        pthread_mutex_lock(&rasterMutex);
+        rasterQuit = true;
+        pthread_cond_broadcast(&rasterCond);
+        pthread_mutex_unlock(&rasterMutex);
+        pthread_join(rasterThread, NULL);
+        rasterRunning = false;
+    }
+    
+    // Glyphs left pending stay blank
+    for (uint32_t i = 0; i < rasterResultCount; i++) {
+        free(rasterResults[(rasterResultHead + i) % FONT_RASTER_QUEUE].bitmap);
+    }
+    rasterJobCount = 0;
+    rasterResultCount = 0;
+    rasterOutstanding = 0;
+    fontRasterStats.pending = 0;
+    
+    for (uint32_t i = 0; i < liveFontCount; i++) {
+        if (liveFonts[i]->raster_face) {
+            FT_Done_Face(liveFonts[i]->raster_face);
+            liveFonts[i]->raster_face = NULL;
+        }
+    }
+}
+
+void font_next_frame(void) {
+    glyphFrame++;
+    rasterBudgetUsed = 0;
+    raster_merge();
+}
+
+void font_mark_texture_used(const Texture2D* texture) {
+    if (texture->format != VK_FORMAT_R8_UNORM) return;  // Not coverage, not a page
+    
+    for (uint32_t f = 0; f < liveFontCount; f++) {
+        Font* font = liveFonts[f];
+        for (uint32_t i = 0; i < font->page_count; i++) {
+            if (&font->pages[i].texture == texture) {
+                font->pages[i].last_used = glyphFrame;
+                return;
+            }
+        }
+    }
+}
+
 // Get or load a character
 Character* font_get_character(Font* font, uint32_t codepoint) {
     // Check cache first
-    Character *cached = get_cached_character(font, codepoint);
-    if (cached) {
+    uint32_t index = find_glyph(font, codepoint);
+    if (index) {
+        Character* cached = &font->glyphs[index];
+        if (cached->page == FONT_GLYPH_PENDING) return NULL;  // Still with the worker
+        if (cached->page != GLYPH_NO_PAGE) font->pages[cached->page].last_used = glyphFrame;
         return cached;
     }
     
+    // Past the frame's budget new glyphs render in the background
+    if (rasterBudgetUsed >= FONT_RASTER_BUDGET && raster_enqueue(font, codepoint)) {
+        return NULL;
+    }
+    rasterBudgetUsed++;
+    fontRasterStats.immediate++;
+    
     // Load new glyph
     Character new_char;
     if (!load_glyph(font, codepoint, &new_char)) {
         // Fall back to replacement character (box)
         codepoint = 0xFFFD;
-        cached = get_cached_character(font, codepoint);
-        if (cached) return cached;
+        index = find_glyph(font, codepoint);
+        if (index) {
+            Character* fallback = &font->glyphs[index];
+            return fallback->page == FONT_GLYPH_PENDING ? NULL : fallback;
+        }
         
         // If even replacement char isn't loaded, try to load it
         if (!load_glyph(font, codepoint, &new_char)) {
             // Ultimate fallback: space character
-            codepoint = ' ';
-            cached = get_cached_character(font, codepoint);
-            if (cached) return cached;
-            return NULL;
+            index = find_glyph(font, ' ');
+            return index ? &font->glyphs[index] : NULL;
         }
     }
     
     // Cache and return
-    cache_character(font, codepoint, new_char);
-    return get_cached_character(font, codepoint);
+    index = store_glyph(font, codepoint, &new_char);
+    if (!index) return NULL;
+    if (new_char.page != GLYPH_NO_PAGE) font->pages[new_char.page].last_used = glyphFrame;
+    return &font->glyphs[index];
 }
 
-Font* load_font(const char* fontPath, int fontSize) {
+void font_get_characters(Font* font, const uint32_t* codepoints, uint32_t count, Character** out) {
+    // Each lookup loads at most one glyph. With the room reserved up front
+    // the store doesn't move under the pointers already written to out, and
+    // a recycled page can't hold any of them since they were fetched this frame.
+    reserve_glyphs(font, count);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = codepoints[i] < 32 ? NULL : font_get_character(font, codepoints[i]);
+    }
+}
+
+float characters_width(Font* font, const uint32_t* codepoints, uint32_t count) {
+    if (!font) return 0;
+    
+    float width = 0;
+    Character* chars[TEXT_BATCH];
+    for (uint32_t start = 0; start < count; start += TEXT_BATCH) {
+        uint32_t n = count - start < TEXT_BATCH ? count - start : TEXT_BATCH;
+        font_get_characters(font, codepoints + start, n, chars);
+        for (uint32_t i = 0; i < n; i++) {
+            if (chars[i]) width += chars[i]->ax;
+        }
+    }
+    return width;
+}
+
+/// DISK CACHE
+
+// What open_font() preloads, the atlas pixels and glyph metrics, saved once
+// and mapped back on later launches instead of running FreeType. Files are
+// named after the font path and size; the header holds everything the
+// contents depend on, a mismatch rebuilds the file.
+
+bool fontDiskCacheEnabled = true;
+
+// PATH_MAX is POSIX only, not there under a strict -std=c23
+#define FONT_CACHE_PATH_MAX 4096
+
+typedef struct {
+    uint32_t codepoint;
+    Character ch;
+} FontCacheGlyph;
+
+// 8 bytes per multiply, so hashing the font file on every load stays cheap
+static uint64_t hash_bytes(const unsigned char* data, size_t size) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+// Maps a whole file read only, false if it's missing or empty
+static bool map_file(const char* path, const unsigned char** data, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    
+    void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+    
+    *data = mapped;
+    *size = (size_t)st.st_size;
+    return true;
+}
+
+// mkdir -p
+static bool make_dirs(char* path) {
+    for (char* p = path + 1; ; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char c = *p;
+        *p = '\0';
+        bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *p = c;
+        if (!ok) return false;
+        if (c == '\0') return true;
+    }
+}
+
+// Cache file and expected header of a font, false when there's nowhere to
+// keep it or the font file can't be read
+static bool font_cache_key(const Font* font, const char* fontPath, char* cachePath, size_t cachePathSize,
+                           FontCacheHeader* header) {
+    char dir[FONT_CACHE_PATH_MAX];
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    int n;
+    if (xdg && xdg[0] == '/') {
+        n = snprintf(dir, sizeof(dir), "%s/obsidian/fonts", xdg);
+    } else if (home && home[0] == '/') {
+        n = snprintf(dir, sizeof(dir), "%s/.cache/obsidian/fonts", home);
+    } else {
+        return false;
+    }
+    if (n < 0 || (size_t)n >= sizeof(dir) || !make_dirs(dir)) return false;
+    
+    uint64_t pathHash = hash_bytes((const unsigned char*)fontPath, strlen(fontPath));
+    n = snprintf(cachePath, cachePathSize, "%s/%016llx-%d%s.atlas", dir,
+                 (unsigned long long)pathHash, font->size, font->sdf ? "-sdf" : "");
+    if (n < 0 || (size_t)n >= cachePathSize) return false;
+    
+    const unsigned char* data;
+    size_t size;
+    if (!map_file(fontPath, &data, &size)) return false;
+    
+    FT_Int major, minor, patch;
+    FT_Library_Version(ft, &major, &minor, &patch);
+    
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, FONT_CACHE_MAGIC, sizeof(header->magic));
+    header->version = FONT_CACHE_VERSION;
+    header->freetype_version = (uint32_t)(major << 16 | minor << 8 | patch);
+    header->font_hash = hash_bytes(data, size);
+    header->font_bytes = size;
+    header->size = font->size;
+    header->sdf_spread = font->sdf ? FONT_SDF_SPREAD : 0;
+    header->atlas_size = FONT_ATLAS_SIZE;
+    header->glyph_size = sizeof(Character);
+    
+    munmap((void*)data, size);
+    return true;
+}
+
+// Fill a freshly opened font from its cache file, false without touching
+// it when the file is missing, stale or malformed
+static bool font_cache_load(Font* font, const char* cachePath, const FontCacheHeader* expected) {
+    const unsigned char* data;
+    size_t size;
+    if (!map_file(cachePath, &data, &size)) return false;
+    uint32_t opened_pages = font->page_count;
+    
+    // Walk the whole file before changing anything
+    FontCacheView view;
+    bool valid = font_cache_parse(data, size, expected, font->width, font->height, ATLAS_TEXEL_SIZE,
+                                  FONT_MAX_PAGES, &view) &&
+                 view.glyph_stride == sizeof(FontCacheGlyph);
+    
+    const FontCacheGlyph* glyphs = (const FontCacheGlyph*)view.glyphs;
+    for (uint32_t i = 0; valid && i < view.glyph_count; i++) {
+        const Character* ch = &glyphs[i].ch;
+        bool blank = ch->bw == 0 || ch->bh == 0;
+        valid = (blank ? ch->page == GLYPH_NO_PAGE : ch->page < view.page_count) &&
+                glyphs[i].codepoint != GLYPH_SLOT_FREE;
+    }
+    
+    // Pages past the first are created here; a skyline that won't restore
+    // still leaves the font usable, it just loads its glyphs from FreeType
+    for (uint32_t i = 0; valid && i < view.page_count; i++) {
+        if (i >= font->page_count && !create_page(font)) {
+            valid = false;
+            break;
+        }
+        
+        FontAtlasPage* page = &font->pages[i];
+        const FontCachePageView* saved = &view.pages[i];
+        if (!skyline_restore(&page->skyline, saved->nodes, saved->info.node_count, saved->info.used_area)) {
+            valid = false;
+            break;
+        }
+        
+        if (saved->info.rows > 0) {
+            memcpy(page->buffer, saved->texels, (size_t)saved->info.rows * font->width * ATLAS_TEXEL_SIZE);
+            mark_dirty(page, 0, 0, font->width, saved->info.rows);
+        }
+    }
+    
+    if (valid && !reserve_glyphs(font, view.glyph_count)) valid = false;
+    for (uint32_t i = 0; valid && i < view.glyph_count; i++) {
+        store_glyph(font, glyphs[i].codepoint, &glyphs[i].ch);
+    }
+    
+    if (!valid) {
+        // Back to the empty first page open_font() made, pages created for
+        // the cache go again
+        while (font->page_count > opened_pages) {
+            destroy_page(&font->pages[--font->page_count]);
+        }
+        for (uint32_t i = 0; i < font->page_count; i++) {
+            FontAtlasPage* page = &font->pages[i];
+            memset(page->buffer, 0, font->width * font->height * ATLAS_TEXEL_SIZE);
+            skyline_reset(&page->skyline);
+            page->dirty_count = 0;
+        }
+    }
+    
+    munmap((void*)data, size);
+    return valid;
+}
+
+// Written beside the final name and renamed over it, so a reader never
+// sees half a file
+static void font_cache_save(const Font* font, const char* cachePath, const FontCacheHeader* key) {
+    char tmpPath[FONT_CACHE_PATH_MAX + 16];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", cachePath, (int)getpid());
+    FILE* file = fopen(tmpPath, "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot write font cache %s\n", tmpPath);
+        return;
+    }
+    
+    FontCacheHeader header = *key;
+    header.page_count = font->page_count;
+    for (uint32_t i = 1; i < font->glyph_count; i++) {
+        if (font->glyph_codepoints[i] != GLYPH_SLOT_FREE) header.glyph_count++;
+    }
+    
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t i = 1; ok && i < font->glyph_count; i++) {
+        if (font->glyph_codepoints[i] == GLYPH_SLOT_FREE) continue;
+        FontCacheGlyph glyph = {font->glyph_codepoints[i], font->glyphs[i]};
+        ok = fwrite(&glyph, sizeof(glyph), 1, file) == 1;
+    }
+    
+    for (uint32_t i = 0; ok && i < font->page_count; i++) {
+        const FontAtlasPage* page = &font->pages[i];
+        FontCachePage saved = {0, page->skyline.count, page->skyline.used_area};
+        for (uint32_t n = 0; n < page->skyline.count; n++) {
+            if (page->skyline.nodes[n].y > saved.rows) saved.rows = page->skyline.nodes[n].y;
+        }
+        
+        ok = fwrite(&saved, sizeof(saved), 1, file) == 1 &&
+             fwrite(page->skyline.nodes, sizeof(SkylineNode), saved.node_count, file) == saved.node_count &&
+             fwrite(page->buffer, (size_t)font->width * ATLAS_TEXEL_SIZE, saved.rows, file) == saved.rows;
+    }
+    
+    if (fclose(file) != 0) ok = false;
+    if (!ok || rename(tmpPath, cachePath) != 0) {
+        fprintf(stderr, "Cannot write font cache %s\n", cachePath);
+        remove(tmpPath);
+    }
+}
+
+static Font* open_font(const char* fontPath, int fontSize, bool sdf) {
     FT_Face face;
-    if (FT_New_Face(ft, fontPath, 0, &face)) {
+    if (open_face(fontPath, fontSize, &face)) {
         fprintf(stderr, "Failed to load font: %s\n", fontPath);
         return NULL;
     }
 
     printf("[LOADED FONT] %s %i\n", fontPath, fontSize);
-    FT_Set_Pixel_Sizes(face, 0, fontSize);
 
     Font* font = (Font*)calloc(1, sizeof(Font));
-    if (!font) {
-        FT_Done_Face(face);
+    char* path = strdup(fontPath);  // For the rasterization worker's face
+    if (!font || !path) {
+        free(font);
+        free(path);
+        close_face(face);
         fprintf(stderr, "Memory allocation failed for font structure\n");
         return NULL;
     }
 
     // Initialize font
     font->face = face;
+    font->path = path;
     font->ascent = face->size->metrics.ascender >> 6;
     font->descent = -(face->size->metrics.descender >> 6);
-    font->width = 2048;   // Larger atlas for Unicode
-    font->height = 2048;
-    font->atlas_x = 0;
-    font->atlas_y = 0;
-    font->row_height = 0;
-    font->needs_update = false;
-    
-    // Initialize hash table
-    memset(font->char_table, 0, sizeof(font->char_table));
-
-    // Create atlas buffer (RGBA for Vulkan)
-    font->atlas_buffer = (unsigned char*)calloc(font->width * font->height * 4, sizeof(unsigned char));
-    if (!font->atlas_buffer) {
+    font->size = fontSize;
+    font->sdf = sdf;
+    font->width = FONT_ATLAS_SIZE;   // Larger atlas for Unicode
+    font->height = FONT_ATLAS_SIZE;
+    font->page_count = 0;
+    
+    // Glyph index 0 means "not loaded"
+    font->glyph_count = 1;
+
+    if (liveFontCount == MAX_FONTS) {
+        fprintf(stderr, "Too many fonts loaded!\n");
+        free(path);
         free(font);
-        FT_Done_Face(face);
-        fprintf(stderr, "Memory allocation failed for texture atlas\n");
+        close_face(face);
+        return NULL;
+    }
+
+    if (!create_page(font)) {
+        free(path);
+        free(font);
+        close_face(face);
         return NULL;
     }
+    liveFonts[liveFontCount++] = font;
+
+    char cachePath[FONT_CACHE_PATH_MAX];
+    FontCacheHeader cacheKey;
+    bool cacheable = fontDiskCacheEnabled &&
+                     font_cache_key(font, fontPath, cachePath, sizeof(cachePath), &cacheKey);
+    if (cacheable && font_cache_load(font, cachePath, &cacheKey)) {
+        font_flush_updates(font);
+        return font;
+    }
 
     // Pre-load ASCII characters (32-126)
     for (uint32_t i = 32; i < 127; i++) {
         Character ch;
         if (load_glyph(font, i, &ch)) {
-            cache_character(font, i, ch);
+            store_glyph(font, i, &ch);
         }
     }
     
@@ -262,40 +1010,425 @@ Font* load_font(const char* fontPath, int fontSize) {
     for (size_t i = 0; i < sizeof(common_chars) / sizeof(common_chars[0]); i++) {
         Character ch;
         if (load_glyph(font, common_chars[i], &ch)) {
-            cache_character(font, common_chars[i], ch);
+            store_glyph(font, common_chars[i], &ch);
         }
     }
 
-    // Create Vulkan texture
-    if (!load_texture_from_rgba(&context, font->atlas_buffer, font->width, font->height, &font->texture)) {
-        fprintf(stderr, "Failed to create Vulkan texture from font atlas\n");
-        free(font->atlas_buffer);
-        free(font);
-        FT_Done_Face(face);
-        return NULL;
-    }
+    if (cacheable) font_cache_save(font, cachePath, &cacheKey);
 
-    font->needs_update = false;
+    // Upload the preloaded glyphs
+    font_flush_updates(font);
     return font;
 }
 
-// FIX: Batch texture updates - only update once per frame
-static void update_texture_if_needed(Font* font) {
-    if (!font->needs_update) return;
+Font* load_font(const char* fontPath, int fontSize) {
+    return open_font(fontPath, fontSize, false);
+}
+
+Font* load_font_sdf(const char* fontPath, int fontSize) {
+    return open_font(fontPath, fontSize, true);
+}
+
+// Blocking, one upload per page covering all its dirty rects. Meant for
+// outside the frame loop, e.g. right after loading.
+void font_flush_updates(Font* font) {
+    for (uint32_t i = 0; i < font->page_count; i++) {
+        FontAtlasPage* page = &font->pages[i];
+        if (page->dirty_count == 0) continue;
+        
+        FontDirtyRect rect = dirty_bounds(page);
+        
+        size_t row_size = (size_t)rect.width * ATLAS_TEXEL_SIZE;
+        unsigned char* pixels = malloc(row_size * rect.height);
+        if (!pixels) continue;
+        for (uint32_t y = 0; y < rect.height; y++) {
+            memcpy(pixels + y * row_size,
+                   page->buffer + ((size_t)(rect.y + y) * font->width + rect.x) * ATLAS_TEXEL_SIZE,
+                   row_size);
+        }
+        
+        if (update_texture_region(&context, &page->texture, pixels, rect.x, rect.y, rect.width, rect.height)) {
+            page->dirty_count = 0;
+        }
+        free(pixels);
+    }
+}
+
+void fonts_record_uploads(VkCommandBuffer cmd, uint32_t frameIndex) {
+    // Rows are packed tightly, every region starts 4 byte aligned
+    VkDeviceSize total = 0;
+    for (uint32_t f = 0; f < liveFontCount; f++) {
+        Font* font = liveFonts[f];
+        for (uint32_t i = 0; i < font->page_count; i++) {
+            const FontAtlasPage* page = &font->pages[i];
+            for (uint32_t r = 0; r < page->dirty_count; r++) {
+                VkDeviceSize size = (VkDeviceSize)page->dirty[r].width * page->dirty[r].height * ATLAS_TEXEL_SIZE;
+                total += (size + 3) & ~(VkDeviceSize)3;
+            }
+        }
+    }
+    if (total == 0) return;
+    
+    // The frame's fence has passed, its old staging buffer is free
+    if (total > uploadSizes[frameIndex]) {
+        if (uploadBuffers[frameIndex]) {
+            vkUnmapMemory(context.device, uploadMemories[frameIndex]);
+            vkDestroyBuffer(context.device, uploadBuffers[frameIndex], NULL);
+            vkFreeMemory(context.device, uploadMemories[frameIndex], NULL);
+        }
+        
+        VkDeviceSize size = 256 * 1024;
+        while (size < total) size *= 2;
+        create_host_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                           &uploadBuffers[frameIndex], &uploadMemories[frameIndex]);
+        vkMapMemory(context.device, uploadMemories[frameIndex], 0, size, 0, (void**)&uploadMapped[frameIndex]);
+        uploadSizes[frameIndex] = size;
+    }
     
-    // Update the Vulkan texture with new atlas data
-    update_texture_from_rgba(&context, &font->texture, font->atlas_buffer, 
-                            font->width, font->height);
+    unsigned char* staging = uploadMapped[frameIndex];
+    VkDeviceSize offset = 0;
     
-    font->needs_update = false;
+    for (uint32_t f = 0; f < liveFontCount; f++) {
+        Font* font = liveFonts[f];
+        for (uint32_t i = 0; i < font->page_count; i++) {
+            FontAtlasPage* page = &font->pages[i];
+            if (page->dirty_count == 0) continue;
+            
+            VkBufferImageCopy regions[FONT_MAX_DIRTY_RECTS];
+            for (uint32_t r = 0; r < page->dirty_count; r++) {
+                const FontDirtyRect* rect = &page->dirty[r];
+                size_t row_size = (size_t)rect->width * ATLAS_TEXEL_SIZE;
+                
+                for (uint32_t y = 0; y < rect->height; y++) {
+                    memcpy(staging + offset + y * row_size,
+                           page->buffer + ((size_t)(rect->y + y) * font->width + rect->x) * ATLAS_TEXEL_SIZE,
+                           row_size);
+                }
+                
+                regions[r] = (VkBufferImageCopy){
+                    .bufferOffset = offset,
+                    .bufferRowLength = 0,
+                    .bufferImageHeight = 0,
+                    .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = 0,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1
+                    },
+                    .imageOffset = {(int32_t)rect->x, (int32_t)rect->y, 0},
+                    .imageExtent = {rect->width, rect->height, 1}
+                };
+                offset += (row_size * rect->height + 3) & ~(VkDeviceSize)3;
+            }
+            
+            transitionImageLayout(cmd, page->texture.image, page->texture.format,
+                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            vkCmdCopyBufferToImage(cmd, uploadBuffers[frameIndex], page->texture.image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, page->dirty_count, regions);
+            transitionImageLayout(cmd, page->texture.image, page->texture.format,
+                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            
+            page->dirty_count = 0;
+        }
+    }
 }
 
-// NEW: Force immediate texture update (call this after batch character loading)
-void font_flush_updates(Font* font) {
-    update_texture_if_needed(font);
+static void text_cache_shutdown(void);
+
+void fonts_shutdown(void) {
+    raster_shutdown();
+    text_cache_shutdown();
+    
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (!uploadBuffers[i]) continue;
+        vkUnmapMemory(context.device, uploadMemories[i]);
+        vkDestroyBuffer(context.device, uploadBuffers[i], NULL);
+        vkFreeMemory(context.device, uploadMemories[i], NULL);
+        uploadBuffers[i] = VK_NULL_HANDLE;
+        uploadMemories[i] = VK_NULL_HANDLE;
+        uploadSizes[i] = 0;
+        uploadMapped[i] = NULL;
+    }
 }
 
-float character(Font* font, uint32_t codepoint, float x, float y, Color color) {
+static float draw_character(Font* font, const Character* ch, float x, float y, float scale, Color color);
+
+/// SHAPED RUN CACHE
+
+// Layout of a string at the font's own size: its drawable glyphs and their
+// pen positions relative to the first baseline. text_sized(), text3D() and
+// text_width() share it, so a label drawn every frame is decoded and looked
+// up once and then emitted by a plain loop.
+typedef struct {
+    Font* font;
+    uint64_t hash;
+    char* text;                 // Copy of the key, length bytes
+    uint32_t length;
+    uint32_t generation;        // font->glyph_generation when laid out
+    uint32_t pages;             // Bit per atlas page the glyphs sit in
+    uint32_t count;             // Drawable glyphs, blanks only move the pen
+    uint32_t* glyphs;           // Indexes into font->glyphs
+    float* pens;                // x, y per glyph
+    float width;                // Widest line
+    uint32_t lines;
+    bool pending;               // Incomplete, glyphs still rasterizing or out of memory, never cached
+    float* carets;              // length + 1 pen x per byte, NULL until measured
+    TextLine* breaks;           // Lines for break_width, NULL until broken
+    uint32_t break_count;
+    float break_width;
+    int32_t prev, next;         // LRU list, most recently used first
+    int32_t chain;              // Next run in the same bucket
+} TextRun;
+
+#define TEXT_CACHE_BUCKETS (TEXT_CACHE_MAX_RUNS * 2)
+
+TextCacheStats textCacheStats;
+
+static TextRun textRuns[TEXT_CACHE_MAX_RUNS];
+static int32_t textBuckets[TEXT_CACHE_BUCKETS];
+static int32_t freeTextRuns[TEXT_CACHE_MAX_RUNS];
+static uint32_t freeTextRunCount = 0;
+static int32_t lruHead = -1, lruTail = -1;
+static bool textCacheReady = false;
+
+// Uncached strings and failed allocations are laid out here, valid until
+// the next text_run(). Its text points at the caller's string and its
+// carets and lines live in their own buffers, they are never cached.
+static TextRun scratchRun;
+static uint32_t scratchCapacity = 0;
+static float* scratchCarets = NULL;
+static size_t scratchCaretCapacity = 0;
+
+static void text_cache_init(void) {
+    for (uint32_t i = 0; i < TEXT_CACHE_BUCKETS; i++) textBuckets[i] = -1;
+    for (uint32_t i = 0; i < TEXT_CACHE_MAX_RUNS; i++) {
+        freeTextRuns[i] = TEXT_CACHE_MAX_RUNS - 1 - i;
+    }
+    freeTextRunCount = TEXT_CACHE_MAX_RUNS;
+    textCacheReady = true;
+}
+
+// FNV-1a
+static uint64_t hash_text(const char* text, uint32_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static void lru_unlink(int32_t i) {
+    TextRun* run = &textRuns[i];
+    if (run->prev >= 0) textRuns[run->prev].next = run->next; else lruHead = run->next;
+    if (run->next >= 0) textRuns[run->next].prev = run->prev; else lruTail = run->prev;
+}
+
+static void lru_push_front(int32_t i) {
+    TextRun* run = &textRuns[i];
+    run->prev = -1;
+    run->next = lruHead;
+    if (lruHead >= 0) textRuns[lruHead].prev = i; else lruTail = i;
+    lruHead = i;
+}
+
+static void release_run(int32_t i) {
+    TextRun* run = &textRuns[i];
+    
+    int32_t* link = &textBuckets[run->hash & (TEXT_CACHE_BUCKETS - 1)];
+    while (*link != i) link = &textRuns[*link].chain;
+    *link = run->chain;
+    lru_unlink(i);
+    
+    textCacheStats.runs--;
+    textCacheStats.glyphs -= run->count;
+    free(run->glyphs);  // One block with pens and text
+    free(run->carets);
+    free(run->breaks);
+    run->carets = NULL;
+    run->breaks = NULL;
+    run->font = NULL;
+    freeTextRuns[freeTextRunCount++] = i;
+}
+
+// Runs of a font that is going away
+static void text_cache_forget(Font* font) {
+    for (int32_t i = lruHead; i >= 0; ) {
+        int32_t next = textRuns[i].next;
+        if (textRuns[i].font == font) release_run(i);
+        i = next;
+    }
+}
+
+static void text_cache_shutdown(void) {
+    while (lruTail >= 0) release_run(lruTail);
+    free(scratchRun.glyphs);
+    free(scratchRun.pens);
+    free(scratchCarets);
+    scratchRun.glyphs = NULL;
+    scratchRun.pens = NULL;
+    scratchCarets = NULL;
+    scratchCapacity = 0;
+    scratchCaretCapacity = 0;
+}
+
+static bool scratch_reserve(uint32_t count) {
+    if (count <= scratchCapacity) return true;
+    
+    uint32_t capacity = scratchCapacity ? scratchCapacity : 256;
+    while (capacity < count) capacity *= 2;
+    
+    uint32_t* glyphs = realloc(scratchRun.glyphs, capacity * sizeof(uint32_t));
+    if (glyphs) scratchRun.glyphs = glyphs;
+    float* pens = realloc(scratchRun.pens, capacity * 2 * sizeof(float));
+    if (pens) scratchRun.pens = pens;
+    if (!glyphs || !pens) {
+        fprintf(stderr, "Memory allocation failed for text layout\n");
+        return false;
+    }
+    scratchCapacity = capacity;
+    return true;
+}
+
+// Decode and lay out text into scratchRun
+static void layout_text(Font* font, const char* text, uint32_t length) {
+    TextRun* run = &scratchRun;
+    run->text = (char*)text;
+    run->length = length;
+    run->count = 0;
+    run->pages = 0;
+    run->width = 0;
+    run->lines = 1;
+    run->pending = false;
+    
+    const char* p = text;
+    const char* end = text + length;
+    float penX = 0, penY = 0;
+    float lineHeight = font->ascent + font->descent;
+    
+    uint32_t codepoints[TEXT_BATCH];
+    Character* chars[TEXT_BATCH];
+    
+    while (p < end) {
+        // Decode a run, then look all its glyphs up at once
+        uint32_t count = (uint32_t)utf8_decode_bulk(&p, end, codepoints, TEXT_BATCH);
+        
+        font_get_characters(font, codepoints, count, chars);
+        if (!scratch_reserve(run->count + count)) {
+            // Partial, drawn this once but never cached
+            run->pending = true;
+            return;
+        }
+        
+        for (uint32_t i = 0; i < count; i++) {
+            // Handle newline
+            if (codepoints[i] == '\n') {
+                if (penX > run->width) run->width = penX;
+                penX = 0;
+                penY -= lineHeight;
+                run->lines++;
+                continue;
+            }
+            if (codepoints[i] < 32) continue;
+            
+            const Character* ch = chars[i];
+            if (!ch) {
+                if (glyph_pending(font, codepoints[i])) run->pending = true;
+                penX += font->ascent;  // Some default width
+                continue;
+            }
+            
+            if (ch->bw > 0 && ch->bh > 0) {
+                run->glyphs[run->count] = ch - font->glyphs;
+                run->pens[run->count * 2 + 0] = penX;
+                run->pens[run->count * 2 + 1] = penY;
+                run->pages |= 1u << ch->page;
+                run->count++;
+            }
+            penX += ch->ax;
+        }
+    }
+    if (penX > run->width) run->width = penX;
+    
+    // Loads during the layout may have recycled a page, but never one this
+    // run uses, its glyphs were all fetched this frame
+    run->generation = font->glyph_generation;
+}
+
+// Cached layout of text[0, length). Pages it draws from count as used
+// this frame, like font_get_character().
+static TextRun* text_run(Font* font, const char* text, uint32_t length) {
+    if (!textCacheReady) text_cache_init();
+    
+    uint64_t hash = hash_text(text, length);
+    int32_t* bucket = &textBuckets[hash & (TEXT_CACHE_BUCKETS - 1)];
+    
+    for (int32_t i = *bucket; i >= 0; i = textRuns[i].chain) {
+        TextRun* run = &textRuns[i];
+        if (run->font != font || run->hash != hash || run->length != length ||
+            memcmp(run->text, text, length) != 0) {
+            continue;
+        }
+        
+        // A recycled page may have handed its glyph slots to other codepoints
+        if (run->generation != font->glyph_generation) {
+            release_run(i);
+            break;
+        }
+        
+        textCacheStats.hits++;
+        lru_unlink(i);
+        lru_push_front(i);
+        for (uint32_t page = 0; page < font->page_count; page++) {
+            if (run->pages & (1u << page)) font->pages[page].last_used = glyphFrame;
+        }
+        return run;
+    }
+    
+    textCacheStats.misses++;
+    layout_text(font, text, length);
+    
+    TextRun* laidOut = &scratchRun;
+    if (length > TEXT_CACHE_MAX_LENGTH || laidOut->count > TEXT_CACHE_MAX_GLYPHS || laidOut->pending) {
+        return laidOut;
+    }
+    
+    // Least recently used runs go until the new one fits
+    while (lruTail >= 0 && (freeTextRunCount == 0 ||
+                            textCacheStats.glyphs + laidOut->count > TEXT_CACHE_MAX_GLYPHS)) {
+        release_run(lruTail);
+        textCacheStats.evictions++;
+    }
+    
+    size_t glyphBytes = (size_t)laidOut->count * sizeof(uint32_t);
+    size_t penBytes = (size_t)laidOut->count * 2 * sizeof(float);
+    unsigned char* block = malloc(glyphBytes + penBytes + length + 1);
+    if (!block) return laidOut;
+    
+    int32_t i = freeTextRuns[--freeTextRunCount];
+    TextRun* run = &textRuns[i];
+    *run = *laidOut;
+    run->font = font;
+    run->hash = hash;
+    run->length = length;
+    run->glyphs = (uint32_t*)block;
+    run->pens = (float*)(block + glyphBytes);
+    run->text = (char*)(block + glyphBytes + penBytes);
+    memcpy(run->glyphs, laidOut->glyphs, glyphBytes);
+    memcpy(run->pens, laidOut->pens, penBytes);
+    memcpy(run->text, text, length);
+    
+    run->chain = *bucket;
+    *bucket = i;
+    lru_push_front(i);
+    
+    textCacheStats.runs++;
+    textCacheStats.glyphs += run->count;
+    return run;
+}
+
+
+// character() drawn scale times the rasterized size, returns the scaled advance
+static float character_scaled(Font* font, uint32_t codepoint, float x, float y, float scale, Color color) {
     if (!font) return 0.0f;
     
     // Handle newline (don't draw, just return advance)
@@ -311,259 +1444,265 @@ float character(Font* font, uint32_t codepoint, float x, float y, Color color) {
     // Get or load character (DOESN'T update texture yet)
     Character *ch = font_get_character(font, codepoint);
     if (!ch) {
-        return font->ascent; // Return some default width
+        return font->ascent * scale; // Return some default width
     }
     
+    return draw_character(font, ch, x, y, scale, color);
+}
+
+// Emit an already looked up glyph, returns its scaled advance
+static float draw_character(Font* font, const Character* ch, float x, float y, float scale, Color color) {
     // Calculate position (align baseline)
-    float xpos = x + ch->bl;
-    float ypos = y - (ch->bh - ch->bt + font->descent);
+    float xpos = x + ch->bl * scale;
+    float ypos = y - (ch->bh - ch->bt + font->descent) * scale;
 
     
-    float w = ch->bw;
-    float h = ch->bh;
+    float w = ch->bw * scale;
+    float h = ch->bh * scale;
     
     // Skip if no visible pixels, but still return advance
     if (w == 0 || h == 0) {
-        return ch->ax;
+        return ch->ax * scale;
     }
     
-    // Calculate UV coordinates
+    // Calculate UV coordinates, the atlas row ty is the glyph's top edge
     float u1 = ch->tx;
     float v1 = ch->ty + ch->bh / (float)font->height;
     float u2 = ch->tx + ch->bw / (float)font->width;
     float v2 = ch->ty;
     
-    // Check vertex buffer space
-    if (vertexCount2D + 6 > MAX_VERTICES) {
+    // Lands in its page's batch of the current 2D target (frame or layer)
+    if (!renderer2D_emit(&font->pages[ch->page].texture, xpos, ypos, w, h, u1, v2, u2, v1, color)) {
         fprintf(stderr, "Vertex buffer full, cannot render character\n");
-        return ch->ax;
-    }
-    
-    Vertex2D quad[6] = {
-        {{xpos, ypos + h}, color, {u1, v1}, 0},
-        {{xpos, ypos}, color, {u1, v2}, 0},
-        {{xpos + w, ypos}, color, {u2, v2}, 0},
-        
-        {{xpos, ypos + h}, color, {u1, v1}, 0},
-        {{xpos + w, ypos}, color, {u2, v2}, 0},
-        {{xpos + w, ypos + h}, color, {u2, v1}, 0}
-    };
-    
-    // Find or create batch for this texture
-    int batchIndex = -1;
-    if (textureBatchCount > 0 && textureBatches[textureBatchCount - 1].texture == &font->texture) {
-        batchIndex = textureBatchCount - 1;
-    } else {
-        if (textureBatchCount >= MAX_TEXTURES) {
-            fprintf(stderr, "Too many texture batches!\n");
-            return ch->ax;
-        }
-        batchIndex = textureBatchCount++;
-        textureBatches[batchIndex].texture = &font->texture;
-        textureBatches[batchIndex].startVertex = coloredVertexCount + (vertexCount2D - coloredVertexCount);
-        textureBatches[batchIndex].vertexCount = 0;
     }
     
-    // Add vertices at the end of the buffer
-    memcpy(&vertices2D[vertexCount2D], quad, sizeof(quad));
-    vertexCount2D += 6;
-    textureBatches[batchIndex].vertexCount += 6;
-    
-    return ch->ax;
+    return ch->ax * scale;
+}
+
+float character(Font* font, uint32_t codepoint, float x, float y, Color color) {
+    return character_scaled(font, codepoint, x, y, 1.0f, color);
 }
 
 void text(Font* font, const char* text_str, float x, float y, Color color) {
+    if (!font) return;
+    text_sized(font, text_str, x, y, font->size, color);
+}
+
+void text_sized(Font* font, const char* text_str, float x, float y, float size, Color color) {
     if (!font || !text_str) return;
 
-    const unsigned char* p = (const unsigned char*)text_str;
-    float initialX = x;
-    float lineHeight = (font->ascent + font->descent);
+    const TextRun* run = text_run(font, text_str, strlen(text_str));
+    float scale = size / font->size;
+    
+    // New glyphs upload with the frame
+    for (uint32_t i = 0; i < run->count; i++) {
+        draw_character(font, &font->glyphs[run->glyphs[i]],
+                       x + run->pens[i * 2 + 0] * scale,
+                       y + run->pens[i * 2 + 1] * scale,
+                       scale, color);
+    }
+}
 
-    while (*p) {
-        // Handle newline
-        if (*p == '\n') {
-            x = initialX;
-            y -= lineHeight;
-            p++;
-            continue;
+float text_width(Font* font, const char* text_str) {
+    if (!font || !text_str) return 0;
+    return text_run(font, text_str, strlen(text_str))->width;
+}
+
+// Pen x before every byte of the run, bytes inside a sequence share the
+// caret before it. Same advances as layout_text(), blanks and missing
+// glyphs included.
+static const float* run_carets(Font* font, TextRun* run) {
+    if (run->carets) return run->carets;
+    
+    float* carets;
+    if (run == &scratchRun) {
+        if (scratchCaretCapacity < (size_t)run->length + 1) {
+            float* grown = realloc(scratchCarets, ((size_t)run->length + 1) * sizeof(float));
+            if (!grown) return NULL;
+            scratchCarets = grown;
+            scratchCaretCapacity = (size_t)run->length + 1;
         }
+        carets = scratchCarets;
+    } else {
+        carets = malloc(((size_t)run->length + 1) * sizeof(float));
+        if (!carets) return NULL;
+        run->carets = carets;
+    }
+    
+    const char* p = run->text;
+    const char* end = run->text + run->length;
+    float penX = 0;
+    while (p < end) {
+        size_t at = p - run->text;
+        uint32_t codepoint = utf8_decode(&p, end);
+        for (size_t i = at; i < (size_t)(p - run->text); i++) carets[i] = penX;
         
-        // Decode UTF-8 character
-        uint32_t codepoint;
-        size_t bytes_read;
-        
-        if ((*p & 0x80) == 0) {
-            // 1-byte character
-            codepoint = *p;
-            bytes_read = 1;
-        } else if ((*p & 0xE0) == 0xC0) {
-            // 2-byte character
-            codepoint = (*p & 0x1F) << 6;
-            codepoint |= (*(p+1) & 0x3F);
-            bytes_read = 2;
-        } else if ((*p & 0xF0) == 0xE0) {
-            // 3-byte character
-            codepoint = (*p & 0x0F) << 12;
-            codepoint |= (*(p+1) & 0x3F) << 6;
-            codepoint |= (*(p+2) & 0x3F);
-            bytes_read = 3;
-        } else if ((*p & 0xF8) == 0xF0) {
-            // 4-byte character
-            codepoint = (*p & 0x07) << 18;
-            codepoint |= (*(p+1) & 0x3F) << 12;
-            codepoint |= (*(p+2) & 0x3F) << 6;
-            codepoint |= (*(p+3) & 0x3F);
-            bytes_read = 4;
-        } else {
-            // Invalid UTF-8, skip
-            p++;
-            continue;
+        if (codepoint == '\n') {
+            penX = 0;
+        } else if (codepoint >= 32) {
+            const Character* ch = font_get_character(font, codepoint);
+            penX += ch ? ch->ax : font->ascent;
         }
-        
-        // Render character (doesn't update texture)
-        x += character(font, codepoint, x, y, color);
-        p += bytes_read;
     }
-    
-    // FIX: Update texture once after rendering all characters
-    update_texture_if_needed(font);
+    carets[run->length] = penX;
+    return carets;
 }
 
+static void emit_line(TextLine* lines, uint32_t maxLines, uint32_t* count, const float* carets,
+                      uint32_t start, uint32_t end) {
+    if (*count < maxLines) lines[*count] = (TextLine){start, end - start, carets[end] - carets[start]};
+    (*count)++;
+}
 
-void text3D(Font* font, const char* text_str, vec3 position, float size, Color color) {
-    if (!font || !text_str) return;
-
-    // Calculate total text width for centering (UTF-8 aware)
-    float totalWidth = 0.0f;
-    const unsigned char* p = (const unsigned char*)text_str;
+// Greedy, returns the line count and writes up to maxLines of them
+static uint32_t break_lines(const TextRun* run, const float* carets, float maxWidth,
+                            TextLine* lines, uint32_t maxLines) {
+    uint32_t count = 0;
+    uint32_t start = 0;
+    uint32_t space = UINT32_MAX;  // Last space of the line
     
-    while (*p && *p != '\n') {
-        uint32_t codepoint;
-        size_t bytes_read;
+    const char* p = run->text;
+    const char* end = run->text + run->length;
+    while (p < end) {
+        uint32_t i = p - run->text;
+        uint32_t codepoint = utf8_decode(&p, end);
+        uint32_t next = p - run->text;
         
-        if ((*p & 0x80) == 0) {
-            codepoint = *p;
-            bytes_read = 1;
-        } else if ((*p & 0xE0) == 0xC0) {
-            codepoint = (*p & 0x1F) << 6 | (*(p+1) & 0x3F);
-            bytes_read = 2;
-        } else if ((*p & 0xF0) == 0xE0) {
-            codepoint = (*p & 0x0F) << 12 | (*(p+1) & 0x3F) << 6 | (*(p+2) & 0x3F);
-            bytes_read = 3;
-        } else if ((*p & 0xF8) == 0xF0) {
-            codepoint = (*p & 0x07) << 18 | (*(p+1) & 0x3F) << 12 | 
-                       (*(p+2) & 0x3F) << 6 | (*(p+3) & 0x3F);
-            bytes_read = 4;
-        } else {
-            p++;
+        if (codepoint == '\n') {
+            emit_line(lines, maxLines, &count, carets, start, i);
+            start = next;
+            space = UINT32_MAX;
+            continue;
+        }
+        // Spaces hang past the edge, the line breaks at them later
+        if (codepoint == ' ') {
+            space = i;
             continue;
         }
         
-        Character *ch = font_get_character(font, codepoint);
-        if (ch) {
-            totalWidth += ch->ax * size / (float)font->height;
+        if (carets[next] - carets[start] > maxWidth && i > start) {
+            if (space != UINT32_MAX && space > start) {
+                emit_line(lines, maxLines, &count, carets, start, space);
+                start = space + 1;
+            }
+            space = UINT32_MAX;
+            // A word wider than the whole line is cut where it overflows
+            if (carets[next] - carets[start] > maxWidth && i > start) {
+                emit_line(lines, maxLines, &count, carets, start, i);
+                start = i;
+            }
         }
-        p += bytes_read;
     }
+    emit_line(lines, maxLines, &count, carets, start, run->length);
+    return count;
+}
 
-    float startX = -totalWidth / 2.0f;
-    float x = startX;
+float text_caret_x(Font* font, const char* text_str, size_t index) {
+    if (!font || !text_str) return 0;
     
-    p = (const unsigned char*)text_str;
+    size_t length = strlen(text_str);
+    TextRun* run = text_run(font, text_str, length);
+    const float* carets = run_carets(font, run);
+    if (!carets) return 0;
+    return carets[index < length ? index : length];
+}
+
+uint32_t text_break_lines(Font* font, const char* text_str, float maxWidth, TextLine* lines, uint32_t maxLines) {
+    if (!font || !text_str) return 0;
     
-    while (*p && *p != '\n') {
-        uint32_t codepoint;
-        size_t bytes_read;
+    TextRun* run = text_run(font, text_str, strlen(text_str));
+    const float* carets = run_carets(font, run);
+    if (!carets) return 0;
+    if (run == &scratchRun) return break_lines(run, carets, maxWidth, lines, maxLines);
+    
+    // The cached run keeps the lines for the last width asked
+    if (!run->breaks || run->break_width != maxWidth) {
+        uint32_t count = break_lines(run, carets, maxWidth, NULL, 0);
+        TextLine* breaks = malloc(count * sizeof(TextLine));
+        if (!breaks) return break_lines(run, carets, maxWidth, lines, maxLines);
+        break_lines(run, carets, maxWidth, breaks, count);
         
-        if ((*p & 0x80) == 0) {
-            codepoint = *p;
-            bytes_read = 1;
-        } else if ((*p & 0xE0) == 0xC0) {
-            codepoint = (*p & 0x1F) << 6 | (*(p+1) & 0x3F);
-            bytes_read = 2;
-        } else if ((*p & 0xF0) == 0xE0) {
-            codepoint = (*p & 0x0F) << 12 | (*(p+1) & 0x3F) << 6 | (*(p+2) & 0x3F);
-            bytes_read = 3;
-        } else if ((*p & 0xF8) == 0xF0) {
-            codepoint = (*p & 0x07) << 18 | (*(p+1) & 0x3F) << 12 | 
-                       (*(p+2) & 0x3F) << 6 | (*(p+3) & 0x3F);
-            bytes_read = 4;
-        } else {
-            p++;
-            continue;
-        }
+        free(run->breaks);
+        run->breaks = breaks;
+        run->break_count = count;
+        run->break_width = maxWidth;
+    }
+    
+    uint32_t copied = run->break_count < maxLines ? run->break_count : maxLines;
+    if (copied > 0) memcpy(lines, run->breaks, copied * sizeof(TextLine));
+    return run->break_count;
+}
+
+
+void text3D(Font* font, const char* text_str, vec3 position, float size, Color color) {
+    if (!font || !text_str) return;
+
+    // First line only, centered on position
+    const TextRun* run = text_run(font, text_str, strcspn(text_str, "\n"));
+    float scale = size / (float)font->height;
+    float startX = -run->width * scale / 2.0f;
+    
+    for (uint32_t i = 0; i < run->count; i++) {
+        const Character* ch = &font->glyphs[run->glyphs[i]];
+        float x = startX + run->pens[i * 2] * scale;
+
+        float charWidth = ch->bw * scale;
+        float charHeight = ch->bh * scale;
         
-        Character *ch = font_get_character(font, codepoint);
-        if (!ch) {
-            p += bytes_read;
-            continue;
+        float xpos = x + ch->bl * scale;
+        float ypos = -(ch->bh - ch->bt) * scale - font->descent * scale;
+
+        if (vertex_count_3D_textured + 6 > MAX_VERTICES) {
+            fprintf(stderr, "3D textured vertex buffer full\n");
+            return;
         }
 
-        float charWidth = ch->bw * size / (float)font->height;
-        float charHeight = ch->bh * size / (float)font->height;
-        
-        float xpos = x + ch->bl * size / (float)font->height;
-        float ypos = -(ch->bh - ch->bt) * size / (float)font->height - 
-                     font->descent * size / (float)font->height;
+        float u1 = ch->tx;
+        float v1 = ch->ty + ch->bh / (float)font->height;
+        float u2 = ch->tx + ch->bw / (float)font->width;
+        float v2 = ch->ty;
 
-        if (ch->bw > 0 && ch->bh > 0) {
-            if (vertex_count_3D_textured + 6 > MAX_VERTICES) {
-                fprintf(stderr, "3D textured vertex buffer full\n");
+        Vertex quad[6] = {
+            {.pos = {position[0] + xpos, position[1] + ypos + charHeight, position[2]},
+             .color = {color.r, color.g, color.b, color.a},
+             .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u2, v1}},
+            {.pos = {position[0] + xpos, position[1] + ypos, position[2]},
+             .color = {color.r, color.g, color.b, color.a},
+             .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u2, v2}},
+            {.pos = {position[0] + xpos + charWidth, position[1] + ypos, position[2]},
+             .color = {color.r, color.g, color.b, color.a},
+             .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u1, v2}},
+            {.pos = {position[0] + xpos, position[1] + ypos + charHeight, position[2]},
+             .color = {color.r, color.g, color.b, color.a},
+             .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u2, v1}},
+            {.pos = {position[0] + xpos + charWidth, position[1] + ypos, position[2]},
+             .color = {color.r, color.g, color.b, color.a},
+             .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u1, v2}},
+            {.pos = {position[0] + xpos + charWidth, position[1] + ypos + charHeight, position[2]},
+             .color = {color.r, color.g, color.b, color.a},
+             .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u1, v1}}
+        };
+        
+        Texture2D* pageTexture = &font->pages[ch->page].texture;
+        int batchIndex = -1;
+        if (texture3DBatchCount > 0 && 
+            texture3DBatches[texture3DBatchCount - 1].texture == pageTexture) {
+            batchIndex = texture3DBatchCount - 1;
+        } else {
+            if (texture3DBatchCount >= MAX_TEXTURES) {
+                fprintf(stderr, "Too many 3D texture batches!\n");
                 return;
             }
-
-            float u1 = ch->tx;
-            float v1 = ch->ty + ch->bh / (float)font->height;
-            float u2 = ch->tx + ch->bw / (float)font->width;
-            float v2 = ch->ty;
-
-            Vertex quad[6] = {
-                {.pos = {position[0] + xpos, position[1] + ypos + charHeight, position[2]},
-                 .color = {color.r, color.g, color.b, color.a},
-                 .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u2, v1}},
-                {.pos = {position[0] + xpos, position[1] + ypos, position[2]},
-                 .color = {color.r, color.g, color.b, color.a},
-                 .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u2, v2}},
-                {.pos = {position[0] + xpos + charWidth, position[1] + ypos, position[2]},
-                 .color = {color.r, color.g, color.b, color.a},
-                 .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u1, v2}},
-                {.pos = {position[0] + xpos, position[1] + ypos + charHeight, position[2]},
-                 .color = {color.r, color.g, color.b, color.a},
-                 .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u2, v1}},
-                {.pos = {position[0] + xpos + charWidth, position[1] + ypos, position[2]},
-                 .color = {color.r, color.g, color.b, color.a},
-                 .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u1, v2}},
-                {.pos = {position[0] + xpos + charWidth, position[1] + ypos + charHeight, position[2]},
-                 .color = {color.r, color.g, color.b, color.a},
-                 .normal = {0.0f, 0.0f, 1.0f}, .texCoord = {u1, v1}}
-            };
-            
-            int batchIndex = -1;
-            if (texture3DBatchCount > 0 && 
-                texture3DBatches[texture3DBatchCount - 1].texture == &font->texture) {
-                batchIndex = texture3DBatchCount - 1;
-            } else {
-                if (texture3DBatchCount >= MAX_TEXTURES) {
-                    fprintf(stderr, "Too many 3D texture batches!\n");
-                    return;
-                }
-                batchIndex = texture3DBatchCount++;
-                texture3DBatches[batchIndex].texture = &font->texture;
-                texture3DBatches[batchIndex].startVertex = vertex_count_3D_textured;
-                texture3DBatches[batchIndex].vertexCount = 0;
-            }
-            
-            memcpy(&vertices3D_textured[vertex_count_3D_textured], quad, sizeof(quad));
-            vertex_count_3D_textured += 6;
-            texture3DBatches[batchIndex].vertexCount += 6;
+            batchIndex = texture3DBatchCount++;
+            texture3DBatches[batchIndex].texture = pageTexture;
+            texture3DBatches[batchIndex].startVertex = vertex_count_3D_textured;
+            texture3DBatches[batchIndex].vertexCount = 0;
         }
         
-        x += ch->ax * size / (float)font->height;
-        p += bytes_read;
+        memcpy(&vertices3D_textured[vertex_count_3D_textured], quad, sizeof(quad));
+        vertex_count_3D_textured += 6;
+        texture3DBatches[batchIndex].vertexCount += 6;
     }
-    
-    // FIX: Update texture once after rendering all characters
-    update_texture_if_needed(font);
 }
 
 // Static variables for FPS calculation
@@ -604,26 +1743,32 @@ void fps(Font* font, float x, float y, Color color) {
 void destroy_font(Font* font) {
     if (!font) return;
     
-    // Free hash table
-    for (int i = 0; i < FONT_HASH_SIZE; i++) {
-        CharNode *node = font->char_table[i];
-        while (node) {
-            CharNode *next = node->next;
-            free(node);
-            node = next;
+    for (uint32_t i = 0; i < liveFontCount; i++) {
+        if (liveFonts[i] == font) {
+            liveFonts[i] = liveFonts[--liveFontCount];
+            break;
         }
     }
     
-    // Free atlas buffer
-    free(font->atlas_buffer);
+    raster_forget(font);
+    text_cache_forget(font);
+    
+    // Free glyph store
+    free(font->glyphs);
+    free(font->glyph_codepoints);
+    free(font->free_glyphs);
+    free(font->table);
     
     // Free FreeType face
     if (font->face) {
-        FT_Done_Face(font->face);
+        close_face(font->face);
     }
+    free(font->path);
     
-    // Free texture
-    destroy_texture(&context, &font->texture);
+    // Free atlas pages
+    for (uint32_t i = 0; i < font->page_count; i++) {
+        destroy_page(&font->pages[i]);
+    }
     free(font);
 }
 
@@ -644,4 +1789,29 @@ float character_width(Font* font, uint32_t codepoint) {
     return ch ? ch->ax : 0;
 }
 
-
+// Grayscale, white glyphs on black, pages stacked top to bottom. Rows are
+// flipped back so the glyphs read upright.
+bool save_font_atlas_png(Font* font, const char* filename) {
+    if (!font || font->page_count == 0) return false;
+    
+    size_t row_size = (size_t)font->width * ATLAS_TEXEL_SIZE;
+    uint32_t height = font->height * font->page_count;
+    unsigned char* pixels = malloc(row_size * height);
+    if (!pixels) {
+        fprintf(stderr, "Memory allocation failed for font atlas image\n");
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < font->page_count; i++) {
+        for (uint32_t y = 0; y < font->height; y++) {
+            memcpy(pixels + ((size_t)i * font->height + y) * row_size,
+                   font->pages[i].buffer + (size_t)(font->height - 1 - y) * row_size,
+                   row_size);
+        }
+    }
+    
+    bool ok = stbi_write_png(filename, font->width, height, 1, pixels, (int)row_size) != 0;
+    if (!ok) fprintf(stderr, "Failed to write font atlas to %s\n", filename);
+    free(pixels);
+    return ok;
+}
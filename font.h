@@ -5,6 +5,33 @@
 #include FT_FREETYPE_H
 #include "renderer.h"
 #include "common.h"
+#include "skyline.h"
+
+#define FONT_ATLAS_SIZE     2048  // Glyph atlas page width and height
+#define FONT_MAX_PAGES      4     // Past this the least recently used page is recycled
+#define FONT_GLYPH_PADDING  1     // Empty texels right of and above each glyph
+#define FONT_MAX_DIRTY_RECTS 32   // Per page, past this they merge into their bounds
+#define MAX_FONTS           16    // Live fonts whose atlas uploads are recorded per frame
+#define FONT_SDF_SPREAD     8     // Distance range each side of an SDF glyph edge, in load size pixels
+
+// Shaped run cache shared by text(), text3D() and text_width(), the least
+// recently used runs are evicted past either bound
+#define TEXT_CACHE_MAX_RUNS    1024   // Power of two
+#define TEXT_CACHE_MAX_GLYPHS  65536  // Glyphs over all cached runs
+#define TEXT_CACHE_MAX_LENGTH  4096   // Longer strings are laid out on every call
+
+// Preloaded atlases are kept in $XDG_CACHE_HOME/obsidian/fonts (or
+// ~/.cache/obsidian/fonts) and mapped back by the next load_font() of the
+// same file and size. Bump the version when rasterization or the file
+// layout changes; the font file's contents and the FreeType version are
+// checked on their own.
+#define FONT_CACHE_VERSION  2
+extern bool fontDiskCacheEnabled;
+
+// Glyph rasterization, see font_get_character()
+#define FONT_RASTER_BUDGET  8     // New glyphs rendered on the render thread per frame, the rest go to the worker
+#define FONT_MERGE_BUDGET   256   // Worker glyphs packed into the atlas per frame
+#define FONT_RASTER_QUEUE   4096  // Glyphs with the worker at once
 
 typedef struct {
     float ax;  // advance.x
@@ -15,44 +42,117 @@ typedef struct {
     float bt;  // bitmap_top
     float tx;  // x offset of glyph in texture coordinates
     float ty;  // y offset of glyph in texture coordinates
+    uint32_t page;  // Atlas page holding the bitmap, none for blank glyphs
 } Character;
 
-// Hash table for character storage
-#define FONT_HASH_SIZE 256
-typedef struct CharNode {
+// Glyph store, see Font
+#define FONT_DIRECT_GLYPHS     256  // ASCII and Latin-1 index a plain array
+#define FONT_GLYPH_TABLE_MIN   64   // Initial open addressing slots, power of two
+typedef struct {
     uint32_t codepoint;
-    Character character;
-    struct CharNode *next;
-} CharNode;
+    uint32_t glyph;               // Index into Font.glyphs, 0 = empty slot
+} FontGlyphSlot;
+
+typedef struct {
+    uint32_t x, y, width, height;
+} FontDirtyRect;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;             // Laid out again, new or stale
+    uint64_t evictions;
+    uint32_t runs;               // Currently cached
+    uint32_t glyphs;
+} TextCacheStats;
+
+extern TextCacheStats textCacheStats;
+
+// One line of text_break_lines()
+typedef struct {
+    uint32_t start;              // Byte offset into the text
+    uint32_t length;             // Bytes, without the newline or the space broken at
+    float width;
+} TextLine;
+
+typedef struct {
+    uint64_t immediate;          // Rendered on the render thread, within the frame budget
+    uint64_t queued;             // Handed to the worker
+    uint64_t merged;             // Worker glyphs packed into the atlas
+    uint64_t failed;             // Worker glyphs FreeType couldn't render
+    uint32_t pending;            // With the worker right now
+} FontRasterStats;
 
+extern FontRasterStats fontRasterStats;
+
+// One fixed size atlas texture. Glyphs are skyline packed and never move;
+// a page is only ever emptied whole, when it is recycled.
 typedef struct {
-    Texture2D texture;           // Vulkan texture atlas
-    unsigned int width;          // width of the texture atlas
-    unsigned int height;         // height of the texture atlas
+    Texture2D texture;
+    unsigned char *buffer;        // Coverage, one byte per texel, kept for dynamic updates
+    Skyline skyline;
+    uint64_t last_used;           // Glyph frame one of its glyphs was last fetched
+    
+    // Regions of buffer newer than the texture
+    FontDirtyRect dirty[FONT_MAX_DIRTY_RECTS];
+    uint32_t dirty_count;
+} FontAtlasPage;
+
+typedef struct {
+    unsigned int width;          // width of an atlas page
+    unsigned int height;         // height of an atlas page
     int ascent;                  // font ascent
     int descent;                 // font descent
+    int size;                    // pixel size the glyphs are rasterized at
+    bool sdf;                    // pages hold distance fields, see load_font_sdf()
+    
+    // Loaded characters, contiguous. Index 0 is never used so 0 can mean
+    // "not loaded" in the lookup tables. Slots of evicted glyphs are reused.
+    Character *glyphs;
+    uint32_t *glyph_codepoints;  // Per glyph, UINT32_MAX when the slot is free
+    uint32_t glyph_count;        // Slots handed out, including index 0
+    uint32_t glyph_capacity;
+    uint32_t *free_glyphs;       // Stack of freed slots
+    uint32_t free_glyph_count;
     
-    // Dynamic character storage
-    CharNode *char_table[FONT_HASH_SIZE];
+    uint32_t direct[FONT_DIRECT_GLYPHS];  // Codepoints below FONT_DIRECT_GLYPHS
+    FontGlyphSlot *table;                 // Everything else, linear probing
+    uint32_t table_capacity;
+    uint32_t table_count;
+    uint32_t glyph_generation;   // Bumped when evicted slots may be reused, stales cached runs
     
-    // Atlas packing state
-    int atlas_x;
-    int atlas_y;
-    int row_height;
+    // Glyph atlas, pages are created as they fill up
+    FontAtlasPage pages[FONT_MAX_PAGES];
+    uint32_t page_count;
     
     // FreeType face for loading new glyphs
     FT_Face face;
-    unsigned char *atlas_buffer;  // Keep buffer for dynamic updates
-    bool needs_update;            // Flag to reupload texture
+    // The rasterization worker's own face, opened on its first glyph
+    FT_Face raster_face;
+    char* path;
 } Font;
 
 void init_free_type(void);
 Font* load_font(const char* fontPath, int fontSize);
+// Glyphs become signed distance fields rasterized once at fontSize, drawn
+// sharp at any text_sized() or text3D() size by the SDF text pipelines
+Font* load_font_sdf(const char* fontPath, int fontSize);
 void destroy_font(Font* font);
 
 // Updated to use uint32_t codepoints
 float character(Font* font, uint32_t codepoint, float x, float y, Color color);
 void text(Font* font, const char* text, float x, float y, Color color);
+// size is the pixel size to draw at, font->size draws like text()
+void text_sized(Font* font, const char* text, float x, float y, float size, Color color);
+// Measurement at the font's own size, from the same cached layout as
+// text(). Carets and line breaks are worked out once per cached string.
+// Widest line
+float text_width(Font* font, const char* text);
+// Pen x of a caret before byte index, from the start of its line
+float text_caret_x(Font* font, const char* text, size_t index);
+// Break into lines no wider than maxWidth, at the last space that fits or
+// inside a word too long for a line, and at every newline. Writes up to
+// maxLines and returns how many lines there are.
+uint32_t text_break_lines(Font* font, const char* text, float maxWidth, TextLine* lines, uint32_t maxLines);
 void text3D(Font* font, const char* text_str, vec3 position, float size, Color color);
 
 void fps(Font* font, float x, float y, Color color);
@@ -61,8 +161,36 @@ float font_height(Font* font);
 float font_width(Font* font);
 float character_width(Font* font, uint32_t codepoint);
 
-// Internal: Get or load a character
+// Get or load a character. The pointer stays valid until the next glyph
+// load, which may grow the store. Past FONT_RASTER_BUDGET new glyphs a
+// frame, a glyph seen for the first time is rendered in the background and
+// this returns NULL for it until a later frame.
 Character* font_get_character(Font* font, uint32_t codepoint);
+// font_get_character() for a whole run, out[i] is NULL for control
+// codepoints and glyphs that failed to load. Every pointer stays valid
+// until the next load after the call.
+void font_get_characters(Font* font, const uint32_t* codepoints, uint32_t count, Character** out);
+// Sum of the advances of a run, one batch lookup
+float characters_width(Font* font, const uint32_t* codepoints, uint32_t count);
+// Upload the font's new glyphs right away, blocking. Frames don't need
+// this, fonts_record_uploads() handles them.
 void font_flush_updates(Font* font);
 
+// Copy the dirty atlas regions of every live font into the frame's staging
+// buffer and record the copies into cmd, outside a render pass. The frame's
+// fence must have been waited on.
+void fonts_record_uploads(VkCommandBuffer cmd, uint32_t frameIndex);
+void fonts_shutdown(void);
+
+// Once per frame. Pages with glyphs fetched in the current frame are never
+// recycled, so nothing drawn this frame loses its bitmap. Glyphs the worker
+// finished are packed into the atlas here and upload with the frame.
+void font_next_frame(void);
+
+// Count texture as drawn from this frame if it is a glyph atlas page.
+// Retained 2D layers draw glyphs they fetched frames ago, they stamp the
+// pages of their batches so a miss later in the frame can't recycle them.
+void font_mark_texture_used(const Texture2D* texture);
+
+// Debug dump of every page as one grayscale PNG
 bool save_font_atlas_png(Font* font, const char* filename);
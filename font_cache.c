@@ -0,0 +1,56 @@
+#include "font_cache.h"
+#include <string.h>
+
+bool font_cache_parse(const unsigned char* data, size_t size, const FontCacheHeader* expected,
+                      uint32_t width, uint32_t height, uint32_t texel_size, uint32_t max_pages,
+                      FontCacheView* view) {
+    if (size < sizeof(FontCacheHeader)) return false;
+
+    FontCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(&header, expected, FONT_CACHE_KEY_SIZE) != 0) return false;
+    if (max_pages > FONT_CACHE_MAX_PAGES) max_pages = FONT_CACHE_MAX_PAGES;
+    if (header.page_count < 1 || header.page_count > max_pages) return false;
+
+    view->glyph_stride = sizeof(uint32_t) + header.glyph_size;
+    if (header.glyph_count > (size - sizeof(FontCacheHeader)) / view->glyph_stride) return false;
+    view->glyphs = data + sizeof(FontCacheHeader);
+    view->glyph_count = header.glyph_count;
+    view->page_count = header.page_count;
+
+    // Sizes are checked against what's left before they're multiplied, so
+    // nothing past the end is ever read
+    size_t offset = sizeof(FontCacheHeader) + (size_t)header.glyph_count * view->glyph_stride;
+    for (uint32_t i = 0; i < header.page_count; i++) {
+        FontCachePageView* page = &view->pages[i];
+        if (size - offset < sizeof(FontCachePage)) return false;
+
+        // Only 4 byte aligned after the glyphs
+        memcpy(&page->info, data + offset, sizeof(FontCachePage));
+        offset += sizeof(FontCachePage);
+
+        uint32_t rows = page->info.rows;
+        uint32_t node_count = page->info.node_count;
+        if (rows > height || node_count == 0 || node_count > width) return false;
+        if ((size - offset) / sizeof(SkylineNode) < node_count) return false;
+        page->nodes = (const SkylineNode*)(data + offset);
+        offset += (size_t)node_count * sizeof(SkylineNode);
+
+        // The saved rows must hold everything under the skyline
+        uint32_t x = 0;
+        for (uint32_t n = 0; n < node_count; n++) {
+            SkylineNode node;
+            memcpy(&node, &page->nodes[n], sizeof(node));
+            if (node.x != x || node.width == 0 || node.width > width - x || node.y > rows) return false;
+            x += node.width;
+        }
+        if (x != width) return false;
+
+        size_t texels = (size_t)rows * width * texel_size;
+        if (size - offset < texels) return false;
+        page->texels = data + offset;
+        offset += texels;
+    }
+
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "skyline.h"
+
+// File layout of the font atlas disk cache, see font.c. The parser only
+// knows the layout, not FreeType or Vulkan, so it can be checked against
+// truncated and corrupt files on its own.
+//
+//   FontCacheHeader
+//   glyph_count records: uint32_t codepoint, glyph_size bytes of Character
+//   page_count times: FontCachePage, node_count SkylineNodes,
+//                     rows full width rows of texels
+
+#define FONT_CACHE_MAGIC "OBSATLAS"
+#define FONT_CACHE_MAX_PAGES 16
+
+typedef struct {
+    char magic[8];
+    uint32_t version;           // FONT_CACHE_VERSION
+    uint32_t freetype_version;  // major << 16 | minor << 8 | patch
+    uint64_t font_hash;         // Contents of the font file
+    uint64_t font_bytes;
+    int32_t size;
+    uint32_t sdf_spread;        // 0 for coverage fonts
+    uint32_t atlas_size;
+    uint32_t glyph_size;        // sizeof(Character)
+    // Not part of the key
+    uint32_t glyph_count;
+    uint32_t page_count;
+} FontCacheHeader;
+
+#define FONT_CACHE_KEY_SIZE offsetof(FontCacheHeader, glyph_count)
+
+typedef struct {
+    uint32_t rows;              // Up to the top of the skyline
+    uint32_t node_count;
+    uint64_t used_area;
+} FontCachePage;
+
+typedef struct {
+    FontCachePage info;
+    const SkylineNode* nodes;     // Cover [0, width) in order, no higher than rows
+    const unsigned char* texels;  // rows * width * texel_size bytes
+} FontCachePageView;
+
+typedef struct {
+    const unsigned char* glyphs;  // glyph_count records of glyph_stride bytes
+    uint32_t glyph_count;
+    size_t glyph_stride;
+    uint32_t page_count;
+    FontCachePageView pages[FONT_CACHE_MAX_PAGES];
+} FontCacheView;
+
+// Check a mapped cache file against the expected key and atlas page size
+// and point view into it. False when the key differs, there are more than
+// max_pages pages or any section is truncated or out of range; glyph
+// records are left to the caller.
+bool font_cache_parse(const unsigned char* data, size_t size, const FontCacheHeader* expected,
+                      uint32_t width, uint32_t height, uint32_t texel_size, uint32_t max_pages,
+                      FontCacheView* view);
@@ -2,12 +2,33 @@
 layout(location = 0) in vec4 fragColor;
 layout(location = 1) in vec3 fragNormal;
 layout(location = 2) in vec3 fragWorldPos;
-layout(location = 3) in flat int fragAmbientOcclusionEnabled;
 layout(location = 4) in vec2 fragTexCoord;
-layout(location = 5) in flat int fragIsUnlit;  // NEW
 
 layout(location = 0) out vec4 outColor;
 
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 vp;
+    vec4 cameraPos;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 skyColor;
+    vec4 groundColor;
+    float time;
+    float deltaTime;
+    float fogDensity;
+} ubo;
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    mat3 normalMatrix;    // Inverse-transpose of model, computed on the CPU
+    float alphaCutoff;
+} pc;
+
+// Pipeline variants, see createPipelineVariants() in vulkan_setup.c
+layout(constant_id = 0) const bool UNLIT = false;
+layout(constant_id = 1) const bool ALPHA_MASK = false;
+layout(constant_id = 2) const bool AMBIENT_OCCLUSION = true;
+
 // Simple directional-based AO approximation
 float cheapAO(vec3 normal) {
     // Surfaces facing up are brighter, down are darker
@@ -18,8 +39,12 @@ float cheapAO(vec3 normal) {
 }
 
 void main() {
-    // NEW: If unlit, just output the base color directly
-    if (fragIsUnlit != 0) {
+    // Only MASK materials get a discard, opaque variants keep early-Z
+    if (ALPHA_MASK && fragColor.a < pc.alphaCutoff) {
+        discard;
+    }
+    
+    if (UNLIT) {
         outColor = fragColor;
         return;
     }
@@ -28,24 +53,24 @@ void main() {
     vec3 N = normalize(fragNormal);
     
     // Calculate simple AO only if enabled
-    float ao = fragAmbientOcclusionEnabled != 0 ? cheapAO(N) : 1.0;
+    float ao = AMBIENT_OCCLUSION ? cheapAO(N) : 1.0;
     
     // Sun lighting
-    vec3 lightDir = normalize(vec3(0.3, 0.8, 0.5));
+    vec3 lightDir = ubo.lightDir.xyz;
     float diff = max(dot(N, lightDir), 0.0);
     
     // Sky color (blue ambient)
-    vec3 skyColor = vec3(0.3, 0.5, 0.7);
+    vec3 skyColor = ubo.skyColor.rgb;
     
     // Ground color (brownish)
-    vec3 groundColor = vec3(0.2, 0.15, 0.1);
+    vec3 groundColor = ubo.groundColor.rgb;
     
     // Hemisphere lighting (surfaces facing up get sky, down get ground)
     float hemiBlend = dot(N, vec3(0, 1, 0)) * 0.5 + 0.5;
     vec3 ambient = mix(groundColor, skyColor, hemiBlend) * ao;
     
     // Direct lighting
-    vec3 sunColor = vec3(1.0, 0.95, 0.8);
+    vec3 sunColor = ubo.lightColor.rgb;
     vec3 direct = sunColor * diff;
     
     // Combine
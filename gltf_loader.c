@@ -1,7 +1,14 @@
 #define CGLTF_IMPLEMENTATION
 #include "gltf_loader.h"
+#include <float.h>
 #include <string.h>
 #include "context.h"
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+#include "meshlet.h"
+#include "occlusion.h"
+
+bool meshQuantization = true;
 
 static int32_t gltf_texture_indices[MAX_TEXTURES];
 static size_t gltf_texture_count = 0;
@@ -151,7 +158,71 @@ static MorphData* load_morph_targets(cgltf_primitive* prim) {
     return morph_data;
 }
 
-static Mesh create_mesh_from_primitive(cgltf_primitive* prim, cgltf_data* data, const char* name) {
+// Host visible buffer filled with data, the same memory setup mesh_update_morph
+// relies on for rewriting vertices in place
+static void create_mesh_buffer(VkBufferUsageFlags usage, const void* data, VkDeviceSize size,
+                               VkBuffer* buffer, VkDeviceMemory* memory) {
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+
+    vkCreateBuffer(context.device, &bufferInfo, NULL, buffer);
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(context.device, *buffer, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(
+            context.physicalDevice, 
+            memRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        )
+    };
+
+    vkAllocateMemory(context.device, &allocInfo, NULL, memory);
+    vkBindBufferMemory(context.device, *buffer, *memory, 0);
+
+    void* data_ptr;
+    vkMapMemory(context.device, *memory, 0, size, 0, &data_ptr);
+    memcpy(data_ptr, data, size);
+    vkUnmapMemory(context.device, *memory);
+}
+
+// Position bounds over every primitive of a mesh. Packed primitives are all
+// quantized against these, so a vertex on an edge two primitives share
+// lands on the same grid point in both.
+static void mesh_position_bounds(cgltf_mesh* gltf_mesh, vec3 min, vec3 max) {
+    glm_vec3_fill(min, FLT_MAX);
+    glm_vec3_fill(max, -FLT_MAX);
+
+    for (size_t i = 0; i < gltf_mesh->primitives_count; i++) {
+        cgltf_primitive* prim = &gltf_mesh->primitives[i];
+        for (size_t j = 0; j < prim->attributes_count; j++) {
+            if (prim->attributes[j].type != cgltf_attribute_type_position) continue;
+
+            cgltf_accessor* accessor = prim->attributes[j].data;
+            for (size_t v = 0; v < accessor->count; v++) {
+                vec3 pos = {0.0f, 0.0f, 0.0f};
+                cgltf_accessor_read_float(accessor, v, pos, 3);
+                glm_vec3_minv(min, pos, min);
+                glm_vec3_maxv(max, pos, max);
+            }
+        }
+    }
+
+    if (min[0] > max[0]) {
+        glm_vec3_zero(min);
+        glm_vec3_zero(max);
+    }
+}
+
+static Mesh create_mesh_from_primitive(cgltf_primitive* prim, cgltf_data* data, const char* name,
+                                       vec3 bounds_min, vec3 bounds_max) {
     Mesh mesh = {0};
     mesh.name = strdup(name);
     mesh.textureIndex = -1;
@@ -161,6 +232,7 @@ static Mesh create_mesh_from_primitive(cgltf_primitive* prim, cgltf_data* data,
     mesh.is_unlit = false;
     mesh.alpha_mode = 0; // OPAQUE by default
     mesh.alpha_cutoff = 0.5f; // Default cutoff
+    mesh.double_sided = false; // glTF default, back faces are culled
     glm_mat4_identity(mesh.model);
     glm_mat4_identity(mesh.local_transform);
 
@@ -230,6 +302,7 @@ static Mesh create_mesh_from_primitive(cgltf_primitive* prim, cgltf_data* data,
         
         // Check for unlit extension using cgltf's built-in flag
         is_unlit = prim->material->unlit;
+        mesh.double_sided = prim->material->double_sided;
         
         // Load alpha mode from glTF material
         switch (prim->material->alpha_mode) {
@@ -310,48 +383,102 @@ static Mesh create_mesh_from_primitive(cgltf_primitive* prim, cgltf_data* data,
     // Load morph targets BEFORE expanding indices
     mesh.morph_data = load_morph_targets(prim);
     
-    // Expand indices or use vertices directly
+    mesh_compute_bounds(&mesh, vertices, vertex_count);
+    
+    // Morphed meshes rewrite an expanded copy of their vertices every frame
+    // and stay non-indexed. Everything else keeps its index buffer and gets
+    // a LOD chain stored after LOD 0 in the same buffer.
     Vertex* final_vertices = NULL;
     size_t final_vertex_count = 0;
+    uint32_t* lod_indices[MESH_MAX_LODS] = {0};
+    size_t lod_index_counts[MESH_MAX_LODS] = {0};
+    float lod_errors[MESH_MAX_LODS] = {0};
     
-    if (indices) {
+    if (mesh.morph_data && indices) {
         final_vertex_count = index_count;
         final_vertices = malloc(final_vertex_count * sizeof(Vertex));
         
         // Expand vertices AND store the index mapping for morphing
-        if (mesh.morph_data) {
-            mesh.morph_data->index_map = malloc(index_count * sizeof(uint32_t));
-        }
+        mesh.morph_data->index_map = malloc(index_count * sizeof(uint32_t));
         
         for (size_t i = 0; i < index_count; i++) {
             final_vertices[i] = vertices[indices[i]];
             
             // Store which original vertex this expanded vertex came from
-            if (mesh.morph_data) {
-                mesh.morph_data->index_map[i] = indices[i];
-            }
+            mesh.morph_data->index_map[i] = indices[i];
         }
         
         // Store base vertices for morphing (unexpanded)
-        if (mesh.morph_data) {
-            mesh.morph_data->base_vertices = malloc(vertex_count * sizeof(Vertex));
-            memcpy(mesh.morph_data->base_vertices, vertices, vertex_count * sizeof(Vertex));
-            mesh.morph_data->base_vertex_count = vertex_count;
-        }
+        mesh.morph_data->base_vertices = malloc(vertex_count * sizeof(Vertex));
+        memcpy(mesh.morph_data->base_vertices, vertices, vertex_count * sizeof(Vertex));
+        mesh.morph_data->base_vertex_count = vertex_count;
         
         free(vertices);
         free(indices);
-    } else {
+    } else if (mesh.morph_data) {
         final_vertices = vertices;
         final_vertex_count = vertex_count;
         
         // No indices, so identity mapping
-        if (mesh.morph_data) {
-            mesh.morph_data->base_vertices = malloc(vertex_count * sizeof(Vertex));
-            memcpy(mesh.morph_data->base_vertices, vertices, vertex_count * sizeof(Vertex));
-            mesh.morph_data->base_vertex_count = vertex_count;
-            mesh.morph_data->index_map = NULL;  // No mapping needed
+        mesh.morph_data->base_vertices = malloc(vertex_count * sizeof(Vertex));
+        memcpy(mesh.morph_data->base_vertices, vertices, vertex_count * sizeof(Vertex));
+        mesh.morph_data->base_vertex_count = vertex_count;
+        mesh.morph_data->index_map = NULL;  // No mapping needed
+    } else {
+        if (!indices) {
+            index_count = vertex_count;
+            indices = malloc(index_count * sizeof(uint32_t));
+            for (size_t i = 0; i < index_count; i++) indices[i] = (uint32_t)i;
+        }
+        
+        mesh.lod_count = simplify_build_lod_chain(indices, index_count, vertices[0].pos, sizeof(Vertex),
+                                                  vertex_count, MESH_MAX_LODS, lod_indices,
+                                                  lod_index_counts, lod_errors);
+        free(indices);
+        
+        // Triangle order for the post-transform cache and overdraw per LOD,
+        // then vertices renumbered in the order LOD 0 first touches them
+        VertexCacheStats before = analyze_vertex_cache(lod_indices[0], lod_index_counts[0],
+                                                       vertex_count, VERTEX_CACHE_SIZE);
+        for (uint32_t l = 0; l < mesh.lod_count; l++) {
+            optimize_overdraw(lod_indices[l], lod_indices[l], lod_index_counts[l],
+                              vertices[0].pos, sizeof(Vertex), vertex_count, OVERDRAW_ACMR_THRESHOLD);
         }
+        vertex_count = optimize_vertex_fetch(vertices, sizeof(Vertex), vertex_count, lod_indices,
+                                             lod_index_counts, mesh.lod_count);
+        VertexCacheStats after = analyze_vertex_cache(lod_indices[0], lod_index_counts[0],
+                                                      vertex_count, VERTEX_CACHE_SIZE);
+        
+        printf("  -> Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+               before.acmr, after.acmr, before.atvr, after.atvr);
+        
+        // Clusters over the final LOD 0 order, which starts the index buffer
+        mesh.meshlets = meshlets_build(lod_indices[0], lod_index_counts[0], vertices[0].pos,
+                                       sizeof(Vertex), vertex_count);
+        if (mesh.meshlets) {
+            printf("  -> Meshlets: %u\n", mesh.meshlets->count);
+        }
+        
+        // Opaque meshes occlude with their coarsest LOD that stays close to
+        // the real surface, as long as it's small enough to rasterize on the CPU
+        if (mesh.alpha_mode == 0) {
+            int occluder_lod = -1;
+            for (uint32_t l = 0; l < mesh.lod_count; l++) {
+                if (lod_errors[l] > OCCLUDER_MAX_ERROR * mesh.bounds_radius) break;
+                if (lod_index_counts[l] / 3 <= OCCLUDER_MAX_TRIANGLES) occluder_lod = (int)l;
+            }
+            if (occluder_lod >= 0) {
+                mesh.occluder = occluder_build(lod_indices[occluder_lod], lod_index_counts[occluder_lod],
+                                               vertices[0].pos, sizeof(Vertex), vertex_count);
+                printf("  -> Occluder: %zu tris (LOD %d)\n", lod_index_counts[occluder_lod] / 3, occluder_lod);
+            }
+        }
+        
+        // Per-vertex colors don't survive packing, those meshes stay full size
+        mesh.packed = meshQuantization && !color_accessor;
+        
+        final_vertices = vertices;
+        final_vertex_count = vertex_count;
     }
 
     mesh.vertexCount = final_vertex_count;
@@ -377,38 +504,61 @@ static Mesh create_mesh_from_primitive(cgltf_primitive* prim, cgltf_data* data,
     }
 
     // Create Vulkan vertex buffer
-    VkBufferCreateInfo bufferInfo = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = final_vertex_count * sizeof(Vertex),
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
-    };
-
-    vkCreateBuffer(context.device, &bufferInfo, NULL, &mesh.vertexBuffer);
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(context.device, mesh.vertexBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memRequirements.size,
-        .memoryTypeIndex = findMemoryType(
-            context.physicalDevice, 
-            memRequirements.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        )
-    };
-
-    vkAllocateMemory(context.device, &allocInfo, NULL, &mesh.vertexBufferMemory);
-    vkBindBufferMemory(context.device, mesh.vertexBuffer, mesh.vertexBufferMemory, 0);
-
-    void* data_ptr;
-    vkMapMemory(context.device, mesh.vertexBufferMemory, 0, bufferInfo.size, 0, &data_ptr);
-    memcpy(data_ptr, final_vertices, final_vertex_count * sizeof(Vertex));
-    vkUnmapMemory(context.device, mesh.vertexBufferMemory);
+    if (mesh.packed) {
+        PackedVertex* packed = malloc(final_vertex_count * sizeof(PackedVertex));
+        quantize_vertices(packed, final_vertices[0].pos, final_vertices[0].normal, final_vertices[0].texCoord,
+                          sizeof(Vertex), final_vertex_count, bounds_min, bounds_max, (float*)mesh.dequantize);
+        mesh.base_color = pack_unorm4x8(base_color);
+        
+        create_mesh_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, packed,
+                           final_vertex_count * sizeof(PackedVertex),
+                           &mesh.vertexBuffer, &mesh.vertexBufferMemory);
+        free(packed);
+        
+        printf("  -> Packed vertices: %zu KB -> %zu KB\n",
+               final_vertex_count * sizeof(Vertex) / 1024,
+               final_vertex_count * sizeof(PackedVertex) / 1024);
+    } else {
+        create_mesh_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, final_vertices,
+                           final_vertex_count * sizeof(Vertex),
+                           &mesh.vertexBuffer, &mesh.vertexBufferMemory);
+    }
 
     free(final_vertices);
 
+    // All LODs back to back in one index buffer
+    if (mesh.lod_count > 0) {
+        size_t total_indices = 0;
+        for (uint32_t l = 0; l < mesh.lod_count; l++) total_indices += lod_index_counts[l];
+        
+        uint32_t* all_indices = malloc(total_indices * sizeof(uint32_t));
+        size_t offset = 0;
+        
+        for (uint32_t l = 0; l < mesh.lod_count; l++) {
+            memcpy(all_indices + offset, lod_indices[l], lod_index_counts[l] * sizeof(uint32_t));
+            mesh.lods[l] = (MeshLOD){
+                .firstIndex = (uint32_t)offset,
+                .indexCount = (uint32_t)lod_index_counts[l],
+                .error = lod_errors[l],
+            };
+            offset += lod_index_counts[l];
+            free(lod_indices[l]);
+        }
+        
+        create_mesh_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, all_indices,
+                           total_indices * sizeof(uint32_t),
+                           &mesh.indexBuffer, &mesh.indexBufferMemory);
+        free(all_indices);
+        
+        if (mesh.lod_count > 1) {
+            printf("  -> LODs:");
+            for (uint32_t l = 0; l < mesh.lod_count; l++) {
+                printf(" %u tris (err %.4f)", mesh.lods[l].indexCount / 3, mesh.lods[l].error);
+            }
+            printf("\n");
+        }
+    }
+
     printf("Loaded mesh '%s' with %zu vertices", mesh.name, final_vertex_count);
     if (is_unlit) {
         printf(" (UNLIT)");
@@ -437,13 +587,16 @@ static void process_node(cgltf_node* node, cgltf_data* data, Meshes* meshes, mat
     
     if (node->mesh) {
         cgltf_mesh* gltf_mesh = node->mesh;
+        vec3 bounds_min, bounds_max;
+        mesh_position_bounds(gltf_mesh, bounds_min, bounds_max);
         
         for (size_t i = 0; i < gltf_mesh->primitives_count; i++) {
             char mesh_name[256];
             snprintf(mesh_name, sizeof(mesh_name), "%s_prim_%zu", 
                      node->name ? node->name : "node", i);
             
-            Mesh mesh = create_mesh_from_primitive(&gltf_mesh->primitives[i], data, mesh_name);
+            Mesh mesh = create_mesh_from_primitive(&gltf_mesh->primitives[i], data, mesh_name,
+                                                   bounds_min, bounds_max);
             
             if (mesh.vertexCount > 0) {
                 mesh.node = node;
@@ -583,6 +736,21 @@ bool load_gltf_animations(cgltf_data* data, GLTFInstance* instance) {
     return true;
 }
 
+// Animated meshes have their model rewritten every frame, the occlusion
+// workers leave them alone
+static void mark_animated_meshes(Scene* scene, GLTFInstance* instance) {
+    for (size_t a = 0; a < instance->animation_count; a++) {
+        Animation* anim = &instance->animations[a];
+        for (size_t c = 0; c < anim->channel_count; c++) {
+            size_t mesh_end = instance->mesh_start_index + instance->mesh_count;
+            for (size_t m = instance->mesh_start_index; m < mesh_end; m++) {
+                Mesh* mesh = &scene->meshes.items[m];
+                if (mesh->node == anim->channels[c].target_node) mesh->animated = true;
+            }
+        }
+    }
+}
+
 bool load_gltf(const char* filepath, Scene* scene) {
     cgltf_options options = {0};
     cgltf_data* data = NULL;
@@ -641,6 +809,7 @@ bool load_gltf(const char* filepath, Scene* scene) {
     instance->mesh_count = scene->meshes.count - instance->mesh_start_index;
     
     load_gltf_animations(data, instance);
+    mark_animated_meshes(scene, instance);
     
     scene->gltf_instance_count++;
     
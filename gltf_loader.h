@@ -3,6 +3,10 @@
 #include "renderer.h"
 #include "scene.h"
 
+// Store static (non-morphed, no vertex color) meshes as PackedVertex,
+// read by load_gltf
+extern bool meshQuantization;
+
 void get_directory(const char* filepath, char* dir, size_t dir_size);
 bool load_gltf_textures(cgltf_data* data, const char* base_path);
 bool load_gltf(const char* filepath, Scene* scene);
@@ -31,6 +31,9 @@
 
 #include <time.h>  
 #include "window.h"
+#include "capture.h"
+#include "meshlet.h"
+#include "occlusion.h"
 
 
 
@@ -94,17 +97,11 @@ void key_callback(int key, int action, int mods) {
     altPressed   = mods & GLFW_MOD_ALT;
     
     if (key == GLFW_KEY_TAB && action == GLFW_PRESS) {
-        screenshot(
-                   context.device,
-                   context.physicalDevice,
-                   context.commandPool,
-                   context.graphicsQueue,
-                   context.swapChainImages[0],
-                   VK_FORMAT_B8G8R8A8_SRGB,
-                   context.swapChainExtent.width,
-                   context.swapChainExtent.height,
-                   "screenshot.png"
-                   );
+        if (shiftPressed) {
+            capture_toggle_sequence("capture");
+        } else {
+            capture_screenshot("screenshot.png");
+        }
     }
 
     if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
@@ -130,6 +127,41 @@ void key_callback(int key, int action, int mods) {
         printf("Ambient Occlusion: %s\n", ambientOcclusionEnabled ? "ENABLED" : "DISABLED");
     }
     
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        toggle_depth_prepass();
+        printf("Depth pre-pass: %s\n", depthPrepassEnabled ? "ENABLED" : "DISABLED");
+    }
+    
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        lodEnabled = !lodEnabled;
+        printf("Mesh LODs: %s\n", lodEnabled ? "ENABLED" : "DISABLED");
+    }
+    
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        toggle_meshlet_culling();
+        printf("Meshlet culling: %s\n", meshletCullingEnabled ? "ENABLED" : "DISABLED");
+    }
+    
+    if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        toggle_meshlet_stats();
+        printf("Meshlet stats: %s\n", meshletStatsEnabled ? "ENABLED" : "DISABLED");
+    }
+    
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        toggle_occlusion_culling();
+        printf("Occlusion culling: %s\n", occlusionCullingEnabled ? "ENABLED" : "DISABLED");
+    }
+    
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        toggle_occlusion_stats();
+        printf("Occlusion stats: %s\n", occlusionStatsEnabled ? "ENABLED" : "DISABLED");
+    }
+    
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        toggle_overdraw_stats();
+        printf("Overdraw stats: %s\n", overdrawStatsEnabled ? "ENABLED" : "DISABLED");
+    }
+    
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         camera.active = !camera.active;
         
@@ -468,171 +500,6 @@ void cursor_pos_callback(double xpos, double ypos) {
 /*     vkEndCommandBuffer(cmd); */
 /* } */
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
-
-void screenshot(
-                VkDevice device,
-                VkPhysicalDevice physicalDevice,
-                VkCommandPool commandPool,
-                VkQueue queue,
-                VkImage srcImage,
-                VkFormat imageFormat,
-                uint32_t width,
-                uint32_t height,
-                const char* filename)
-{
-    VkResult err;
-
-    // 1. Create CPU-accessible buffer
-    VkDeviceSize imageSize = width * height * 4;
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    VkBufferCreateInfo bufferInfo = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = imageSize,
-        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-    };
-
-    err = vkCreateBuffer(device, &bufferInfo, NULL, &stagingBuffer);
-    assert(err == VK_SUCCESS);
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memRequirements.size,
-        .memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits,
-                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
-    };
-
-    err = vkAllocateMemory(device, &allocInfo, NULL, &stagingBufferMemory);
-    assert(err == VK_SUCCESS);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
-
-    // 2. Create command buffer for copy
-    VkCommandBufferAllocateInfo cmdBufAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandPool = commandPool,
-        .commandBufferCount = 1,
-    };
-
-    VkCommandBuffer cmdBuf;
-    vkAllocateCommandBuffers(device, &cmdBufAllocInfo, &cmdBuf);
-
-    VkCommandBufferBeginInfo beginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-    };
-    vkBeginCommandBuffer(cmdBuf, &beginInfo);
-
-    // 3. Transition image layout if necessary (skip if already TRANSFER_SRC_OPTIMAL)
-    VkImageMemoryBarrier barrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,  // adjust if different!
-        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = srcImage,
-        .subresourceRange = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-    };
-    vkCmdPipelineBarrier(
-                         cmdBuf,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         0,
-                         0, NULL,
-                         0, NULL,
-                         1, &barrier);
-
-    // 4. Copy image to buffer
-    VkBufferImageCopy region = {
-        .bufferOffset = 0,
-        .bufferRowLength = 0,
-        .bufferImageHeight = 0,
-        .imageSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-        .imageOffset = {0, 0, 0},
-        .imageExtent = {width, height, 1},
-    };
-
-    vkCmdCopyImageToBuffer(cmdBuf, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &region);
-
-    // 5. Barrier to host read
-    VkBufferMemoryBarrier bufBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = stagingBuffer,
-        .offset = 0,
-        .size = imageSize,
-    };
-    vkCmdPipelineBarrier(
-                         cmdBuf,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_HOST_BIT,
-                         0,
-                         0, NULL,
-                         1, &bufBarrier,
-                         0, NULL);
-
-    vkEndCommandBuffer(cmdBuf);
-
-    // 6. Submit and wait
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdBuf,
-    };
-    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(queue);
-
-    // 7. Map buffer and save with stb_image_write
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-
-    // NOTE: Vulkan default is BGRA, convert to RGBA for PNG
-    uint8_t* rgba_pixels = malloc(imageSize);
-    for (uint32_t i = 0; i < width * height; ++i) {
-        uint8_t* src = (uint8_t*)data + i * 4;
-        uint8_t* dst = rgba_pixels + i * 4;
-        dst[0] = src[2]; // R
-        dst[1] = src[1]; // G
-        dst[2] = src[0]; // B
-        dst[3] = src[3]; // A
-    }
-
-    stbi_write_png(filename, width, height, 4, rgba_pixels, width * 4);
-
-    free(rgba_pixels);
-
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    // 8. Cleanup
-    vkFreeCommandBuffers(device, commandPool, 1, &cmdBuf);
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
-    printf("took screenshot");
-}
 
                                
 
@@ -799,6 +666,9 @@ int main() {
     
     keymap_print_bindings(&keymap);
     
+    // Static 2D overlay, built once and redrawn from its own GPU buffer
+    Layer2D overlay;
+    layer2D_init(&overlay);
 
     while (!windowShouldClose()) {
         /* float current_frame = glfwGetTime(); */
@@ -873,23 +743,25 @@ int main() {
         
         
         
-        text(jetbrains, "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~", 150, 50, WHITE);
-        
         // Draw 3D text at world position
         text3D(jetbrains, "Hello 3D!", (vec3){0.0f, 5.0f, 10.0f}, 6, WHITE);
         text3D(jetbrains, "Press SPACE", (vec3){0.0f, 4.5f, 10.0f}, 6, RED);
         
-        // 2D GEOMETRY
-        quad2D((vec2){10, 10}, (vec2){50, 50}, BLUE);
-        quad2D((vec2){70, 10}, (vec2){50, 50}, WHITE);
-        quad2D((vec2){10, 70}, (vec2){50, 50}, RED);
-        quad2D((vec2){70, 70}, (vec2){50, 50}, GREEN);
-        
-        
-        
-        texture2D((vec2){100, 200}, (vec2){200, 200}, texture1, WHITE);
-        texture2D((vec2){500, 200}, (vec2){150, 150}, texture2, WHITE);
-        /* texture2D((vec2){300, 300}, (vec2){600, 600}, texture2, WHITE); */
+        // 2D GEOMETRY, rebuilt only when the overlay is dirty
+        if (layer2D_begin(&overlay)) {
+            text(jetbrains, "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~", 150, 50, WHITE);
+            
+            quad2D((vec2){10, 10}, (vec2){50, 50}, BLUE);
+            quad2D((vec2){70, 10}, (vec2){50, 50}, WHITE);
+            quad2D((vec2){10, 70}, (vec2){50, 50}, RED);
+            quad2D((vec2){70, 70}, (vec2){50, 50}, GREEN);
+            
+            texture2D((vec2){100, 200}, (vec2){200, 200}, texture1, WHITE);
+            texture2D((vec2){500, 200}, (vec2){150, 150}, texture2, WHITE);
+            /* texture2D((vec2){300, 300}, (vec2){600, 600}, texture2, WHITE); */
+            layer2D_end(&overlay);
+        }
+        layer2D_draw(&overlay);
         
         
         // Render axes 
@@ -1027,6 +899,7 @@ int main() {
     
     vkDeviceWaitIdle(context.device);
     
+    layer2D_destroy(&overlay);
     texture_pool_cleanup(&context);
     cleanup(&context);
     
@@ -0,0 +1,430 @@
+#include "mesh_optimize.h"
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline const float* vertex_attribute(const float* attribute, size_t stride, uint32_t v) {
+    return (const float*)((const unsigned char*)attribute + (size_t)v * stride);
+}
+
+static void vec3_cross(const float a[3], const float b[3], float out[3]) {
+    float x = a[1] * b[2] - a[2] * b[1];
+    float y = a[2] * b[0] - a[0] * b[2];
+    float z = a[0] * b[1] - a[1] * b[0];
+    out[0] = x;
+    out[1] = y;
+    out[2] = z;
+}
+
+static float vec3_dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void vec3_scale(float v[3], float s) {
+    for (int k = 0; k < 3; k++) v[k] *= s;
+}
+
+// Zero stays zero
+static void vec3_normalize(float v[3]) {
+    float length = sqrtf(vec3_dot(v, v));
+    if (length < FLT_EPSILON) {
+        v[0] = v[1] = v[2] = 0.0f;
+        return;
+    }
+    vec3_scale(v, 1.0f / length);
+}
+
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, size_t index_count,
+                                      size_t vertex_count, uint32_t cache_size) {
+    VertexCacheStats stats = {0};
+    if (index_count < 3 || vertex_count == 0) return stats;
+
+    // FIFO cache, a vertex is resident while its insertion stamp is recent
+    uint32_t* stamps = calloc(vertex_count, sizeof(uint32_t));
+    bool* referenced = calloc(vertex_count, sizeof(bool));
+    uint32_t time = cache_size + 1;
+    size_t misses = 0;
+    size_t unique = 0;
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (time - stamps[v] > cache_size) {
+            stamps[v] = time++;
+            misses++;
+        }
+        if (!referenced[v]) {
+            referenced[v] = true;
+            unique++;
+        }
+    }
+
+    stats.acmr = (float)misses / (float)(index_count / 3);
+    stats.atvr = unique ? (float)misses / (float)unique : 0.0f;
+
+    free(referenced);
+    free(stamps);
+    return stats;
+}
+
+// Vertex -> triangle lists in CSR form
+static void build_adjacency(uint32_t* offsets, uint32_t* triangles,
+                            const uint32_t* indices, size_t index_count, size_t vertex_count) {
+    memset(offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < index_count; i++) offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+
+    uint32_t* cursor = malloc(vertex_count * sizeof(uint32_t));
+    memcpy(cursor, offsets, vertex_count * sizeof(uint32_t));
+    for (size_t i = 0; i < index_count; i++) {
+        triangles[cursor[indices[i]]++] = (uint32_t)(i / 3);
+    }
+    free(cursor);
+}
+
+// Tipsify. Optionally records the output triangle index at which each hard
+// cluster (a restart after a dead end) begins.
+static void tipsify(uint32_t* dst, const uint32_t* indices, size_t index_count, size_t vertex_count,
+                    uint32_t cache_size, uint32_t* cluster_starts, size_t* cluster_count) {
+    size_t triangle_count = index_count / 3;
+
+    uint32_t* offsets = malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = malloc(index_count * sizeof(uint32_t));
+    build_adjacency(offsets, adjacency, indices, index_count, vertex_count);
+
+    uint32_t* live = malloc(vertex_count * sizeof(uint32_t));
+    for (size_t v = 0; v < vertex_count; v++) live[v] = offsets[v + 1] - offsets[v];
+
+    uint32_t* stamps = calloc(vertex_count, sizeof(uint32_t));
+    bool* emitted = calloc(triangle_count, sizeof(bool));
+    uint32_t* dead_end = malloc(index_count * sizeof(uint32_t));
+    uint32_t* candidates = malloc(index_count * sizeof(uint32_t));
+    size_t dead_end_top = 0;
+
+    uint32_t time = cache_size + 1;
+    size_t input_cursor = 0;
+    size_t written = 0;
+    size_t clusters = 0;
+
+    // First vertex that still has triangles left
+    while (input_cursor < vertex_count && live[input_cursor] == 0) input_cursor++;
+    int64_t fan = input_cursor < vertex_count ? (int64_t)input_cursor : -1;
+    bool restart = true;
+
+    while (fan >= 0) {
+        if (restart && cluster_starts) cluster_starts[clusters] = (uint32_t)(written / 3);
+        if (restart) clusters++;
+        restart = false;
+
+        size_t candidate_count = 0;
+
+        for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++) {
+            uint32_t t = adjacency[k];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = indices[t * 3 + c];
+                dst[written++] = v;
+                dead_end[dead_end_top++] = v;
+                candidates[candidate_count++] = v;
+                live[v]--;
+
+                if (time - stamps[v] > cache_size) stamps[v] = time++;
+            }
+        }
+
+        // Next fanning vertex: the candidate that will still be in the cache
+        // after its remaining triangles are emitted, oldest first
+        int64_t best = -1;
+        int64_t best_priority = -1;
+        for (size_t c = 0; c < candidate_count; c++) {
+            uint32_t v = candidates[c];
+            if (live[v] == 0) continue;
+
+            int64_t priority = 0;
+            if ((int64_t)time - stamps[v] + 2 * (int64_t)live[v] <= (int64_t)cache_size) {
+                priority = (int64_t)time - stamps[v];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        if (best < 0) {
+            // Dead end: recently used vertices first, then scan the input
+            while (dead_end_top > 0) {
+                uint32_t v = dead_end[--dead_end_top];
+                if (live[v] > 0) {
+                    best = v;
+                    break;
+                }
+            }
+            if (best < 0) {
+                while (input_cursor < vertex_count && live[input_cursor] == 0) input_cursor++;
+                if (input_cursor < vertex_count) best = (int64_t)input_cursor;
+                restart = true;
+            }
+        }
+
+        fan = best;
+    }
+
+    if (cluster_count) *cluster_count = clusters;
+
+    free(candidates);
+    free(dead_end);
+    free(emitted);
+    free(stamps);
+    free(live);
+    free(adjacency);
+    free(offsets);
+}
+
+typedef struct {
+    uint32_t start;      // First triangle
+    uint32_t count;      // Triangles in the cluster
+    float sort_key;      // Larger = faces further out
+} OverdrawCluster;
+
+static int compare_clusters(const void* a, const void* b) {
+    float ka = ((const OverdrawCluster*)a)->sort_key;
+    float kb = ((const OverdrawCluster*)b)->sort_key;
+    return (ka < kb) - (ka > kb);
+}
+
+void optimize_overdraw(uint32_t* dst, const uint32_t* indices, size_t index_count,
+                       const float* positions, size_t stride, size_t vertex_count, float threshold) {
+    if (index_count < 3 || index_count % 3 != 0) {
+        memmove(dst, indices, index_count * sizeof(uint32_t));
+        return;
+    }
+
+    size_t triangle_count = index_count / 3;
+    uint32_t* cache_order = calloc(index_count, sizeof(uint32_t));  // Zeroed only for the compiler, tipsify() writes it all
+    uint32_t* cluster_starts = malloc(triangle_count * sizeof(uint32_t));
+    size_t cluster_count = 0;
+    tipsify(cache_order, indices, index_count, vertex_count, VERTEX_CACHE_SIZE,
+            cluster_starts, &cluster_count);
+
+    // Split the hard clusters further wherever the cache state can be thrown
+    // away without hurting ACMR much, more clusters means finer sorting
+    float mesh_acmr = analyze_vertex_cache(cache_order, index_count, vertex_count, VERTEX_CACHE_SIZE).acmr;
+    OverdrawCluster* clusters = malloc(triangle_count * sizeof(OverdrawCluster));
+    uint32_t* stamps = calloc(vertex_count, sizeof(uint32_t));
+    uint32_t time = VERTEX_CACHE_SIZE + 1;
+    size_t soft_count = 0;
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        uint32_t end = c + 1 < cluster_count ? cluster_starts[c + 1] : (uint32_t)triangle_count;
+        uint32_t start = cluster_starts[c];
+        size_t misses = 0;
+
+        time += VERTEX_CACHE_SIZE + 1;  // Cold cache
+        for (uint32_t t = cluster_starts[c]; t < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = cache_order[t * 3 + k];
+                if (time - stamps[v] > VERTEX_CACHE_SIZE) {
+                    stamps[v] = time++;
+                    misses++;
+                }
+            }
+
+            uint32_t triangles = t + 1 - start;
+            if (t + 1 < end && (float)misses / (float)triangles <= mesh_acmr * threshold) {
+                clusters[soft_count++] = (OverdrawCluster){ .start = start, .count = triangles };
+                start = t + 1;
+                misses = 0;
+                time += VERTEX_CACHE_SIZE + 1;
+            }
+        }
+        clusters[soft_count++] = (OverdrawCluster){ .start = start, .count = end - start };
+    }
+    free(stamps);
+    cluster_count = soft_count;
+
+    // Area weighted mesh centroid
+    float mesh_center[3] = {0.0f, 0.0f, 0.0f};
+    float total_area = 0.0f;
+
+    // Cluster centroid and average normal, the key is how far the cluster
+    // sits out along its own normal
+    float (*centers)[3] = malloc(cluster_count * sizeof(*centers));
+    float (*normals)[3] = malloc(cluster_count * sizeof(*normals));
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        float center[3] = {0.0f, 0.0f, 0.0f};
+        float normal[3] = {0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+
+        for (uint32_t t = clusters[c].start; t < clusters[c].start + clusters[c].count; t++) {
+            const float* a = vertex_attribute(positions, stride, cache_order[t * 3 + 0]);
+            const float* b = vertex_attribute(positions, stride, cache_order[t * 3 + 1]);
+            const float* p = vertex_attribute(positions, stride, cache_order[t * 3 + 2]);
+
+            float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e1[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            float n[3];
+            vec3_cross(e0, e1, n);
+            float triangle_area = sqrtf(vec3_dot(n, n)) * 0.5f;
+
+            for (int k = 0; k < 3; k++) {
+                center[k] += (a[k] + b[k] + p[k]) / 3.0f * triangle_area;
+                normal[k] += n[k];
+            }
+            area += triangle_area;
+        }
+
+        for (int k = 0; k < 3; k++) mesh_center[k] += center[k];
+        total_area += area;
+
+        if (area > 0.0f) vec3_scale(center, 1.0f / area);
+        vec3_normalize(normal);
+        memcpy(centers[c], center, sizeof(center));
+        memcpy(normals[c], normal, sizeof(normal));
+    }
+
+    if (total_area > 0.0f) vec3_scale(mesh_center, 1.0f / total_area);
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        float offset[3] = {
+            centers[c][0] - mesh_center[0],
+            centers[c][1] - mesh_center[1],
+            centers[c][2] - mesh_center[2],
+        };
+        clusters[c].sort_key = vec3_dot(offset, normals[c]);
+    }
+
+    qsort(clusters, cluster_count, sizeof(OverdrawCluster), compare_clusters);
+
+    uint32_t* sorted = malloc(index_count * sizeof(uint32_t));
+    size_t written = 0;
+    for (size_t c = 0; c < cluster_count; c++) {
+        memcpy(sorted + written, cache_order + clusters[c].start * 3,
+               clusters[c].count * 3 * sizeof(uint32_t));
+        written += clusters[c].count * 3;
+    }
+
+    // Keep the reordering only if it doesn't undo the cache pass
+    float cache_acmr = analyze_vertex_cache(cache_order, index_count, vertex_count, VERTEX_CACHE_SIZE).acmr;
+    float sorted_acmr = analyze_vertex_cache(sorted, index_count, vertex_count, VERTEX_CACHE_SIZE).acmr;
+    memcpy(dst, sorted_acmr <= cache_acmr * threshold ? sorted : cache_order,
+           index_count * sizeof(uint32_t));
+
+    free(sorted);
+    free(normals);
+    free(centers);
+    free(clusters);
+    free(cluster_starts);
+    free(cache_order);
+}
+
+size_t optimize_vertex_fetch(void* vertices, size_t vertex_size, size_t vertex_count,
+                             uint32_t** index_buffers, const size_t* index_counts,
+                             uint32_t buffer_count) {
+    uint32_t* remap = malloc(vertex_count * sizeof(uint32_t));
+    memset(remap, 0xff, vertex_count * sizeof(uint32_t));
+    uint32_t next = 0;
+
+    for (uint32_t b = 0; b < buffer_count; b++) {
+        for (size_t i = 0; i < index_counts[b]; i++) {
+            uint32_t v = index_buffers[b][i];
+            if (remap[v] == UINT32_MAX) remap[v] = next++;
+            index_buffers[b][i] = remap[v];
+        }
+    }
+
+    unsigned char* bytes = vertices;
+    unsigned char* reordered = malloc((next ? next : 1) * vertex_size);
+    for (size_t v = 0; v < vertex_count; v++) {
+        if (remap[v] != UINT32_MAX) memcpy(reordered + remap[v] * vertex_size, bytes + v * vertex_size, vertex_size);
+    }
+    memcpy(bytes, reordered, next * vertex_size);
+
+    free(reordered);
+    free(remap);
+    return next;
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu) {
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));  // Inf / NaN
+    }
+    if (exponent >= 31) return (uint16_t)(sign | 0x7c00u);             // Overflow
+    if (exponent <= 0) {
+        if (exponent < -10) return (uint16_t)sign;                      // Underflow
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) half++;                     // Round
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) half++;  // Round, a carry correctly bumps the exponent
+    return (uint16_t)half;
+}
+
+uint32_t pack_unorm4x8(const float* value) {
+    uint32_t packed = 0;
+    for (int i = 0; i < 4; i++) {
+        float c = value[i] < 0.0f ? 0.0f : (value[i] > 1.0f ? 1.0f : value[i]);
+        packed |= (uint32_t)lroundf(c * 255.0f) << (i * 8);
+    }
+    return packed;
+}
+
+static uint32_t quantize_unorm(float value, float scale, uint32_t max) {
+    float q = value * scale;
+    if (q <= 0.0f) return 0;
+    if (q >= (float)max) return max;
+    return (uint32_t)lroundf(q);
+}
+
+void quantize_vertices(PackedVertex* dst, const float* positions, const float* normals,
+                       const float* tex_coords, size_t stride, size_t vertex_count,
+                       const float bounds_min[3], const float bounds_max[3], float dequantize[16]) {
+    float min[3], extent[3];
+    for (int k = 0; k < 3; k++) {
+        min[k] = bounds_min[k];
+        extent[k] = bounds_max[k] > bounds_min[k] ? bounds_max[k] - bounds_min[k] : 1.0f;
+    }
+
+    for (size_t v = 0; v < vertex_count; v++) {
+        const float* pos = vertex_attribute(positions, stride, (uint32_t)v);
+        const float* normal = vertex_attribute(normals, stride, (uint32_t)v);
+        const float* tex_coord = vertex_attribute(tex_coords, stride, (uint32_t)v);
+        PackedVertex* out = &dst[v];
+
+        for (int k = 0; k < 3; k++) {
+            out->pos[k] = (uint16_t)quantize_unorm(pos[k] - min[k], 65535.0f / extent[k], 65535);
+        }
+        out->pos[3] = 0;
+
+        float n[3] = { normal[0], normal[1], normal[2] };
+        vec3_normalize(n);
+        out->normal = quantize_unorm(n[0] * 0.5f + 0.5f, 1023.0f, 1023)
+                    | quantize_unorm(n[1] * 0.5f + 0.5f, 1023.0f, 1023) << 10
+                    | quantize_unorm(n[2] * 0.5f + 0.5f, 1023.0f, 1023) << 20;
+
+        out->texCoord[0] = float_to_half(tex_coord[0]);
+        out->texCoord[1] = float_to_half(tex_coord[1]);
+    }
+
+    // local = min + unorm * extent, column-major
+    memset(dequantize, 0, 16 * sizeof(float));
+    dequantize[15] = 1.0f;
+    for (int k = 0; k < 3; k++) {
+        dequantize[k * 4 + k] = extent[k];
+        dequantize[12 + k] = min[k];
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Load time reordering of indexed triangle lists for the GPU:
+//   1. optimize_overdraw       - Tipsify (Sander et al. 2007) triangle order
+//      for post-transform vertex cache hits, then its clusters reordered so
+//      outward facing ones come first, without giving back cache efficiency
+//   2. optimize_vertex_fetch   - renumbers vertices in first-use order so the
+//      vertex fetch walks memory linearly
+//   3. quantize_vertices       - optional compact PackedVertex encoding
+//
+// Vertex attributes are read as floats stride bytes apart, so nothing here
+// depends on the renderer's Vertex layout. Only indexed glTF meshes go
+// through these passes, OBJ meshes are unindexed triangle soups and are
+// uploaded as loaded.
+
+#define VERTEX_CACHE_SIZE         16    // FIFO entries assumed when optimizing/analyzing
+#define OVERDRAW_ACMR_THRESHOLD   1.05f // Cluster reordering may cost this much ACMR
+
+// Compact vertex for static meshes, 16 bytes instead of a full Vertex.
+// Positions are normalized to the bounds of the glTF mesh, shared by all
+// its primitives, and dequantized through the model matrix. The color is
+// constant per mesh (Mesh.base_color).
+typedef struct {
+    uint16_t pos[4];         // R16G16B16A16_UNORM, w unused
+    uint32_t normal;         // A2B10G10R10_UNORM_PACK32, xyz * 0.5 + 0.5
+    uint16_t texCoord[2];    // R16G16_SFLOAT
+} PackedVertex;
+
+typedef struct {
+    float acmr;  // Vertex shader invocations per triangle (0.5 ideal, 3 worst)
+    float atvr;  // Invocations per referenced vertex (1 ideal)
+} VertexCacheStats;
+
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, size_t index_count,
+                                      size_t vertex_count, uint32_t cache_size);
+
+// Runs the vertex cache pass itself, then sorts its clusters. dst may alias
+// indices.
+void optimize_overdraw(uint32_t* dst, const uint32_t* indices, size_t index_count,
+                       const float* positions, size_t stride, size_t vertex_count, float threshold);
+
+// Reorder vertices (vertex_size bytes each) by first use across all index
+// buffers (in order) and rewrite the indices in place. Unreferenced vertices
+// are dropped, returns the new vertex count.
+size_t optimize_vertex_fetch(void* vertices, size_t vertex_size, size_t vertex_count,
+                             uint32_t** index_buffers, const size_t* index_counts,
+                             uint32_t buffer_count);
+
+// Quantize into PackedVertex (colors are dropped, keep them per mesh).
+// positions, normals and tex_coords share stride. Positions are normalized
+// to [bounds_min, bounds_max]; primitives that share edges must pass the
+// same bounds or the edges crack apart. dequantize receives the column-major
+// matrix mapping packed positions back to local space.
+void quantize_vertices(PackedVertex* dst, const float* positions, const float* normals,
+                       const float* tex_coords, size_t stride, size_t vertex_count,
+                       const float bounds_min[3], const float bounds_max[3], float dequantize[16]);
+
+uint16_t float_to_half(float value);
+uint32_t pack_unorm4x8(const float* value);
@@ -0,0 +1,343 @@
+#include "mesh_simplify.h"
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIMPLIFY_MAX_PASSES 64
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+// w accumulates the plane weights so the error can be reported as a mean
+// squared distance in object space units.
+typedef struct {
+    double a2, b2, c2, d2;
+    double ab, ac, ad, bc, bd, cd;
+    double w;
+} Quadric;
+
+typedef struct {
+    uint32_t u;     // Vertex that goes away
+    uint32_t v;     // Vertex it collapses onto
+    float cost;
+} Collapse;
+
+static void quadric_add_plane(Quadric* q, double a, double b, double c, double d, double w) {
+    q->a2 += w * a * a; q->b2 += w * b * b; q->c2 += w * c * c; q->d2 += w * d * d;
+    q->ab += w * a * b; q->ac += w * a * c; q->ad += w * a * d;
+    q->bc += w * b * c; q->bd += w * b * d; q->cd += w * c * d;
+    q->w  += w;
+}
+
+static void quadric_add(Quadric* dst, const Quadric* src) {
+    dst->a2 += src->a2; dst->b2 += src->b2; dst->c2 += src->c2; dst->d2 += src->d2;
+    dst->ab += src->ab; dst->ac += src->ac; dst->ad += src->ad;
+    dst->bc += src->bc; dst->bd += src->bd; dst->cd += src->cd;
+    dst->w  += src->w;
+}
+
+static float quadric_error(const Quadric* q, const float* p) {
+    double x = p[0], y = p[1], z = p[2];
+    double e = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z
+             + 2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z)
+             + 2.0 * (q->ad * x + q->bd * y + q->cd * z)
+             + q->d2;
+
+    if (q->w <= 0.0) return 0.0f;
+    e /= q->w;
+    return e > 0.0 ? (float)e : 0.0f;
+}
+
+static inline uint32_t hash_u32(uint32_t h) {
+    h ^= h >> 16; h *= 0x7feb352du;
+    h ^= h >> 15; h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline const float* vertex_position(const float* positions, size_t stride, uint32_t v) {
+    return (const float*)((const unsigned char*)positions + (size_t)v * stride);
+}
+
+static size_t table_capacity(size_t count) {
+    size_t capacity = 16;
+    while (capacity < count * 2) capacity <<= 1;
+    return capacity;
+}
+
+// Count how many vertices share each exact position. A position used by more
+// than one vertex is a UV/normal/color seam.
+static void find_seams(bool* locked, const float* positions, size_t stride, size_t vertex_count) {
+    size_t capacity = table_capacity(vertex_count);
+    uint32_t* table = malloc(capacity * sizeof(uint32_t));
+    uint32_t* first = malloc(vertex_count * sizeof(uint32_t));
+    memset(table, 0xff, capacity * sizeof(uint32_t));
+
+    for (size_t v = 0; v < vertex_count; v++) {
+        const float* position = vertex_position(positions, stride, (uint32_t)v);
+        uint32_t bits[3];
+        memcpy(bits, position, sizeof(bits));
+        size_t h = hash_u32(bits[0] ^ hash_u32(bits[1] ^ hash_u32(bits[2]))) & (capacity - 1);
+
+        first[v] = (uint32_t)v;
+        while (table[h] != UINT32_MAX) {
+            if (memcmp(vertex_position(positions, stride, table[h]), position, sizeof(bits)) == 0) {
+                first[v] = table[h];
+                break;
+            }
+            h = (h + 1) & (capacity - 1);
+        }
+
+        if (first[v] == v) {
+            table[h] = (uint32_t)v;
+        } else {
+            locked[v] = true;
+            locked[first[v]] = true;
+        }
+    }
+
+    free(first);
+    free(table);
+}
+
+// An edge with no opposite half-edge lies on an open border
+static void find_borders(bool* locked, const uint32_t* indices, size_t index_count) {
+    size_t capacity = table_capacity(index_count);
+    uint64_t* table = malloc(capacity * sizeof(uint64_t));
+    memset(table, 0xff, capacity * sizeof(uint64_t));
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t a = indices[i];
+        uint32_t b = indices[i % 3 == 2 ? i - 2 : i + 1];
+        uint64_t key = ((uint64_t)a << 32) | b;
+
+        size_t h = hash_u32(a ^ hash_u32(b)) & (capacity - 1);
+        while (table[h] != UINT64_MAX && table[h] != key) h = (h + 1) & (capacity - 1);
+        table[h] = key;
+    }
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t a = indices[i];
+        uint32_t b = indices[i % 3 == 2 ? i - 2 : i + 1];
+        uint64_t key = ((uint64_t)b << 32) | a;
+
+        size_t h = hash_u32(b ^ hash_u32(a)) & (capacity - 1);
+        while (table[h] != UINT64_MAX && table[h] != key) h = (h + 1) & (capacity - 1);
+
+        if (table[h] == UINT64_MAX) {
+            locked[a] = true;
+            locked[b] = true;
+        }
+    }
+
+    free(table);
+}
+
+static void triangle_normal(const float* a, const float* b, const float* c, float out[3]) {
+    float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    out[0] = e0[1] * e1[2] - e0[2] * e1[1];
+    out[1] = e0[2] * e1[0] - e0[0] * e1[2];
+    out[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+// Would moving u onto v turn any of u's remaining triangles inside out?
+static bool collapse_flips(uint32_t u, uint32_t v, const uint32_t* indices,
+                           const float* positions, size_t stride,
+                           const uint32_t* adjacency_offsets, const uint32_t* adjacency) {
+    for (uint32_t k = adjacency_offsets[u]; k < adjacency_offsets[u + 1]; k++) {
+        const uint32_t* tri = &indices[adjacency[k] * 3];
+        if (tri[0] == v || tri[1] == v || tri[2] == v) continue;  // Becomes degenerate
+
+        const float* p[3];
+        const float* q[3];
+        for (int c = 0; c < 3; c++) {
+            p[c] = vertex_position(positions, stride, tri[c]);
+            q[c] = tri[c] == u ? vertex_position(positions, stride, v) : p[c];
+        }
+
+        float before[3], after[3];
+        triangle_normal(p[0], p[1], p[2], before);
+        triangle_normal(q[0], q[1], q[2], after);
+
+        if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_collapses(const void* a, const void* b) {
+    float ca = ((const Collapse*)a)->cost;
+    float cb = ((const Collapse*)b)->cost;
+    return (ca > cb) - (ca < cb);
+}
+
+size_t simplify_mesh(uint32_t* dst, const uint32_t* indices, size_t index_count,
+                     const float* positions, size_t stride, size_t vertex_count,
+                     size_t target_index_count, float target_error, float* out_error) {
+    memmove(dst, indices, index_count * sizeof(uint32_t));
+    if (out_error) *out_error = 0.0f;
+    if (index_count <= target_index_count || index_count % 3 != 0 || vertex_count == 0) return index_count;
+
+    bool* locked = calloc(vertex_count, sizeof(bool));
+    find_seams(locked, positions, stride, vertex_count);
+    find_borders(locked, dst, index_count);
+
+    // Area weighted plane quadrics
+    Quadric* quadrics = calloc(vertex_count, sizeof(Quadric));
+    for (size_t i = 0; i < index_count; i += 3) {
+        const float* a = vertex_position(positions, stride, dst[i + 0]);
+        const float* b = vertex_position(positions, stride, dst[i + 1]);
+        const float* c = vertex_position(positions, stride, dst[i + 2]);
+
+        float n[3];
+        triangle_normal(a, b, c, n);
+        double length = sqrt((double)n[0] * n[0] + (double)n[1] * n[1] + (double)n[2] * n[2]);
+        if (length <= 0.0) continue;
+
+        double nx = n[0] / length, ny = n[1] / length, nz = n[2] / length;
+        double d = -(nx * a[0] + ny * a[1] + nz * a[2]);
+        double area = length * 0.5;
+
+        for (int k = 0; k < 3; k++) {
+            quadric_add_plane(&quadrics[dst[i + k]], nx, ny, nz, d, area);
+        }
+    }
+
+    uint32_t* adjacency_offsets = malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = malloc(index_count * sizeof(uint32_t));
+    Collapse* collapses = malloc(index_count * 2 * sizeof(Collapse));
+    uint32_t* collapse_target = malloc(vertex_count * sizeof(uint32_t));
+    bool* touched = malloc(vertex_count * sizeof(bool));
+
+    float max_error_sq = target_error < sqrtf(FLT_MAX) ? target_error * target_error : FLT_MAX;
+    float reached_error_sq = 0.0f;
+
+    for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && index_count > target_index_count; pass++) {
+        size_t triangle_count = index_count / 3;
+
+        // Vertex -> triangle adjacency for the current index buffer
+        memset(adjacency_offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+        for (size_t i = 0; i < index_count; i++) adjacency_offsets[dst[i] + 1]++;
+        for (size_t v = 0; v < vertex_count; v++) adjacency_offsets[v + 1] += adjacency_offsets[v];
+        for (size_t t = 0; t < triangle_count; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[adjacency_offsets[dst[t * 3 + k]]++] = (uint32_t)t;
+            }
+        }
+        for (size_t v = vertex_count; v > 0; v--) adjacency_offsets[v] = adjacency_offsets[v - 1];
+        adjacency_offsets[0] = 0;
+
+        // Both directions of every edge, the cheaper one usually wins
+        size_t collapse_count = 0;
+        for (size_t i = 0; i < index_count; i++) {
+            uint32_t a = dst[i];
+            uint32_t b = dst[i % 3 == 2 ? i - 2 : i + 1];
+
+            for (int dir = 0; dir < 2; dir++) {
+                uint32_t u = dir ? b : a;
+                uint32_t v = dir ? a : b;
+                if (locked[u]) continue;
+
+                Quadric q = quadrics[u];
+                quadric_add(&q, &quadrics[v]);
+                collapses[collapse_count++] = (Collapse){ u, v, quadric_error(&q, vertex_position(positions, stride, v)) };
+            }
+        }
+
+        qsort(collapses, collapse_count, sizeof(Collapse), compare_collapses);
+
+        // Independent collapses only, so the adjacency stays valid for the pass
+        for (size_t v = 0; v < vertex_count; v++) collapse_target[v] = (uint32_t)v;
+        memset(touched, 0, vertex_count * sizeof(bool));
+
+        size_t budget = (triangle_count - target_index_count / 3) / 2 + 1;
+        size_t applied = 0;
+
+        for (size_t c = 0; c < collapse_count && applied < budget; c++) {
+            Collapse* collapse = &collapses[c];
+            if (collapse->cost > max_error_sq) break;
+            if (touched[collapse->u] || touched[collapse->v]) continue;
+            if (collapse_flips(collapse->u, collapse->v, dst, positions, stride,
+                               adjacency_offsets, adjacency)) continue;
+
+            for (uint32_t k = adjacency_offsets[collapse->u]; k < adjacency_offsets[collapse->u + 1]; k++) {
+                const uint32_t* tri = &dst[adjacency[k] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+
+            collapse_target[collapse->u] = collapse->v;
+            quadric_add(&quadrics[collapse->v], &quadrics[collapse->u]);
+            if (collapse->cost > reached_error_sq) reached_error_sq = collapse->cost;
+            applied++;
+        }
+
+        if (applied == 0) break;
+
+        // Remap and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < index_count; i += 3) {
+            uint32_t a = collapse_target[dst[i + 0]];
+            uint32_t b = collapse_target[dst[i + 1]];
+            uint32_t c = collapse_target[dst[i + 2]];
+            if (a == b || b == c || a == c) continue;
+
+            dst[write++] = a;
+            dst[write++] = b;
+            dst[write++] = c;
+        }
+        index_count = write;
+    }
+
+    free(touched);
+    free(collapse_target);
+    free(collapses);
+    free(adjacency);
+    free(adjacency_offsets);
+    free(quadrics);
+    free(locked);
+
+    if (out_error) *out_error = sqrtf(reached_error_sq);
+    return index_count;
+}
+
+uint32_t simplify_build_lod_chain(const uint32_t* indices, size_t index_count,
+                                  const float* positions, size_t stride, size_t vertex_count,
+                                  uint32_t max_lods, uint32_t** lod_indices,
+                                  size_t* lod_index_counts, float* lod_errors) {
+    if (max_lods == 0) return 0;
+
+    lod_indices[0] = malloc(index_count * sizeof(uint32_t));
+    memcpy(lod_indices[0], indices, index_count * sizeof(uint32_t));
+    lod_index_counts[0] = index_count;
+    lod_errors[0] = 0.0f;
+
+    uint32_t lod_count = 1;
+    if (index_count % 3 != 0 || index_count / 3 < LOD_MIN_TRIANGLES) return lod_count;
+
+    while (lod_count < max_lods) {
+        const uint32_t* previous = lod_indices[lod_count - 1];
+        size_t previous_count = lod_index_counts[lod_count - 1];
+        size_t target = (size_t)(previous_count / 3 * LOD_REDUCTION) * 3;
+
+        uint32_t* lod = malloc(previous_count * sizeof(uint32_t));
+        float error = 0.0f;
+        size_t count = simplify_mesh(lod, previous, previous_count, positions, stride, vertex_count,
+                                     target, FLT_MAX, &error);
+
+        // Mostly locked seams/borders left, deeper levels would barely differ
+        if (count == 0 || count > previous_count * 4 / 5) {
+            free(lod);
+            break;
+        }
+
+        // Errors of successive simplifications add up at worst
+        lod_indices[lod_count] = realloc(lod, count * sizeof(uint32_t));
+        lod_index_counts[lod_count] = count;
+        lod_errors[lod_count] = lod_errors[lod_count - 1] + error;
+        lod_count++;
+    }
+
+    return lod_count;
+}
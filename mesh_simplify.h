@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Quadric error metric simplification (Garland & Heckbert) using half-edge
+// collapses, so every surviving vertex keeps its original attributes and the
+// simplified index buffers can share the source vertex array.
+//
+// Open borders and UV/normal seams are locked in place, so LODs never tear
+// apart at material or texture boundaries. Only positions are read: xyz
+// floats stride bytes apart, so any vertex layout can be passed in place.
+
+#define LOD_MIN_TRIANGLES 512   // Smaller meshes are not worth a LOD chain
+#define LOD_REDUCTION     0.5f  // Triangle ratio between consecutive LODs
+
+// Simplify towards target_index_count, never accepting a collapse whose error
+// exceeds target_error (object space distance). dst must hold index_count
+// indices. Returns the new index count, the error reached goes to out_error.
+size_t simplify_mesh(uint32_t* dst, const uint32_t* indices, size_t index_count,
+                     const float* positions, size_t stride, size_t vertex_count,
+                     size_t target_index_count, float target_error, float* out_error);
+
+// Build up to max_lods levels, level 0 being a copy of the input. Each level
+// is a malloc'd index buffer the caller frees. Returns the number of levels.
+uint32_t simplify_build_lod_chain(const uint32_t* indices, size_t index_count,
+                                  const float* positions, size_t stride, size_t vertex_count,
+                                  uint32_t max_lods, uint32_t** lod_indices,
+                                  size_t* lod_index_counts, float* lod_errors);
@@ -0,0 +1,538 @@
+#include "meshlet.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool meshletCullingEnabled = true;
+bool meshletStatsEnabled = false;
+MeshletCullStats meshletStats = {0};
+
+// Local vec3 math, the little the build and the cull need
+
+static inline const float* vertex_position(const float* positions, size_t stride, uint32_t v) {
+    return (const float*)((const unsigned char*)positions + (size_t)v * stride);
+}
+
+static inline float vec3_dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline float vec3_length(const float v[3]) {
+    return sqrtf(vec3_dot(v, v));
+}
+
+static void meshlet_compute_bounds(MeshletSet* set, uint32_t m, const uint32_t* indices,
+                                   const float* positions, size_t stride) {
+    const uint32_t* tri = indices + set->first_index[m];
+    uint32_t count = set->index_count[m];
+
+    float min[3], max[3];
+    memcpy(min, vertex_position(positions, stride, tri[0]), sizeof(min));
+    memcpy(max, min, sizeof(max));
+    for (uint32_t i = 1; i < count; i++) {
+        const float* p = vertex_position(positions, stride, tri[i]);
+        for (int k = 0; k < 3; k++) {
+            min[k] = fminf(min[k], p[k]);
+            max[k] = fmaxf(max[k], p[k]);
+        }
+    }
+
+    float center[3];
+    for (int k = 0; k < 3; k++) center[k] = (min[k] + max[k]) * 0.5f;
+    float radius_sq = 0.0f;
+    for (uint32_t i = 0; i < count; i++) {
+        const float* p = vertex_position(positions, stride, tri[i]);
+        float d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+        radius_sq = fmaxf(radius_sq, vec3_dot(d, d));
+    }
+
+    set->center_x[m] = center[0];
+    set->center_y[m] = center[1];
+    set->center_z[m] = center[2];
+    set->radius[m] = sqrtf(radius_sq);
+
+    // Normal cone from the face normals (counter-clockwise front faces)
+    float normals[MESHLET_MAX_TRIANGLES][3];
+    uint32_t normal_count = 0;
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+
+    for (uint32_t i = 0; i < count; i += 3) {
+        const float* a = vertex_position(positions, stride, tri[i]);
+        const float* b = vertex_position(positions, stride, tri[i + 1]);
+        const float* c = vertex_position(positions, stride, tri[i + 2]);
+        float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                      e1[2] * e2[0] - e1[0] * e2[2],
+                      e1[0] * e2[1] - e1[1] * e2[0]};
+
+        float length = vec3_length(n);
+        if (length <= 1e-12f) continue;  // Degenerate, can't face anywhere
+
+        float inv_length = 1.0f / length;
+        for (int k = 0; k < 3; k++) {
+            normals[normal_count][k] = n[k] * inv_length;
+            axis[k] += normals[normal_count][k];
+        }
+        normal_count++;
+    }
+
+    float cutoff = 1.0f;
+    float axis_length = vec3_length(axis);
+
+    if (normal_count > 0 && axis_length > 1e-6f) {
+        for (int k = 0; k < 3; k++) axis[k] *= 1.0f / axis_length;
+
+        float min_dot = 1.0f;
+        for (uint32_t i = 0; i < normal_count; i++) {
+            min_dot = fminf(min_dot, vec3_dot(axis, normals[i]));
+        }
+
+        // Cones wider than ~84 degrees almost never cull, don't bother
+        if (min_dot > 0.1f) cutoff = sqrtf(1.0f - min_dot * min_dot);
+    } else {
+        axis[0] = axis[1] = axis[2] = 0.0f;
+    }
+
+    set->cone_x[m] = axis[0];
+    set->cone_y[m] = axis[1];
+    set->cone_z[m] = axis[2];
+    set->cone_cutoff[m] = cutoff;
+}
+
+MeshletSet* meshlets_build(const uint32_t* indices, size_t index_count,
+                           const float* positions, size_t stride, size_t vertex_count) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count < (size_t)MESHLET_MIN_COUNT * MESHLET_MAX_TRIANGLES / 2) return NULL;
+
+    // Worst case every meshlet is closed by the vertex limit after
+    // MESHLET_MAX_VERTICES / 3 triangles
+    size_t max_meshlets = triangle_count / (MESHLET_MAX_VERTICES / 3) + 1;
+    uint32_t* first = malloc(max_meshlets * sizeof(uint32_t));
+    uint32_t* counts = malloc(max_meshlets * sizeof(uint32_t));
+
+    // Meshlet that last referenced each vertex, to count unique vertices
+    uint32_t* last_meshlet = malloc(vertex_count * sizeof(uint32_t));
+    memset(last_meshlet, 0xff, vertex_count * sizeof(uint32_t));
+
+    uint32_t count = 0;
+    uint32_t meshlet_vertices = 0;
+    uint32_t meshlet_triangles = 0;
+    first[0] = 0;
+
+    for (size_t t = 0; t < triangle_count; t++) {
+        const uint32_t* tri = indices + t * 3;
+
+        uint32_t new_vertices = 0;
+        for (int k = 0; k < 3; k++) {
+            if (last_meshlet[tri[k]] != count &&
+                (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) {
+                new_vertices++;
+            }
+        }
+
+        if (meshlet_triangles == MESHLET_MAX_TRIANGLES ||
+            meshlet_vertices + new_vertices > MESHLET_MAX_VERTICES) {
+            counts[count] = meshlet_triangles * 3;
+            count++;
+            first[count] = (uint32_t)(t * 3);
+            meshlet_vertices = 0;
+            meshlet_triangles = 0;
+            new_vertices = 0;
+            for (int k = 0; k < 3; k++) {
+                if ((k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) new_vertices++;
+            }
+        }
+
+        for (int k = 0; k < 3; k++) last_meshlet[tri[k]] = count;
+        meshlet_vertices += new_vertices;
+        meshlet_triangles++;
+    }
+    counts[count] = meshlet_triangles * 3;
+    count++;
+    free(last_meshlet);
+
+    MeshletSet* set = calloc(1, sizeof(MeshletSet));
+    set->count = count;
+    set->first_index = realloc(first, count * sizeof(uint32_t));
+    set->index_count = realloc(counts, count * sizeof(uint32_t));
+
+    uint32_t padded = (count + 3) & ~3u;
+    float** arrays[] = {
+        &set->center_x, &set->center_y, &set->center_z, &set->radius,
+        &set->cone_x, &set->cone_y, &set->cone_z, &set->cone_cutoff,
+    };
+    float* bounds = aligned_alloc(16, sizeof(arrays) / sizeof(arrays[0]) * padded * sizeof(float));
+    memset(bounds, 0, sizeof(arrays) / sizeof(arrays[0]) * padded * sizeof(float));
+    for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++) {
+        *arrays[a] = bounds + a * padded;
+    }
+
+    for (uint32_t m = 0; m < count; m++) {
+        meshlet_compute_bounds(set, m, indices, positions, stride);
+    }
+
+    set->range_first = malloc(count * sizeof(uint32_t));
+    set->range_count = malloc(count * sizeof(uint32_t));
+
+    return set;
+}
+
+void meshlets_destroy(MeshletSet* set) {
+    if (!set) return;
+    free(set->first_index);
+    free(set->index_count);
+    free(set->center_x);  // Owns all eight bounds arrays
+    free(set->range_first);
+    free(set->range_count);
+    free(set);
+}
+
+// Per frame culling
+
+typedef struct {
+    MeshletCullItem* items;
+    size_t count;
+    float planes[6][4];      // World space, normalized, pointing inwards
+    float camera[3];
+} CullJob;
+
+static CullJob cullJob;
+static atomic_size_t cullNextMesh;
+
+static pthread_t cullWorkers[MESHLET_CULL_WORKERS];
+static pthread_mutex_t cullMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cullStartCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cullDoneCond = PTHREAD_COND_INITIALIZER;
+static uint64_t cullGeneration = 0;
+static uint32_t cullBusyWorkers = 0;
+static bool quitCullWorkers = false;
+static bool cullInitialized = false;
+
+// Bit i set when meshlet base + i survives, tail lanes past count are clear
+static uint32_t meshlet_visibility4(const MeshletSet* set, uint32_t base,
+                                    const float planes[6][4], const float camera[3],
+                                    bool backface, uint32_t* frustum_mask) {
+#if defined(__SSE2__)
+    __m128 cx = _mm_load_ps(set->center_x + base);
+    __m128 cy = _mm_load_ps(set->center_y + base);
+    __m128 cz = _mm_load_ps(set->center_z + base);
+    __m128 r = _mm_load_ps(set->radius + base);
+    __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+
+    __m128 outside = _mm_setzero_ps();
+    for (int p = 0; p < 6; p++) {
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p][0])),
+                                         _mm_mul_ps(cy, _mm_set1_ps(planes[p][1]))),
+                              _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p][2])),
+                                         _mm_set1_ps(planes[p][3])));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(d, neg_r));
+    }
+    *frustum_mask = (uint32_t)_mm_movemask_ps(outside);
+
+    uint32_t backface_mask = 0;
+    if (backface) {
+        // Conservative cone test against the bounding sphere:
+        // dot(c - eye, axis) >= cutoff * |c - eye| + r
+        __m128 vx = _mm_sub_ps(cx, _mm_set1_ps(camera[0]));
+        __m128 vy = _mm_sub_ps(cy, _mm_set1_ps(camera[1]));
+        __m128 vz = _mm_sub_ps(cz, _mm_set1_ps(camera[2]));
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                                               _mm_mul_ps(vz, vz)));
+        __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_load_ps(set->cone_x + base)),
+                                             _mm_mul_ps(vy, _mm_load_ps(set->cone_y + base))),
+                                  _mm_mul_ps(vz, _mm_load_ps(set->cone_z + base)));
+        __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_load_ps(set->cone_cutoff + base), length), r);
+        backface_mask = (uint32_t)_mm_movemask_ps(_mm_cmpge_ps(along, limit));
+    }
+#else
+    *frustum_mask = 0;
+    uint32_t backface_mask = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        uint32_t m = base + i;
+        for (int p = 0; p < 6; p++) {
+            float d = planes[p][0] * set->center_x[m] + planes[p][1] * set->center_y[m]
+                    + planes[p][2] * set->center_z[m] + planes[p][3];
+            if (d < -set->radius[m]) {
+                *frustum_mask |= 1u << i;
+                break;
+            }
+        }
+
+        if (backface) {
+            float v[3] = {set->center_x[m] - camera[0], set->center_y[m] - camera[1],
+                          set->center_z[m] - camera[2]};
+            float along = v[0] * set->cone_x[m] + v[1] * set->cone_y[m] + v[2] * set->cone_z[m];
+            if (along >= set->cone_cutoff[m] * vec3_length(v) + set->radius[m]) {
+                backface_mask |= 1u << i;
+            }
+        }
+    }
+#endif
+
+    uint32_t lanes = set->count - base < 4 ? (1u << (set->count - base)) - 1 : 0xf;
+    *frustum_mask &= lanes;
+    return ~(*frustum_mask | backface_mask) & lanes;
+}
+
+static float det3(const float a[3], const float b[3], const float c[3]) {
+    return a[0] * (b[1] * c[2] - b[2] * c[1]) -
+           a[1] * (b[0] * c[2] - b[2] * c[0]) +
+           a[2] * (b[0] * c[1] - b[1] * c[0]);
+}
+
+// p through the inverse of an affine transform, by Cramer's rule on its
+// linear part
+static void affine_inverse_point(const float m[16], const float p[3], float out[3]) {
+    float d[3] = {p[0] - m[12], p[1] - m[13], p[2] - m[14]};
+    float inv_det = 1.0f / det3(m, m + 4, m + 8);
+    out[0] = det3(d, m + 4, m + 8) * inv_det;
+    out[1] = det3(m, d, m + 8) * inv_det;
+    out[2] = det3(m, m + 4, d) * inv_det;
+}
+
+// Planes of the column-major view_projection, left right bottom top near far
+static void frustum_planes(const float m[16], float planes[6][4]) {
+    for (int i = 0; i < 3; i++) {
+        for (int c = 0; c < 4; c++) {
+            planes[i * 2][c] = m[c * 4 + 3] + m[c * 4 + i];
+            planes[i * 2 + 1][c] = m[c * 4 + 3] - m[c * 4 + i];
+        }
+    }
+    for (int p = 0; p < 6; p++) {
+        float length = vec3_length(planes[p]);
+        if (length > 0.0f) {
+            for (int c = 0; c < 4; c++) planes[p][c] *= 1.0f / length;
+        }
+    }
+}
+
+static void cull_mesh(MeshletCullItem* item, MeshletCullStats* stats) {
+    MeshletSet* set = item->meshlets;
+
+    // Frustum planes into local space: a plane transforms by the transpose
+    // of the model matrix, renormalized so sphere radii stay in local units
+    float planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] = vec3_dot(item->model + c * 4, cullJob.planes[p])
+                         + item->model[c * 4 + 3] * cullJob.planes[p][3];
+        }
+        float length = vec3_length(planes[p]);
+        if (length > 0.0f) {
+            for (int c = 0; c < 4; c++) planes[p][c] *= 1.0f / length;
+        }
+    }
+
+    // Facing is preserved by affine transforms, so the cone test also runs
+    // in local space against the camera moved there
+    float camera[3];
+    affine_inverse_point(item->model, cullJob.camera, camera);
+
+    uint32_t triangles = 0;
+    for (uint32_t m = 0; m < set->count; m++) triangles += set->index_count[m] / 3;
+
+    stats->meshes++;
+    stats->meshlets += set->count;
+    stats->triangles += triangles;
+    set->culled = true;
+    set->range_total = 0;
+    set->visible_count = 0;
+
+    bool outside = false;
+    for (int p = 0; p < 6 && !outside; p++) {
+        outside = vec3_dot(planes[p], item->bounds_center) + planes[p][3] < -item->bounds_radius;
+    }
+    if (outside) {
+        stats->meshes_culled++;
+        stats->meshlets_frustum += set->count;
+        return;
+    }
+    stats->triangles_mesh += triangles;
+
+    bool backface = item->cull_back_faces;
+    uint32_t range_end = UINT32_MAX;
+
+    for (uint32_t base = 0; base < set->count; base += 4) {
+        uint32_t lanes = set->count - base < 4 ? (1u << (set->count - base)) - 1 : 0xf;
+        uint32_t frustum_mask;
+        uint32_t visible = meshlet_visibility4(set, base, planes, camera, backface, &frustum_mask);
+
+        stats->meshlets_frustum += (uint32_t)__builtin_popcount(frustum_mask);
+        stats->meshlets_backface += (uint32_t)__builtin_popcount(lanes & ~(visible | frustum_mask));
+
+        while (visible) {
+            uint32_t m = base + (uint32_t)__builtin_ctz(visible);
+            visible &= visible - 1;
+
+            set->visible_count++;
+            stats->triangles_meshlet += set->index_count[m] / 3;
+
+            // Meshlets are consecutive in the index buffer, neighbours merge
+            if (set->first_index[m] == range_end) {
+                set->range_count[set->range_total - 1] += set->index_count[m];
+            } else {
+                set->range_first[set->range_total] = set->first_index[m];
+                set->range_count[set->range_total] = set->index_count[m];
+                set->range_total++;
+            }
+            range_end = set->first_index[m] + set->index_count[m];
+        }
+    }
+
+    stats->draws += set->range_total;
+}
+
+static void cull_run(MeshletCullStats* stats) {
+    size_t i;
+    while ((i = atomic_fetch_add(&cullNextMesh, 1)) < cullJob.count) {
+        cull_mesh(&cullJob.items[i], stats);
+    }
+}
+
+static void stats_add(MeshletCullStats* dst, const MeshletCullStats* src) {
+    dst->meshes += src->meshes;
+    dst->meshes_culled += src->meshes_culled;
+    dst->meshlets += src->meshlets;
+    dst->meshlets_frustum += src->meshlets_frustum;
+    dst->meshlets_backface += src->meshlets_backface;
+    dst->triangles += src->triangles;
+    dst->triangles_mesh += src->triangles_mesh;
+    dst->triangles_meshlet += src->triangles_meshlet;
+    dst->draws += src->draws;
+}
+
+static MeshletCullStats workerStats[MESHLET_CULL_WORKERS];
+
+static void* cull_worker(void* arg) {
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&cullMutex);
+        while (cullGeneration == seen && !quitCullWorkers) {
+            pthread_cond_wait(&cullStartCond, &cullMutex);
+        }
+        if (quitCullWorkers) {
+            pthread_mutex_unlock(&cullMutex);
+            return NULL;
+        }
+        seen = cullGeneration;
+        pthread_mutex_unlock(&cullMutex);
+
+        workerStats[index] = (MeshletCullStats){0};
+        cull_run(&workerStats[index]);
+
+        pthread_mutex_lock(&cullMutex);
+        if (--cullBusyWorkers == 0) pthread_cond_signal(&cullDoneCond);
+        pthread_mutex_unlock(&cullMutex);
+    }
+}
+
+void meshlets_init() {
+    if (cullInitialized) return;
+
+    quitCullWorkers = false;
+    for (uint32_t i = 0; i < MESHLET_CULL_WORKERS; i++) {
+        if (pthread_create(&cullWorkers[i], NULL, cull_worker, (void*)(uintptr_t)i) != 0) {
+            fprintf(stderr, "Failed to create meshlet cull worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    cullInitialized = true;
+}
+
+void meshlets_shutdown() {
+    if (!cullInitialized) return;
+
+    pthread_mutex_lock(&cullMutex);
+    quitCullWorkers = true;
+    pthread_cond_broadcast(&cullStartCond);
+    pthread_mutex_unlock(&cullMutex);
+
+    for (uint32_t i = 0; i < MESHLET_CULL_WORKERS; i++) {
+        pthread_join(cullWorkers[i], NULL);
+    }
+    cullInitialized = false;
+}
+
+static double now_ms() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void meshlets_cull(MeshletCullItem* items, size_t count, const float view_projection[16],
+                   const float camera_position[3]) {
+    if (!meshletCullingEnabled) {
+        for (size_t i = 0; i < count; i++) items[i].meshlets->culled = false;
+        return;
+    }
+
+    double start = now_ms();
+
+    cullJob.items = items;
+    cullJob.count = count;
+    frustum_planes(view_projection, cullJob.planes);
+    memcpy(cullJob.camera, camera_position, sizeof(cullJob.camera));
+    atomic_store(&cullNextMesh, 0);
+
+    MeshletCullStats stats = {0};
+
+    // Only wake the pool when there's more than one mesh to share
+    bool parallel = cullInitialized && count > 1;
+    if (parallel) {
+        pthread_mutex_lock(&cullMutex);
+        cullBusyWorkers = MESHLET_CULL_WORKERS;
+        cullGeneration++;
+        pthread_cond_broadcast(&cullStartCond);
+        pthread_mutex_unlock(&cullMutex);
+    }
+
+    cull_run(&stats);
+
+    if (parallel) {
+        pthread_mutex_lock(&cullMutex);
+        while (cullBusyWorkers > 0) {
+            pthread_cond_wait(&cullDoneCond, &cullMutex);
+        }
+        pthread_mutex_unlock(&cullMutex);
+
+        for (uint32_t i = 0; i < MESHLET_CULL_WORKERS; i++) {
+            stats_add(&stats, &workerStats[i]);
+        }
+    }
+
+    stats.cull_ms = now_ms() - start;
+    meshletStats = stats;
+
+    if (!meshletStatsEnabled) return;
+
+    static double lastReport = 0.0;
+    if (start - lastReport < 1000.0) return;
+    lastReport = start;
+
+    printf("Meshlets: %u meshes (%u culled), %u meshlets: %u frustum, %u backface culled, %u draws, %.3f ms\n",
+           stats.meshes, stats.meshes_culled, stats.meshlets, stats.meshlets_frustum,
+           stats.meshlets_backface, stats.draws, stats.cull_ms);
+    printf("  Triangles: %llu total, %llu per-mesh culling, %llu meshlet culling (%.1f%%)\n",
+           (unsigned long long)stats.triangles, (unsigned long long)stats.triangles_mesh,
+           (unsigned long long)stats.triangles_meshlet,
+           stats.triangles_mesh ? 100.0 * stats.triangles_meshlet / stats.triangles_mesh : 0.0);
+}
+
+void toggle_meshlet_culling() {
+    meshletCullingEnabled = !meshletCullingEnabled;
+}
+
+void toggle_meshlet_stats() {
+    meshletStatsEnabled = !meshletStatsEnabled;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Cluster culling for large indexed meshes. At load LOD 0 is cut into
+// meshlets: runs of consecutive triangles (the index buffer is already in
+// cache/overdraw order, so runs are spatially coherent) with a bounding
+// sphere and a normal cone. Every frame the CPU tests those against the
+// frustum and the camera position and merges the survivors into compacted
+// index ranges that mesh_draw_geometry() submits instead of the whole LOD.
+//
+// Nothing here touches Vulkan or the renderer, meshes come in as plain
+// MeshletCullItems (see meshes_meshlets_cull()). Matrices are column-major
+// float[16], the layout of a cglm mat4.
+
+#define MESHLET_MAX_VERTICES   64   // Unique vertices per meshlet
+#define MESHLET_MAX_TRIANGLES  124  // Triangles per meshlet
+#define MESHLET_MIN_COUNT      4    // Fewer meshlets than this, cull the mesh whole
+#define MESHLET_CULL_WORKERS   3    // Threads helping the main thread each frame
+
+typedef struct MeshletSet {
+    uint32_t count;
+    uint32_t* first_index;   // Into the mesh index buffer (LOD 0)
+    uint32_t* index_count;
+
+    // Local space bounds as a structure of arrays, padded to a multiple of
+    // 4 so the cull loop can test four meshlets per iteration
+    float* center_x;
+    float* center_y;
+    float* center_z;
+    float* radius;
+    float* cone_x;           // Average face normal
+    float* cone_y;
+    float* cone_z;
+    float* cone_cutoff;      // sin of the cone half angle, 1 = never backfacing
+
+    // Written by meshlets_cull() every frame
+    uint32_t* range_first;   // Visible meshlets merged into contiguous ranges
+    uint32_t* range_count;
+    uint32_t range_total;
+    uint32_t visible_count;
+    bool culled;             // Ranges are valid for this frame
+} MeshletSet;
+
+// What the cull reads of one mesh, filled in before meshlets_cull()
+typedef struct MeshletCullItem {
+    MeshletSet* meshlets;        // Ranges written by the pass
+    float model[16];
+    float bounds_center[3];      // Local space sphere around the whole mesh
+    float bounds_radius;
+    bool cull_back_faces;        // Normal cones are tested too
+} MeshletCullItem;
+
+typedef struct {
+    uint32_t meshes;             // Meshes with meshlets tested this frame
+    uint32_t meshes_culled;      // Rejected whole by their bounding sphere
+    uint32_t meshlets;
+    uint32_t meshlets_frustum;   // Rejected by a frustum plane
+    uint32_t meshlets_backface;  // Rejected by the normal cone
+    uint64_t triangles;          // LOD 0 triangles of every tested mesh
+    uint64_t triangles_mesh;     // Submitted with per-mesh sphere culling only
+    uint64_t triangles_meshlet;  // Submitted with meshlet culling
+    uint32_t draws;              // Index ranges emitted
+    double cull_ms;
+} MeshletCullStats;
+
+extern bool meshletCullingEnabled;
+extern bool meshletStatsEnabled;
+extern MeshletCullStats meshletStats;  // Last frame
+
+// Returns NULL when the mesh is too small to be worth splitting. Positions
+// are xyz floats, stride bytes apart.
+MeshletSet* meshlets_build(const uint32_t* indices, size_t index_count,
+                           const float* positions, size_t stride, size_t vertex_count);
+void meshlets_destroy(MeshletSet* set);
+
+void meshlets_init();
+void meshlets_shutdown();
+
+// Cull every item against the view projection and camera position, shared
+// between the calling thread and the worker pool
+void meshlets_cull(MeshletCullItem* items, size_t count, const float view_projection[16],
+                   const float camera_position[3]);
+
+void toggle_meshlet_culling();
+void toggle_meshlet_stats();
@@ -29,6 +29,7 @@ static void file_reader(void* ctx, const char* filename, int is_mtl, const char*
 Mesh load_obj(const char* path, char* name, vec4 color){
     Mesh mesh = {0};
     mesh.name = name;
+    mesh.double_sided = true; // OBJ has no winding guarantee
     glm_mat4_identity(mesh.model);
     tinyobj_attrib_t attrib;
     tinyobj_shape_t* shapes = NULL;
@@ -150,6 +151,7 @@ Mesh load_obj(const char* path, char* name, vec4 color){
     vkUnmapMemory(context.device, mesh.vertexBufferMemory);
 
     mesh.vertexCount = vertexCount;
+    mesh_compute_bounds(&mesh, vertices, vertexCount);
 
     printf("Loaded mesh '%s': %zu vertices, %zu triangles, named: %s\n", path, vertexCount, vertexCount / 3, mesh.name);
 
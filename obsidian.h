@@ -14,3 +14,10 @@
 #include "gltf_loader.h"
 #include "obj.h"
 #include "keychords.h"
+#include "capture.h"
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "skyline.h"
+#include "utf8.h"
@@ -0,0 +1,617 @@
+#include "occlusion.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define BAND_HEIGHT (OCCLUSION_HEIGHT / OCCLUSION_WORKER_COUNT)
+
+static_assert(OCCLUSION_WIDTH % 4 == 0, "rows are rasterized four pixels at a time");
+static_assert(BAND_HEIGHT % (1 << (OCCLUSION_HIZ_LEVELS - 1)) == 0,
+              "every band must reduce to whole rows at the coarsest HiZ level");
+
+bool occlusionCullingEnabled = true;
+bool occlusionStatsEnabled = false;
+OcclusionStats occlusionStats = {0};
+
+Occluder* occluder_build(const uint32_t* indices, size_t index_count,
+                         const float* positions, size_t stride, size_t vertex_count) {
+    if (index_count == 0) return NULL;
+
+    uint32_t* remap = malloc(vertex_count * sizeof(uint32_t));
+    memset(remap, 0xff, vertex_count * sizeof(uint32_t));
+
+    Occluder* occluder = calloc(1, sizeof(Occluder));
+    occluder->indices = malloc(index_count * sizeof(uint32_t));
+    occluder->positions = malloc(index_count * 3 * sizeof(float));  // Upper bound
+    occluder->index_count = (uint32_t)index_count;
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = occluder->vertex_count++;
+            const float* position = (const float*)((const unsigned char*)positions + v * stride);
+            memcpy(occluder->positions + remap[v] * 3, position, 3 * sizeof(float));
+        }
+        occluder->indices[i] = remap[v];
+    }
+    free(remap);
+
+    occluder->positions = realloc(occluder->positions, occluder->vertex_count * 3 * sizeof(float));
+    return occluder;
+}
+
+void occluder_destroy(Occluder* occluder) {
+    if (!occluder) return;
+    free(occluder->positions);
+    free(occluder->indices);
+    free(occluder);
+}
+
+// Column-major 4x4 math, the little the pass needs
+
+static void mat4_mul(const float a[16], const float b[16], float out[16]) {
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] +
+                             a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+        }
+    }
+}
+
+static void mat4_transform(const float m[16], float x, float y, float z, float out[4]) {
+    for (int r = 0; r < 4; r++) {
+        out[r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r];
+    }
+}
+
+static float det3(const float a[3], const float b[3], const float c[3]) {
+    return a[0] * (b[1] * c[2] - b[2] * c[1]) -
+           a[1] * (b[0] * c[2] - b[2] * c[0]) +
+           a[2] * (b[0] * c[1] - b[1] * c[0]);
+}
+
+// p through the inverse of an affine transform, by Cramer's rule on its
+// linear part
+static void affine_inverse_point(const float m[16], const float p[3], float out[3]) {
+    float d[3] = {p[0] - m[12], p[1] - m[13], p[2] - m[14]};
+    float inv_det = 1.0f / det3(m, m + 4, m + 8);
+    out[0] = det3(d, m + 4, m + 8) * inv_det;
+    out[1] = det3(m, d, m + 8) * inv_det;
+    out[2] = det3(m, m + 4, d) * inv_det;
+}
+
+bool occlusion_culls_back_faces(const float model[16], bool double_sided) {
+    if (double_sided) return false;
+    return det3(model, model + 4, model + 8) > 0.0f;
+}
+
+// Depth buffer and HiZ pyramid: the nearest depth per pixel at level 0,
+// the farthest of each 2x2 block above. Depth is z/w, which grows with
+// distance for both GL and Vulkan style projections.
+
+static float hizStorage[OCCLUSION_WIDTH * OCCLUSION_HEIGHT * 4 / 3 + 16] __attribute__((aligned(16)));
+static float* hizLevels[OCCLUSION_HIZ_LEVELS];
+
+static void hiz_setup() {
+    float* level = hizStorage;
+    for (uint32_t l = 0; l < OCCLUSION_HIZ_LEVELS; l++) {
+        hizLevels[l] = level;
+        level += (OCCLUSION_WIDTH >> l) * (OCCLUSION_HEIGHT >> l);
+    }
+}
+
+const float* occlusion_depth(uint32_t level, uint32_t* width, uint32_t* height) {
+    if (level >= OCCLUSION_HIZ_LEVELS) return NULL;
+    if (!hizLevels[0]) hiz_setup();
+    if (width) *width = OCCLUSION_WIDTH >> level;
+    if (height) *height = OCCLUSION_HEIGHT >> level;
+    return hizLevels[level];
+}
+
+typedef struct {
+    float x[3], y[3], z[3];  // Screen pixels and z/w
+} ScreenTriangle;
+
+typedef struct {
+    ScreenTriangle* triangles;
+    size_t count;
+    size_t capacity;
+    float (*clip)[4];        // Scratch for transformed occluder vertices
+    size_t clip_capacity;
+    OcclusionStats stats;
+} OcclusionWorker;
+
+typedef struct {
+    OcclusionItem* items;
+    size_t count;
+    float view_projection[16];
+    float camera[3];
+} OcclusionJob;
+
+static OcclusionWorker occlusionWorkers[OCCLUSION_WORKER_COUNT];
+static OcclusionJob occlusionJob;
+static atomic_size_t nextOccluder;
+static atomic_size_t nextTest;
+
+static pthread_t workerThreads[OCCLUSION_WORKER_COUNT];
+static pthread_cond_t phaseCond = PTHREAD_COND_INITIALIZER;
+static uint32_t phaseArrived = 0;
+static uint64_t phaseGeneration = 0;
+static pthread_mutex_t occlusionMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+static uint64_t jobGeneration = 0;
+static uint32_t busyWorkers = 0;
+static bool quitWorkers = false;
+static bool occlusionInitialized = false;
+static bool jobActive = false;
+static double jobStart = 0.0;
+static double jobEnd = 0.0;
+
+static double now_ms() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void emit_triangle(OcclusionWorker* worker, const float a[4], const float b[4], const float c[4]) {
+    const float* clip[3] = {a, b, c};
+    ScreenTriangle tri;
+    for (int i = 0; i < 3; i++) {
+        float inv_w = 1.0f / clip[i][3];
+        tri.x[i] = (clip[i][0] * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        tri.y[i] = (clip[i][1] * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        tri.z[i] = clip[i][2] * inv_w;
+    }
+
+    float min_x = fminf(tri.x[0], fminf(tri.x[1], tri.x[2]));
+    float max_x = fmaxf(tri.x[0], fmaxf(tri.x[1], tri.x[2]));
+    float min_y = fminf(tri.y[0], fminf(tri.y[1], tri.y[2]));
+    float max_y = fmaxf(tri.y[0], fmaxf(tri.y[1], tri.y[2]));
+    if (max_x < 0.0f || max_y < 0.0f || min_x > OCCLUSION_WIDTH || min_y > OCCLUSION_HEIGHT) return;
+
+    if (worker->count == worker->capacity) {
+        worker->capacity = worker->capacity ? worker->capacity * 2 : 1024;
+        worker->triangles = realloc(worker->triangles, worker->capacity * sizeof(ScreenTriangle));
+    }
+    worker->triangles[worker->count++] = tri;
+    worker->stats.occluder_triangles++;
+}
+
+// Clip against w = OCCLUSION_NEAR_W, the only plane that matters: everything
+// else is handled by the screen bounds of the rasterizer
+static void clip_triangle(OcclusionWorker* worker, const float a[4], const float b[4], const float c[4]) {
+    const float* in[3] = {a, b, c};
+    bool inside[3];
+    int inside_count = 0;
+    for (int i = 0; i < 3; i++) {
+        inside[i] = in[i][3] >= OCCLUSION_NEAR_W;
+        inside_count += inside[i];
+    }
+
+    if (inside_count == 3) {
+        emit_triangle(worker, a, b, c);
+        return;
+    }
+    if (inside_count == 0) return;
+
+    float out[4][4];
+    int out_count = 0;
+    for (int i = 0; i < 3; i++) {
+        const float* p = in[i];
+        const float* q = in[(i + 1) % 3];
+        if (inside[i]) memcpy(out[out_count++], p, sizeof(out[0]));
+        if (inside[i] != inside[(i + 1) % 3]) {
+            float t = (OCCLUSION_NEAR_W - p[3]) / (q[3] - p[3]);
+            for (int k = 0; k < 4; k++) out[out_count][k] = p[k] + (q[k] - p[k]) * t;
+            out_count++;
+        }
+    }
+
+    emit_triangle(worker, out[0], out[1], out[2]);
+    if (out_count == 4) emit_triangle(worker, out[0], out[2], out[3]);
+}
+
+// Phase 1: clear this worker's band, transform and clip a share of the occluders
+static void phase_transform(uint32_t index) {
+    OcclusionWorker* worker = &occlusionWorkers[index];
+    worker->count = 0;
+
+    float* band = hizLevels[0] + index * BAND_HEIGHT * OCCLUSION_WIDTH;
+    for (uint32_t i = 0; i < BAND_HEIGHT * OCCLUSION_WIDTH; i++) band[i] = FLT_MAX;
+
+    size_t m;
+    while ((m = atomic_fetch_add(&nextOccluder, 1)) < occlusionJob.count) {
+        const OcclusionItem* item = &occlusionJob.items[m];
+        if (!item->occluder || item->dynamic) continue;
+
+        const Occluder* occluder = item->occluder;
+        worker->stats.occluders++;
+
+        if (worker->clip_capacity < occluder->vertex_count) {
+            worker->clip_capacity = occluder->vertex_count;
+            worker->clip = realloc(worker->clip, worker->clip_capacity * sizeof(worker->clip[0]));
+        }
+
+        float mvp[16];
+        mat4_mul(occlusionJob.view_projection, item->model, mvp);
+        for (uint32_t v = 0; v < occluder->vertex_count; v++) {
+            const float* position = occluder->positions + v * 3;
+            mat4_transform(mvp, position[0], position[1], position[2], worker->clip[v]);
+        }
+
+        // Back faces are invisible on the GPU too, they must not occlude.
+        // Facing is decided in local space, independent of the projection.
+        bool cull_back = occlusion_culls_back_faces(item->model, item->double_sided);
+        float camera[3] = {0.0f, 0.0f, 0.0f};
+        if (cull_back) affine_inverse_point(item->model, occlusionJob.camera, camera);
+
+        for (uint32_t i = 0; i + 2 < occluder->index_count; i += 3) {
+            const uint32_t* tri = occluder->indices + i;
+
+            if (cull_back) {
+                const float* p0 = occluder->positions + tri[0] * 3;
+                const float* p1 = occluder->positions + tri[1] * 3;
+                const float* p2 = occluder->positions + tri[2] * 3;
+                float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                float view[3] = {p0[0] - camera[0], p0[1] - camera[1], p0[2] - camera[2]};
+                // (e1 x e2) . view
+                if (det3(view, e1, e2) >= 0.0f) continue;
+            }
+
+            clip_triangle(worker, worker->clip[tri[0]], worker->clip[tri[1]], worker->clip[tri[2]]);
+        }
+    }
+}
+
+static void rasterize_triangle(const ScreenTriangle* tri, uint32_t band_y0, uint32_t band_y1) {
+    float x0 = tri->x[0], y0 = tri->y[0];
+    float x1 = tri->x[1], y1 = tri->y[1];
+    float x2 = tri->x[2], y2 = tri->y[2];
+    float z0 = tri->z[0], z1 = tri->z[1], z2 = tri->z[2];
+
+    float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    if (area == 0.0f) return;
+    if (area < 0.0f) {
+        float t;
+        t = x1; x1 = x2; x2 = t;
+        t = y1; y1 = y2; y2 = t;
+        t = z1; z1 = z2; z2 = t;
+        area = -area;
+    }
+
+    int min_y = (int)fmaxf(floorf(fminf(y0, fminf(y1, y2))), (float)band_y0);
+    int max_y = (int)fminf(ceilf(fmaxf(y0, fmaxf(y1, y2))), (float)band_y1);
+    int min_x = (int)fmaxf(floorf(fminf(x0, fminf(x1, x2))), 0.0f);
+    int max_x = (int)fminf(ceilf(fmaxf(x0, fmaxf(x1, x2))), (float)OCCLUSION_WIDTH);
+    if (min_y >= max_y || min_x >= max_x) return;
+    min_x &= ~3;
+
+    // Edge functions and depth as planes a * x + b * y + c over pixel centers
+    float ea[3] = {y0 - y1, y1 - y2, y2 - y0};
+    float eb[3] = {x1 - x0, x2 - x1, x0 - x2};
+    float ec[3] = {x0 * y1 - y0 * x1, x1 * y2 - y1 * x2, x2 * y0 - y2 * x0};
+
+    float inv_area = 1.0f / area;
+    float dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) * inv_area;
+    float dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) * inv_area;
+    float zc = z0 - dzdx * x0 - dzdy * y0;
+
+    for (int y = min_y; y < max_y; y++) {
+        float py = y + 0.5f;
+        float* row = hizLevels[0] + y * OCCLUSION_WIDTH;
+
+#if defined(__SSE2__)
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)min_x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+        __m128 e[3], step[3];
+        for (int k = 0; k < 3; k++) {
+            e[k] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[k]), px), _mm_set1_ps(eb[k] * py + ec[k]));
+            step[k] = _mm_set1_ps(ea[k] * 4.0f);
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * py + zc));
+        __m128 z_step = _mm_set1_ps(dzdx * 4.0f);
+        __m128 zero = _mm_setzero_ps();
+
+        for (int x = min_x; x < max_x; x += 4) {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)),
+                                       _mm_cmpge_ps(e[2], zero));
+            if (_mm_movemask_ps(inside)) {
+                __m128 depth = _mm_load_ps(row + x);
+                __m128 nearest = _mm_min_ps(depth, z);
+                _mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest),
+                                                _mm_andnot_ps(inside, depth)));
+            }
+            for (int k = 0; k < 3; k++) e[k] = _mm_add_ps(e[k], step[k]);
+            z = _mm_add_ps(z, z_step);
+        }
+#else
+        for (int x = min_x; x < max_x; x++) {
+            float px = x + 0.5f;
+            if (ea[0] * px + eb[0] * py + ec[0] < 0.0f) continue;
+            if (ea[1] * px + eb[1] * py + ec[1] < 0.0f) continue;
+            if (ea[2] * px + eb[2] * py + ec[2] < 0.0f) continue;
+            float z = dzdx * px + dzdy * py + zc;
+            if (z < row[x]) row[x] = z;
+        }
+#endif
+    }
+}
+
+// Phase 2: rasterize every emitted triangle into this worker's band, then
+// reduce the band through the HiZ levels
+static void phase_rasterize(uint32_t index) {
+    uint32_t band_y0 = index * BAND_HEIGHT;
+    uint32_t band_y1 = band_y0 + BAND_HEIGHT;
+
+    for (uint32_t w = 0; w < OCCLUSION_WORKER_COUNT; w++) {
+        const OcclusionWorker* source = &occlusionWorkers[w];
+        for (size_t t = 0; t < source->count; t++) {
+            rasterize_triangle(&source->triangles[t], band_y0, band_y1);
+        }
+    }
+
+    for (uint32_t l = 1; l < OCCLUSION_HIZ_LEVELS; l++) {
+        uint32_t width = OCCLUSION_WIDTH >> l;
+        const float* src = hizLevels[l - 1];
+        float* dst = hizLevels[l];
+
+        for (uint32_t y = band_y0 >> l; y < band_y1 >> l; y++) {
+            const float* row0 = src + (y * 2) * (width * 2);
+            const float* row1 = row0 + width * 2;
+            for (uint32_t x = 0; x < width; x++) {
+                dst[y * width + x] = fmaxf(fmaxf(row0[x * 2], row0[x * 2 + 1]),
+                                           fmaxf(row1[x * 2], row1[x * 2 + 1]));
+            }
+        }
+    }
+}
+
+static bool box_occluded(const OcclusionItem* item) {
+    float mvp[16];
+    mat4_mul(occlusionJob.view_projection, item->model, mvp);
+
+    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+
+    for (int i = 0; i < 8; i++) {
+        float clip[4];
+        mat4_transform(mvp,
+                       (i & 1) ? item->bounds_max[0] : item->bounds_min[0],
+                       (i & 2) ? item->bounds_max[1] : item->bounds_min[1],
+                       (i & 4) ? item->bounds_max[2] : item->bounds_min[2],
+                       clip);
+
+        // Crosses the near plane, the camera may be inside the box
+        if (clip[3] < OCCLUSION_NEAR_W) return false;
+
+        float inv_w = 1.0f / clip[3];
+        float x = (clip[0] * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        float y = (clip[1] * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        min_x = fminf(min_x, x);
+        max_x = fmaxf(max_x, x);
+        min_y = fminf(min_y, y);
+        max_y = fmaxf(max_y, y);
+        min_z = fminf(min_z, clip[2] * inv_w);
+    }
+
+    // Off screen is the frustum's business, not occlusion's
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= OCCLUSION_WIDTH || min_y >= OCCLUSION_HEIGHT) {
+        return false;
+    }
+
+    int x0 = (int)fmaxf(floorf(min_x), 0.0f);
+    int y0 = (int)fmaxf(floorf(min_y), 0.0f);
+    int x1 = (int)fminf(floorf(max_x), OCCLUSION_WIDTH - 1.0f);
+    int y1 = (int)fminf(floorf(max_y), OCCLUSION_HEIGHT - 1.0f);
+
+    // Level where the rectangle covers at most 4x4 texels
+    uint32_t level = 0;
+    while (level + 1 < OCCLUSION_HIZ_LEVELS &&
+           ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3)) {
+        level++;
+    }
+
+    uint32_t width = OCCLUSION_WIDTH >> level;
+    const float* hiz = hizLevels[level];
+    for (int y = y0 >> level; y <= y1 >> level; y++) {
+        for (int x = x0 >> level; x <= x1 >> level; x++) {
+            if (min_z <= hiz[y * width + x] + OCCLUSION_DEPTH_BIAS) return false;
+        }
+    }
+    return true;
+}
+
+// Phase 3: test a share of the items against the finished pyramid
+static void phase_test(uint32_t index) {
+    OcclusionWorker* worker = &occlusionWorkers[index];
+
+    size_t m;
+    while ((m = atomic_fetch_add(&nextTest, 1)) < occlusionJob.count) {
+        const OcclusionItem* item = &occlusionJob.items[m];
+
+        // Animated transforms are being written on the main thread
+        if (item->dynamic) {
+            *item->occluded = false;
+            continue;
+        }
+
+        worker->stats.tested++;
+        bool occluded = box_occluded(item);
+        *item->occluded = occluded;
+        if (occluded) {
+            worker->stats.culled++;
+            worker->stats.culled_triangles += item->triangles;
+        }
+    }
+}
+
+// All workers meet here between phases
+static void phase_barrier() {
+    pthread_mutex_lock(&occlusionMutex);
+    uint64_t generation = phaseGeneration;
+    if (++phaseArrived == OCCLUSION_WORKER_COUNT) {
+        phaseArrived = 0;
+        phaseGeneration++;
+        pthread_cond_broadcast(&phaseCond);
+    } else {
+        while (generation == phaseGeneration) {
+            pthread_cond_wait(&phaseCond, &occlusionMutex);
+        }
+    }
+    pthread_mutex_unlock(&occlusionMutex);
+}
+
+static void* occlusion_worker(void* arg) {
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&occlusionMutex);
+        while (jobGeneration == seen && !quitWorkers) {
+            pthread_cond_wait(&startCond, &occlusionMutex);
+        }
+        if (quitWorkers) {
+            pthread_mutex_unlock(&occlusionMutex);
+            return NULL;
+        }
+        seen = jobGeneration;
+        pthread_mutex_unlock(&occlusionMutex);
+
+        phase_transform(index);
+        phase_barrier();
+        phase_rasterize(index);
+        phase_barrier();
+        phase_test(index);
+
+        pthread_mutex_lock(&occlusionMutex);
+        if (--busyWorkers == 0) {
+            jobEnd = now_ms();
+            pthread_cond_signal(&doneCond);
+        }
+        pthread_mutex_unlock(&occlusionMutex);
+    }
+}
+
+void occlusion_init() {
+    if (occlusionInitialized) return;
+    hiz_setup();
+
+    quitWorkers = false;
+    for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) {
+        if (pthread_create(&workerThreads[i], NULL, occlusion_worker, (void*)(uintptr_t)i) != 0) {
+            fprintf(stderr, "Failed to create occlusion worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    occlusionInitialized = true;
+}
+
+void occlusion_shutdown() {
+    if (!occlusionInitialized) return;
+    occlusion_end();
+
+    pthread_mutex_lock(&occlusionMutex);
+    quitWorkers = true;
+    pthread_cond_broadcast(&startCond);
+    pthread_mutex_unlock(&occlusionMutex);
+
+    for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) {
+        pthread_join(workerThreads[i], NULL);
+        free(occlusionWorkers[i].triangles);
+        free(occlusionWorkers[i].clip);
+        occlusionWorkers[i] = (OcclusionWorker){0};
+    }
+    occlusionInitialized = false;
+}
+
+void occlusion_begin(OcclusionItem* items, size_t count, const float view_projection[16],
+                     const float camera_position[3]) {
+    occlusion_end();
+
+    if (!occlusionCullingEnabled) {
+        for (size_t i = 0; i < count; i++) *items[i].occluded = false;
+        return;
+    }
+
+    if (!hizLevels[0]) hiz_setup();
+
+    occlusionJob.items = items;
+    occlusionJob.count = count;
+    memcpy(occlusionJob.view_projection, view_projection, sizeof(occlusionJob.view_projection));
+    memcpy(occlusionJob.camera, camera_position, sizeof(occlusionJob.camera));
+    atomic_store(&nextOccluder, 0);
+    atomic_store(&nextTest, 0);
+    for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) {
+        occlusionWorkers[i].stats = (OcclusionStats){0};
+    }
+
+    jobStart = now_ms();
+    jobActive = true;
+
+    if (!occlusionInitialized) {
+        // Same phases, one band after the other on the calling thread
+        for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) phase_transform(i);
+        for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) phase_rasterize(i);
+        for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) phase_test(i);
+        jobEnd = now_ms();
+        return;
+    }
+
+    pthread_mutex_lock(&occlusionMutex);
+    busyWorkers = OCCLUSION_WORKER_COUNT;
+    jobGeneration++;
+    pthread_cond_broadcast(&startCond);
+    pthread_mutex_unlock(&occlusionMutex);
+}
+
+void occlusion_end() {
+    if (!jobActive) return;
+    jobActive = false;
+
+    pthread_mutex_lock(&occlusionMutex);
+    while (busyWorkers > 0) {
+        pthread_cond_wait(&doneCond, &occlusionMutex);
+    }
+    pthread_mutex_unlock(&occlusionMutex);
+
+    OcclusionStats stats = {0};
+    for (uint32_t i = 0; i < OCCLUSION_WORKER_COUNT; i++) {
+        const OcclusionStats* s = &occlusionWorkers[i].stats;
+        stats.occluders += s->occluders;
+        stats.occluder_triangles += s->occluder_triangles;
+        stats.tested += s->tested;
+        stats.culled += s->culled;
+        stats.culled_triangles += s->culled_triangles;
+    }
+    stats.cull_ms = jobEnd - jobStart;
+    occlusionStats = stats;
+
+    if (!occlusionStatsEnabled) return;
+
+    static double lastReport = 0.0;
+    if (jobStart - lastReport < 1000.0) return;
+    lastReport = jobStart;
+
+    printf("Occlusion: %u occluders (%u tris), %u/%u meshes culled (%llu tris), %.3f ms\n",
+           stats.occluders, stats.occluder_triangles, stats.culled, stats.tested,
+           (unsigned long long)stats.culled_triangles, stats.cull_ms);
+}
+
+void toggle_occlusion_culling() {
+    occlusionCullingEnabled = !occlusionCullingEnabled;
+}
+
+void toggle_occlusion_stats() {
+    occlusionStatsEnabled = !occlusionStatsEnabled;
+}
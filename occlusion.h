@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// CPU occlusion culling. Large static opaque meshes contribute a simplified
+// occluder (their coarsest accurate LOD) that is rasterized into a small
+// depth buffer, reduced into a hierarchical max-depth pyramid (HiZ) and
+// every other static mesh's bounding box is tested against it. Occluded
+// meshes are skipped by meshes_draw() and the depth pre-pass.
+//
+// The whole pass runs on its own worker threads between occlusion_begin()
+// and occlusion_end(), so it overlaps animate_scene() on the main thread.
+// Nothing here touches Vulkan or the renderer, meshes come in as plain
+// OcclusionItems (see meshes_occlusion_begin()). Matrices are column-major
+// float[16], the layout of a cglm mat4.
+
+#define OCCLUSION_WIDTH          256
+#define OCCLUSION_HEIGHT         128
+#define OCCLUSION_HIZ_LEVELS     6     // 256x128 down to 8x4
+#define OCCLUSION_WORKER_COUNT   4     // Each rasterizes one horizontal band
+#define OCCLUSION_NEAR_W         1e-3f // Clip space w below this is clipped
+#define OCCLUSION_DEPTH_BIAS     1e-6f // z/w slack so meshes never hide behind themselves
+#define OCCLUDER_MAX_TRIANGLES   4096  // Coarser LOD needed to become an occluder
+#define OCCLUDER_MAX_ERROR       0.01f // LOD error tolerated, relative to the bounds radius
+
+typedef struct Occluder {
+    float* positions;        // xyz per vertex, local space
+    uint32_t vertex_count;
+    uint32_t* indices;
+    uint32_t index_count;
+} Occluder;
+
+// What the pass reads of one mesh, filled in before occlusion_begin()
+typedef struct OcclusionItem {
+    const Occluder* occluder;    // Rasterized when set
+    float model[16];
+    float bounds_min[3];         // Local space box tested against the HiZ
+    float bounds_max[3];
+    bool double_sided;           // Back faces occlude too
+    bool dynamic;                // Transform written during the pass, neither occludes nor is culled
+    uint32_t triangles;          // Counted in culled_triangles when hidden
+    bool* occluded;              // Written by the pass
+} OcclusionItem;
+
+typedef struct {
+    uint32_t occluders;          // Occluder meshes rasterized
+    uint32_t occluder_triangles; // Triangles that reached the rasterizer
+    uint32_t tested;             // Meshes tested against the HiZ
+    uint32_t culled;             // Of those, found hidden
+    uint64_t culled_triangles;   // LOD 0 triangles of the hidden meshes
+    double cull_ms;              // Wall time on the workers
+} OcclusionStats;
+
+extern bool occlusionCullingEnabled;
+extern bool occlusionStatsEnabled;
+extern OcclusionStats occlusionStats;  // Last completed pass
+
+// Keeps a compact copy of the triangles in indices. Positions are xyz
+// floats, stride bytes apart.
+Occluder* occluder_build(const uint32_t* indices, size_t index_count,
+                         const float* positions, size_t stride, size_t vertex_count);
+void occluder_destroy(Occluder* occluder);
+
+void occlusion_init();
+void occlusion_shutdown();
+
+// Start culling items against the view, the workers use them until
+// occlusion_end(). Without occlusion_init() the pass runs inline.
+void occlusion_begin(OcclusionItem* items, size_t count, const float view_projection[16],
+                     const float camera_position[3]);
+void occlusion_end();
+
+// Whether back faces are culled under model: not for double sided
+// surfaces, nor for mirroring transforms, which flip the winding
+bool occlusion_culls_back_faces(const float model[16], bool double_sided);
+
+// Depth buffer access for debugging and tests
+const float* occlusion_depth(uint32_t level, uint32_t* width, uint32_t* height);
+
+void toggle_occlusion_culling();
+void toggle_occlusion_stats();
@@ -0,0 +1,43 @@
+#version 450
+// Compact vertex layout for static meshes, see PackedVertex in renderer.h
+layout(location = 0) in vec4 inPosition;   // 16-bit UNORM inside the mesh bounds
+layout(location = 1) in vec4 inNormal;     // 10:10:10:2 UNORM, xyz * 0.5 + 0.5
+layout(location = 2) in vec2 inTexCoord;   // Half floats
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 vp;
+    vec4 cameraPos;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 skyColor;
+    vec4 groundColor;
+    float time;
+    float deltaTime;
+    float fogDensity;
+} ubo;
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;           // Dequantization scale and offset already folded in
+    mat3 normalMatrix;    // Inverse-transpose of the unquantized model
+    float alphaCutoff;
+    uint baseColor;       // RGBA8 material color, replaces the per-vertex color
+} pc;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragWorldPos;
+layout(location = 4) out vec2 fragTexCoord;
+
+// The depth pre-pass and the EQUAL color pass must produce bit-identical depth
+invariant gl_Position;
+
+void main() {
+    vec4 worldPos = pc.model * vec4(inPosition.xyz, 1.0);
+    gl_Position = ubo.vp * worldPos;
+    
+    fragNormal = normalize(pc.normalMatrix * (inNormal.xyz * 2.0 - 1.0));
+    
+    fragWorldPos = worldPos.xyz;
+    fragColor = unpackUnorm4x8(pc.baseColor);
+    fragTexCoord = inTexCoord;
+}
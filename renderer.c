@@ -1,11 +1,17 @@
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include "renderer.h"
 #include "context.h"
 #include "common.h"
 #include "scene.h"
+#include "camera.h"
 
 #include "vulkan_setup.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "skyline.h"
+#include "font.h"
 
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -15,6 +21,15 @@
 static Texture2D texturePool[MAX_TEXTURES];
 static uint32_t textureCount = 0;
 
+// Sprite atlas pages for the small pool images
+typedef struct {
+    Texture2D texture;
+    Skyline skyline;
+} SpriteAtlasPage;
+
+static SpriteAtlasPage spritePages[SPRITE_ATLAS_MAX_PAGES];
+static uint32_t spritePageCount = 0;
+
 void texture_pool_init() {
     textureCount = 0;
     memset(texturePool, 0, sizeof(texturePool));
@@ -25,8 +40,102 @@ void texture_pool_cleanup(VulkanContext* context) {
         if (texturePool[i].loaded) {
             destroy_texture(context, &texturePool[i]);
         }
+        texturePool[i].atlas = NULL;
     }
     textureCount = 0;
+    
+    for (uint32_t i = 0; i < spritePageCount; i++) {
+        destroy_texture(context, &spritePages[i].texture);
+        skyline_destroy(&spritePages[i].skyline);
+    }
+    spritePageCount = 0;
+}
+
+static SpriteAtlasPage* sprite_page_create(VulkanContext* context) {
+    if (spritePageCount == SPRITE_ATLAS_MAX_PAGES) return NULL;
+    
+    SpriteAtlasPage* page = &spritePages[spritePageCount];
+    unsigned char* clear = calloc((size_t)SPRITE_ATLAS_SIZE * SPRITE_ATLAS_SIZE, 4);
+    if (!clear) return NULL;
+    
+    memset(&page->texture, 0, sizeof(page->texture));
+    bool created = load_texture_from_rgba(context, clear, SPRITE_ATLAS_SIZE, SPRITE_ATLAS_SIZE, &page->texture);
+    free(clear);
+    if (!created) return NULL;
+    
+    skyline_init(&page->skyline, SPRITE_ATLAS_SIZE, SPRITE_ATLAS_SIZE);
+    spritePageCount++;
+    return page;
+}
+
+// Copy a small image into a sprite atlas page with its border pixels
+// extruded by SPRITE_PADDING, so linear filtering at the sprite edge never
+// picks up a neighbour. Larger images and a full atlas just keep their own
+// image for 2D too.
+static void sprite_atlas_add(VulkanContext* context, Texture2D* texture,
+                             const unsigned char* pixels, uint32_t width, uint32_t height) {
+    if (width > SPRITE_MAX_SIZE || height > SPRITE_MAX_SIZE) return;
+    
+    uint32_t padded_width = width + 2 * SPRITE_PADDING;
+    uint32_t padded_height = height + 2 * SPRITE_PADDING;
+    
+    SpriteAtlasPage* page = NULL;
+    uint32_t x, y;
+    for (uint32_t i = 0; i < spritePageCount && !page; i++) {
+        if (skyline_pack(&spritePages[i].skyline, padded_width, padded_height, &x, &y)) {
+            page = &spritePages[i];
+        }
+    }
+    if (!page) {
+        page = sprite_page_create(context);
+        if (!page || !skyline_pack(&page->skyline, padded_width, padded_height, &x, &y)) return;
+    }
+    
+    unsigned char* padded = malloc((size_t)padded_width * padded_height * 4);
+    if (!padded) return;
+    
+    for (uint32_t py = 0; py < padded_height; py++) {
+        uint32_t sy = py < SPRITE_PADDING ? 0 : (py - SPRITE_PADDING >= height ? height - 1 : py - SPRITE_PADDING);
+        for (uint32_t px = 0; px < padded_width; px++) {
+            uint32_t sx = px < SPRITE_PADDING ? 0 : (px - SPRITE_PADDING >= width ? width - 1 : px - SPRITE_PADDING);
+            memcpy(&padded[(py * padded_width + px) * 4], &pixels[(sy * width + sx) * 4], 4);
+        }
+    }
+    
+    bool uploaded = update_texture_region(context, &page->texture, padded, x, y, padded_width, padded_height);
+    free(padded);
+    if (!uploaded) return;
+    
+    float scale = 1.0f / SPRITE_ATLAS_SIZE;
+    texture->atlas = &page->texture;
+    texture->atlasRect[0] = (x + SPRITE_PADDING) * scale;
+    texture->atlasRect[1] = (y + SPRITE_PADDING) * scale;
+    texture->atlasRect[2] = (x + SPRITE_PADDING + width) * scale;
+    texture->atlasRect[3] = (y + SPRITE_PADDING + height) * scale;
+    
+    printf("  -> Packed into sprite atlas page %u at (%u, %u)\n",
+           (uint32_t)(page - spritePages), x + SPRITE_PADDING, y + SPRITE_PADDING);
+}
+
+static bool create_texture(VulkanContext* context, const unsigned char* pixels,
+                           uint32_t width, uint32_t height, VkFormat format,
+                           VkComponentMapping components, VkSamplerAddressMode addressMode,
+                           Texture2D* texture);
+
+// The next pool slot from decoded RGBA pixels: its own repeating texture
+// for meshes, and a place in the sprite atlas too when it's small
+static int32_t texture_pool_add_pixels(VulkanContext* context, const stbi_uc* pixels,
+                                       int width, int height) {
+    Texture2D* texture = &texturePool[textureCount];
+    if (!create_texture(context, pixels, width, height, VK_FORMAT_R8G8B8A8_SRGB,
+                        (VkComponentMapping){0}, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture)) {
+        printf("  -> Failed to load\n");
+        return -1;
+    }
+    printf("  -> Successfully loaded as texture #%u\n", textureCount);
+    
+    sprite_atlas_add(context, texture, pixels, width, height);
+    return textureCount++;
 }
 
 int32_t texture_pool_add(VulkanContext* context, const char* filename) {
@@ -37,14 +146,18 @@ int32_t texture_pool_add(VulkanContext* context, const char* filename) {
     
     printf("Loading texture %u: %s\n", textureCount, filename);
     
-    if (load_texture(context, filename, &texturePool[textureCount])) {
-        texturePool[textureCount].loaded = true;
-        printf("  -> Successfully loaded as texture #%u\n", textureCount);
-        return textureCount++;
+    // Decoded once for both the texture and the atlas
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        fprintf(stderr, "Failed to load texture image: %s\n", filename);
+        printf("  -> Failed to load\n");
+        return -1;
     }
     
-    printf("  -> Failed to load\n");
-    return -1;
+    int32_t index = texture_pool_add_pixels(context, pixels, width, height);
+    stbi_image_free(pixels);
+    return index;
 }
 
 Texture2D* texture_pool_get(int32_t index) {
@@ -68,6 +181,34 @@ static VkDeviceMemory vertexBufferMemory;
 
 PushConstants pushConstants;
 
+// Set the model matrix and derive the normal matrix once on the CPU instead
+// of running transpose(inverse(model)) for every vertex in vert.vert
+void push_constants_set_model(mat4 model) {
+    glm_mat4_copy(model, pushConstants.model);
+
+    mat3 normal;
+    glm_mat4_pick3(model, normal);
+
+    // Rotation with uniform scale: mat3(model) already points normals the
+    // right way and the shader renormalizes, skip the inverse
+    float sx = glm_vec3_norm2(normal[0]);
+    float sy = glm_vec3_norm2(normal[1]);
+    float sz = glm_vec3_norm2(normal[2]);
+    bool uniform_scale = fabsf(sx - sy) <= 1e-4f * sx && fabsf(sx - sz) <= 1e-4f * sx &&
+                         fabsf(glm_vec3_dot(normal[0], normal[1])) <= 1e-4f * sx &&
+                         fabsf(glm_vec3_dot(normal[0], normal[2])) <= 1e-4f * sx &&
+                         fabsf(glm_vec3_dot(normal[1], normal[2])) <= 1e-4f * sx;
+
+    if (!uniform_scale && fabsf(glm_mat3_det(normal)) > 1e-12f) {
+        glm_mat3_inv(normal, normal);
+        glm_mat3_transpose(normal);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        glm_vec4(normal[i], 0.0f, pushConstants.normalMatrix[i]);
+    }
+}
+
 Vertex vertices3D_textured[MAX_VERTICES];
 uint32_t vertex_count_3D_textured = 0;
 Texture3DBatch texture3DBatches[MAX_TEXTURES];
@@ -410,7 +551,7 @@ void renderer_upload() {
 }
 
 void renderer_draw(VkCommandBuffer cmd) {
-    glm_mat4_identity(pushConstants.model);
+    push_constants_set_model(GLM_MAT4_IDENTITY);
     
     vkCmdPushConstants(
         cmd,
@@ -430,73 +571,219 @@ void renderer_clear() {
     vertex_count = 0;
 }
 
+struct MeshSortKey {
+    uint32_t index;
+    int alpha_mode;
+    float distance;          // Squared distance from the camera to the bounds center
+};
+typedef struct MeshSortKey MeshSortKey;
+
+// OPAQUE, then MASK, both front-to-back so early-Z rejects hidden fragments,
+// then BLEND back-to-front so transparency composites correctly
+static int compare_mesh_sort_keys(const void* a, const void* b) {
+    const MeshSortKey* ka = a;
+    const MeshSortKey* kb = b;
+    
+    if (ka->alpha_mode != kb->alpha_mode) return ka->alpha_mode - kb->alpha_mode;
+    
+    float da = ka->alpha_mode == 2 ? kb->distance : ka->distance;
+    float db = ka->alpha_mode == 2 ? ka->distance : kb->distance;
+    if (da < db) return -1;
+    if (da > db) return 1;
+    return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+// Builds meshes->draw_order instead of permuting meshes->items, so index
+// ranges into the mesh list (glTF instances) stay valid
 void sort_meshes_by_alpha(Meshes* meshes, vec3 cameraPos) {
-    if (meshes->count <= 1) return;
+    if (meshes->count > meshes->draw_order_capacity) {
+        // Without room the meshes keep drawing in list order
+        meshes->draw_order_count = 0;
+        
+        uint32_t* order = realloc(meshes->draw_order, meshes->count * sizeof(uint32_t));
+        if (!order) {
+            fprintf(stderr, "Failed to allocate mesh draw order\n");
+            return;
+        }
+        meshes->draw_order = order;
+        
+        MeshSortKey* keys = realloc(meshes->draw_keys, meshes->count * sizeof(MeshSortKey));
+        if (!keys) {
+            fprintf(stderr, "Failed to allocate mesh sort keys\n");
+            return;
+        }
+        meshes->draw_keys = keys;
+        meshes->draw_order_capacity = meshes->count;
+    }
+    
+    MeshSortKey* keys = meshes->draw_keys;
+    for (size_t i = 0; i < meshes->count; i++) {
+        Mesh* m = &meshes->items[i];
+        
+        // The origin can sit far from the geometry, the bounds can't
+        vec3 center;
+        glm_mat4_mulv3(m->model, m->bounds_center, 1.0f, center);
+        
+        keys[i] = (MeshSortKey){
+            .index = (uint32_t)i,
+            .alpha_mode = m->alpha_mode,
+            .distance = glm_vec3_distance2(cameraPos, center),
+        };
+    }
+    
+    qsort(keys, meshes->count, sizeof(MeshSortKey), compare_mesh_sort_keys);
     
-    // Simple two-pass approach:
-    // 1. Count how many non-blended meshes we have
-    size_t non_blended_count = 0;
     for (size_t i = 0; i < meshes->count; i++) {
-        if (meshes->items[i].alpha_mode != 2) { // Not BLEND mode
-            non_blended_count++;
+        meshes->draw_order[i] = keys[i].index;
+    }
+    meshes->draw_order_count = meshes->count;
+}
+
+// The occlusion pass only sees plain copies, the workers write nothing but
+// the occluded flags while the main thread animates
+void meshes_occlusion_begin(Meshes* meshes, mat4 view_projection, vec3 camera_position) {
+    if (meshes->count > meshes->occlusion_capacity) {
+        OcclusionItem* items = realloc(meshes->occlusion_items, meshes->count * sizeof(OcclusionItem));
+        if (!items) {
+            fprintf(stderr, "Failed to allocate occlusion items\n");
+            for (size_t i = 0; i < meshes->count; i++) meshes->items[i].occluded = false;
+            return;
         }
+        meshes->occlusion_items = items;
+        meshes->occlusion_capacity = meshes->count;
     }
     
-    // 2. Move all blended meshes to the end of the array
-    size_t write_idx = 0;
     for (size_t i = 0; i < meshes->count; i++) {
-        if (meshes->items[i].alpha_mode != 2) { // Not BLEND - keep at front
-            if (i != write_idx) {
-                // Swap meshes
-                Mesh temp = meshes->items[write_idx];
-                meshes->items[write_idx] = meshes->items[i];
-                meshes->items[i] = temp;
+        Mesh* m = &meshes->items[i];
+        OcclusionItem* item = &meshes->occlusion_items[i];
+        
+        // Only opaque meshes occlude, masked ones have holes
+        item->occluder = m->alpha_mode == 0 ? m->occluder : NULL;
+        memcpy(item->model, m->model, sizeof(item->model));
+        memcpy(item->bounds_min, m->bounds_min, sizeof(item->bounds_min));
+        memcpy(item->bounds_max, m->bounds_max, sizeof(item->bounds_max));
+        item->double_sided = m->double_sided;
+        item->dynamic = m->animated;
+        item->triangles = (m->lod_count ? m->lods[0].indexCount : m->vertexCount) / 3;
+        item->occluded = &m->occluded;
+    }
+    
+    occlusion_begin(meshes->occlusion_items, meshes->count, (const float*)view_projection, camera_position);
+}
+
+void meshes_meshlets_cull(Meshes* meshes, mat4 view_projection, vec3 camera_position) {
+    if (meshes->count > meshes->meshlet_capacity) {
+        MeshletCullItem* items = realloc(meshes->meshlet_items, meshes->count * sizeof(MeshletCullItem));
+        if (!items) {
+            fprintf(stderr, "Failed to allocate meshlet cull items\n");
+            for (size_t i = 0; i < meshes->count; i++) {
+                if (meshes->items[i].meshlets) meshes->items[i].meshlets->culled = false;
             }
-            write_idx++;
+            return;
         }
+        meshes->meshlet_items = items;
+        meshes->meshlet_capacity = meshes->count;
     }
     
-    // 3. Sort blended meshes by distance from camera (back-to-front)
-    for (size_t i = non_blended_count; i < meshes->count - 1; i++) {
-        for (size_t j = i + 1; j < meshes->count; j++) {
-            // Extract position from model matrix
-            vec3 pos_i = {
-                meshes->items[i].model[3][0],
-                meshes->items[i].model[3][1], 
-                meshes->items[i].model[3][2]
-            };
-            vec3 pos_j = {
-                meshes->items[j].model[3][0],
-                meshes->items[j].model[3][1],
-                meshes->items[j].model[3][2]
-            };
-            
-            // Calculate distances from camera
-            float dist_i = glm_vec3_distance(cameraPos, pos_i);
-            float dist_j = glm_vec3_distance(cameraPos, pos_j);
-            
-            // Sort back-to-front (farthest first)
-            if (dist_i < dist_j) {
-                Mesh temp = meshes->items[i];
-                meshes->items[i] = meshes->items[j];
-                meshes->items[j] = temp;
-            }
+    size_t count = 0;
+    for (size_t i = 0; i < meshes->count; i++) {
+        Mesh* m = &meshes->items[i];
+        if (!m->meshlets) continue;
+        m->meshlets->culled = false;
+        
+        // Occlusion culling already hid the whole mesh, and coarser LODs
+        // are drawn whole, there is nothing to gain up close only
+        if (m->occluded || mesh_select_lod(m) != 0) continue;
+        
+        MeshletCullItem* item = &meshes->meshlet_items[count++];
+        item->meshlets = m->meshlets;
+        memcpy(item->model, m->model, sizeof(item->model));
+        memcpy(item->bounds_center, m->bounds_center, sizeof(item->bounds_center));
+        item->bounds_radius = m->bounds_radius;
+        item->cull_back_faces = mesh_culls_back_faces(m);
+    }
+    
+    meshlets_cull(meshes->meshlet_items, count, (const float*)view_projection, camera_position);
+}
+
+
+// Last variant bound by mesh(), lets consecutive meshes with the same
+// material skip the rebind. Reset at the start of every meshes_draw().
+static VkPipeline boundMeshPipeline = VK_NULL_HANDLE;
+
+// Set by meshes_draw_depth_prepass(), the following meshes_draw() shades
+// with depth EQUAL against it and clears it again
+static bool meshesDepthPrepassed = false;
+
+// A mirroring transform flips the winding, draw those unculled
+bool mesh_culls_back_faces(const Mesh* mesh) {
+    return occlusion_culls_back_faces((const float*)mesh->model, mesh->double_sided);
+}
+
+static uint32_t mesh_pipeline_variant(const Mesh* mesh) {
+    uint32_t variant = 0;
+    if (mesh->is_unlit) variant |= PIPELINE_VARIANT_UNLIT;
+    if (mesh->alpha_mode == 1) variant |= PIPELINE_VARIANT_ALPHA_MASK;
+    if (mesh->packed) variant |= PIPELINE_VARIANT_PACKED;
+    if (mesh_culls_back_faces(mesh)) variant |= PIPELINE_VARIANT_CULL_BACK;
+    
+    return variant;
+}
+
+static void mesh_draw_geometry(VkCommandBuffer cmd, const Mesh* mesh) {
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->vertexBuffer, offsets);
+    
+    if (!mesh->indexBuffer) {
+        vkCmdDraw(cmd, mesh->vertexCount, 1, 0, 0);
+        return;
+    }
+    
+    vkCmdBindIndexBuffer(cmd, mesh->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    
+    // meshlets_cull() only fills ranges when LOD 0 is selected this frame
+    const MeshletSet* meshlets = mesh->meshlets;
+    if (meshletCullingEnabled && meshlets && meshlets->culled) {
+        for (uint32_t i = 0; i < meshlets->range_total; i++) {
+            vkCmdDrawIndexed(cmd, meshlets->range_count[i], 1, meshlets->range_first[i], 0, 0);
         }
+        return;
     }
     
-    /* printf("Sorted %zu meshes: %zu opaque/mask, %zu blended\n",  */
-    /*        meshes->count, non_blended_count, meshes->count - non_blended_count); */
+    const MeshLOD* lod = &mesh->lods[mesh_select_lod(mesh)];
+    vkCmdDrawIndexed(cmd, lod->indexCount, 1, lod->firstIndex, 0, 0);
 }
 
+static void mesh_set_push_constants(const Mesh* mesh) {
+    push_constants_set_model((vec4*)mesh->model);
+    pushConstants.alphaCutoff = mesh->alpha_cutoff;
+    
+    // Normals use the real model matrix, positions also need dequantizing
+    if (mesh->packed) {
+        glm_mat4_mul((vec4*)mesh->model, (vec4*)mesh->dequantize, pushConstants.model);
+        pushConstants.baseColor = mesh->base_color;
+    }
+}
 
 // WITH TEXTURES AND UNLIT
 void mesh(VkCommandBuffer cmd, Mesh* mesh) {
-    glm_mat4_copy(mesh->model, pushConstants.model);
-    pushConstants.isUnlit = mesh->is_unlit ? 1 : 0;  // NEW: Set unlit flag
+    mesh_set_push_constants(mesh);
+    
+    uint32_t variant = mesh_pipeline_variant(mesh);
+    if (meshesDepthPrepassed && mesh->alpha_mode != 2) {
+        // The pre-pass already discarded masked texels, EQUAL rejects them here
+        variant &= ~PIPELINE_VARIANT_ALPHA_MASK;
+        variant |= PIPELINE_VARIANT_DEPTH_EQUAL;
+    }
     
-    if (mesh->texture && mesh->texture->loaded) {
-        // Use textured 3D pipeline
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipelineTextured3D);
+    bool textured = mesh->texture && mesh->texture->loaded;
+    VkPipeline pipeline = getPipelineVariant(textured, variant);
+    if (pipeline != boundMeshPipeline) {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        boundMeshPipeline = pipeline;
+    }
+    
+    if (textured) {
         
         // Bind descriptor sets
         VkDescriptorSet descriptorSets[2] = {
@@ -510,7 +797,7 @@ void mesh(VkCommandBuffer cmd, Mesh* mesh) {
             context.pipelineLayoutTextured3D,
             0, 2,
             descriptorSets,
-            0, NULL
+            1, &uniformDynamicOffset
         );
         
         vkCmdPushConstants(
@@ -522,9 +809,6 @@ void mesh(VkCommandBuffer cmd, Mesh* mesh) {
             &pushConstants
         );
     } else {
-        // Use regular colored pipeline
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipeline);
-        
         vkCmdPushConstants(
             cmd,
             context.pipelineLayout,
@@ -535,9 +819,64 @@ void mesh(VkCommandBuffer cmd, Mesh* mesh) {
         );
     }
     
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->vertexBuffer, offsets);
-    vkCmdDraw(cmd, mesh->vertexCount, 1, 0, 0);
+    mesh_draw_geometry(cmd, mesh);
+}
+
+void mesh_compute_bounds(Mesh* mesh, const Vertex* vertices, size_t vertex_count) {
+    if (vertex_count == 0) {
+        glm_vec3_zero(mesh->bounds_center);
+        glm_vec3_zero(mesh->bounds_min);
+        glm_vec3_zero(mesh->bounds_max);
+        mesh->bounds_radius = 0.0f;
+        return;
+    }
+    
+    vec3 min, max;
+    glm_vec3_copy((float*)vertices[0].pos, min);
+    glm_vec3_copy((float*)vertices[0].pos, max);
+    for (size_t i = 1; i < vertex_count; i++) {
+        glm_vec3_minv(min, (float*)vertices[i].pos, min);
+        glm_vec3_maxv(max, (float*)vertices[i].pos, max);
+    }
+    glm_vec3_center(min, max, mesh->bounds_center);
+    glm_vec3_copy(min, mesh->bounds_min);
+    glm_vec3_copy(max, mesh->bounds_max);
+    
+    float radius_sq = 0.0f;
+    for (size_t i = 0; i < vertex_count; i++) {
+        float d = glm_vec3_distance2(mesh->bounds_center, (float*)vertices[i].pos);
+        if (d > radius_sq) radius_sq = d;
+    }
+    mesh->bounds_radius = sqrtf(radius_sq);
+}
+
+bool lodEnabled = true;
+float lodPixelThreshold = 1.0f;
+
+// Coarsest LOD whose error, projected at the nearest point of the bounding
+// sphere, stays under lodPixelThreshold
+uint32_t mesh_select_lod(const Mesh* mesh) {
+    if (!lodEnabled || mesh->lod_count <= 1) return 0;
+    
+    vec3 center;
+    glm_mat4_mulv3((vec4*)mesh->model, (float*)mesh->bounds_center, 1.0f, center);
+    
+    float scale = fmaxf(glm_vec3_norm((float*)mesh->model[0]),
+                        fmaxf(glm_vec3_norm((float*)mesh->model[1]), glm_vec3_norm((float*)mesh->model[2])));
+    
+    float distance = glm_vec3_distance(camera.position, center) - mesh->bounds_radius * scale;
+    if (distance <= camera.near_plane) return 0;
+    
+    // projection[1][1] is cot(fov / 2), negated by the Y flip
+    float pixels_per_unit = fabsf(camera.projection_matrix[1][1]) * 0.5f
+                          * (float)context.swapChainExtent.height / distance;
+    
+    uint32_t lod = 0;
+    for (uint32_t i = 1; i < mesh->lod_count; i++) {
+        if (mesh->lods[i].error * scale * pixels_per_unit > lodPixelThreshold) break;
+        lod = i;
+    }
+    return lod;
 }
 
 void mesh_update_morph(Mesh* mesh) {
@@ -640,6 +979,13 @@ void mesh_update_morph(Mesh* mesh) {
 void mesh_destroy(VkDevice device, Mesh* mesh) {
     if (mesh->vertexBuffer) vkDestroyBuffer(device, mesh->vertexBuffer, NULL);
     if (mesh->vertexBufferMemory) vkFreeMemory(device, mesh->vertexBufferMemory, NULL);
+    if (mesh->indexBuffer) vkDestroyBuffer(device, mesh->indexBuffer, NULL);
+    if (mesh->indexBufferMemory) vkFreeMemory(device, mesh->indexBufferMemory, NULL);
+    
+    meshlets_destroy(mesh->meshlets);
+    mesh->meshlets = NULL;
+    occluder_destroy(mesh->occluder);
+    mesh->occluder = NULL;
     
     if (mesh->morph_data) {
         for (size_t t = 0; t < mesh->morph_data->target_count; t++) {
@@ -661,12 +1007,23 @@ void mesh_destroy(VkDevice device, Mesh* mesh) {
     mesh->vertexBuffer = VK_NULL_HANDLE;
     mesh->vertexBufferMemory = VK_NULL_HANDLE;
     mesh->vertexCount = 0;
+    mesh->indexBuffer = VK_NULL_HANDLE;
+    mesh->indexBufferMemory = VK_NULL_HANDLE;
+    mesh->lod_count = 0;
 }
 
 void meshes_init(Meshes* meshes) {
     meshes->items = NULL;
     meshes->count = 0;
     meshes->capacity = 0;
+    meshes->draw_order = NULL;
+    meshes->draw_keys = NULL;
+    meshes->draw_order_count = 0;
+    meshes->draw_order_capacity = 0;
+    meshes->occlusion_items = NULL;
+    meshes->occlusion_capacity = 0;
+    meshes->meshlet_items = NULL;
+    meshes->meshlet_capacity = 0;
 }
 
 void meshes_add(Meshes* meshes, Mesh mesh) {
@@ -683,12 +1040,62 @@ void meshes_remove(Meshes* meshes, size_t index) {
     for (size_t i = index; i < meshes->count - 1; ++i)
         meshes->items[i] = meshes->items[i + 1];
     meshes->count--;
+    meshes->draw_order_count = 0;  // Stale until the next sort
+}
+
+static inline Mesh* meshes_in_draw_order(Meshes* meshes, size_t i) {
+    if (meshes->draw_order_count == meshes->count) {
+        return &meshes->items[meshes->draw_order[i]];
+    }
+    return &meshes->items[i];
+}
+
+// Depth-only pass over every non-blended mesh. Expects set 0 bound with
+// context.pipelineLayout, leaves an arbitrary depth pipeline bound.
+void meshes_draw_depth_prepass(VkCommandBuffer cmd, Meshes* meshes) {
+    VkPipeline bound = VK_NULL_HANDLE;
+    
+    for (size_t i = 0; i < meshes->count; ++i) {
+        Mesh* m = meshes_in_draw_order(meshes, i);
+        if (m->alpha_mode == 2 || m->occluded) continue;
+        
+        uint32_t variant = mesh_pipeline_variant(m);
+        
+        // Only masked meshes run a fragment shader here and need the texture
+        bool textured = (variant & PIPELINE_VARIANT_ALPHA_MASK) && m->texture && m->texture->loaded;
+        VkPipelineLayout layout = textured ? context.pipelineLayoutTextured3D : context.pipelineLayout;
+        
+        VkPipeline pipeline = getDepthPrepassPipeline(textured, variant);
+        if (pipeline != bound) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            bound = pipeline;
+        }
+        
+        if (textured) {
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                                    1, 1, &m->texture->descriptorSet, 0, NULL);
+        }
+        
+        mesh_set_push_constants(m);
+        vkCmdPushConstants(cmd, layout,
+                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0, sizeof(PushConstants), &pushConstants);
+        
+        // Same LOD as the color pass, the depth EQUAL test depends on it
+        mesh_draw_geometry(cmd, m);
+    }
+    
+    meshesDepthPrepassed = true;
 }
 
 void meshes_draw(VkCommandBuffer cmd, Meshes* meshes) {
+    boundMeshPipeline = VK_NULL_HANDLE;
     for (size_t i = 0; i < meshes->count; ++i) {
-        mesh(cmd, &meshes->items[i]);
+        Mesh* m = meshes_in_draw_order(meshes, i);
+        if (m->occluded) continue;
+        mesh(cmd, m);
     }
+    meshesDepthPrepassed = false;
 }
 
 void meshes_destroy(VkDevice device, Meshes* meshes) {
@@ -696,9 +1103,21 @@ void meshes_destroy(VkDevice device, Meshes* meshes) {
         mesh_destroy(device, &meshes->items[i]);
     }
     free(meshes->items);
+    free(meshes->draw_order);
+    free(meshes->draw_keys);
+    free(meshes->occlusion_items);
+    free(meshes->meshlet_items);
     meshes->items = NULL;
     meshes->count = 0;
     meshes->capacity = 0;
+    meshes->draw_order = NULL;
+    meshes->draw_keys = NULL;
+    meshes->draw_order_count = 0;
+    meshes->draw_order_capacity = 0;
+    meshes->occlusion_items = NULL;
+    meshes->occlusion_capacity = 0;
+    meshes->meshlet_items = NULL;
+    meshes->meshlet_capacity = 0;
 }
 
 Mesh* get_mesh(const char* name) {
@@ -717,27 +1136,50 @@ Mesh* get_mesh(const char* name) {
 
 // Batch structure for textured quads
 
-Vertex2D vertices2D[MAX_VERTICES];
-uint32_t vertexCount2D = 0;
-uint32_t coloredVertexCount = 0;
-TextureBatch textureBatches[MAX_TEXTURES];
-uint32_t textureBatchCount = 0;
+// The size renderer.h quotes, and the stride of the 2D instance attributes
+static_assert(sizeof(Quad2D) == 28, "Quad2D is 28 bytes, see the comment in renderer.h");
 
-static uint32_t texturedStartVertex = 0;
+static Quad2D quads2D[MAX_QUADS_2D];
+static TextureBatch coloredBatches2D[MAX_TEXTURES];
+static TextureBatch textureBatches[MAX_TEXTURES];
 
+// Immediate mode geometry, rebuilt every frame into context.vertexBuffer2D
+static Layer2D immediate2D = {
+    .quads = quads2D,
+    .quadCapacity = MAX_QUADS_2D,
+    .coloredBatches = coloredBatches2D,
+    .coloredBatchCapacity = MAX_TEXTURES,
+    .batches = textureBatches,
+    .batchCapacity = MAX_TEXTURES,
+};
 
-void renderer2D_init() {
+// Where quad2D, texture2D and character() write, a layer while it's rebuilt
+static Layer2D* target2D = &immediate2D;
+
+static Layer2D* queuedLayers2D[MAX_LAYERS_2D];
+static uint32_t queuedLayerCount2D = 0;
+static uint32_t uvGeneration2D = 0;
+
+// Clip rects as x0, y0, x1, y1, already intersected with their parents
+static float clipStack2D[MAX_CLIP_DEPTH_2D][4];
+static uint32_t clipDepth2D = 0;
+
+static uint32_t z2D = 0;
+
+
+void create_host_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                        VkBuffer* buffer, VkDeviceMemory* memory) {
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = sizeof(vertices2D),
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        .size = size,
+        .usage = usage,
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE
     };
 
-    vkCreateBuffer(context.device, &bufferInfo, NULL, &context.vertexBuffer2D);
+    vkCreateBuffer(context.device, &bufferInfo, NULL, buffer);
 
     VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(context.device, context.vertexBuffer2D, &memRequirements);
+    vkGetBufferMemoryRequirements(context.device, *buffer, &memRequirements);
 
     VkMemoryAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
@@ -746,185 +1188,482 @@ void renderer2D_init() {
                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
     };
 
-    vkAllocateMemory(context.device, &allocInfo, NULL, &context.vertexBufferMemory2D);
-    vkBindBufferMemory(context.device, context.vertexBuffer2D, context.vertexBufferMemory2D, 0);
+    vkAllocateMemory(context.device, &allocInfo, NULL, memory);
+    vkBindBufferMemory(context.device, *buffer, *memory, 0);
 }
 
-// Shift textured vertices when colored quads are added after textures
-static void shift_textured_vertices_right(uint32_t shift_amount) {
-    if (textureBatchCount == 0 || shift_amount == 0) return;
-    
-    // Calculate how many textured vertices we have
-    uint32_t textured_vertex_count = vertexCount2D - coloredVertexCount;
-    if (textured_vertex_count == 0) return;
-    
-    // Move textured vertices to the right to make room for new colored vertices
-    // Move from right to left to avoid overwriting
-    for (int i = (int)textured_vertex_count - 1; i >= 0; i--) {
-        vertices2D[coloredVertexCount + shift_amount + i] = vertices2D[coloredVertexCount + i];
+void renderer2D_init() {
+    create_host_buffer(sizeof(quads2D), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                       &context.vertexBuffer2D, &context.vertexBufferMemory2D);
+}
+
+static uint16_t unorm16(float value) {
+    if (value <= 0.0f) return 0;
+    if (value >= 1.0f) return 65535;
+    return (uint16_t)(value * 65535.0f + 0.5f);
+}
+
+void quad2D_set(Quad2D* quad, float x, float y, float w, float h,
+                float u0, float v0, float u1, float v1, Color color) {
+    *quad = (Quad2D){
+        .rect = {x, y, w, h},
+        .uv = {unorm16(u0), unorm16(v0), unorm16(u1), unorm16(v1)},
+        .color = colorToRGBA8(color),
+    };
+}
+
+void renderer2D_push_clip(float x, float y, float width, float height) {
+    if (clipDepth2D == MAX_CLIP_DEPTH_2D) {
+        fprintf(stderr, "2D clip stack overflow!\n");
+        return;
     }
     
-    // Update all batch start vertices
-    for (uint32_t i = 0; i < textureBatchCount; i++) {
-        textureBatches[i].startVertex += shift_amount;
+    float* clip = clipStack2D[clipDepth2D];
+    clip[0] = x;
+    clip[1] = y;
+    clip[2] = x + width;
+    clip[3] = y + height;
+    
+    if (clipDepth2D > 0) {
+        const float* parent = clipStack2D[clipDepth2D - 1];
+        clip[0] = fmaxf(clip[0], parent[0]);
+        clip[1] = fmaxf(clip[1], parent[1]);
+        clip[2] = fminf(clip[2], parent[2]);
+        clip[3] = fminf(clip[3], parent[3]);
     }
+    clipDepth2D++;
 }
 
-void quad2D(vec2 position, vec2 size, Color color) {
-    if (vertexCount2D + 6 > MAX_VERTICES) return;
-
-    float x = position[0], y = position[1];
-    float w = size[0], h = size[1];
+void renderer2D_pop_clip(void) {
+    if (clipDepth2D == 0) {
+        fprintf(stderr, "2D clip stack underflow!\n");
+        return;
+    }
+    clipDepth2D--;
+}
 
-    Vertex2D quad[6] = {
-        {{x, y}, color, {0.0f, 0.0f}, 0},
-        {{x + w, y}, color, {1.0f, 0.0f}, 0},
-        {{x + w, y + h}, color, {1.0f, 1.0f}, 0},
+// Quads are axis aligned and their UVs linear across them, so trimming the
+// rect and interpolating the UVs is exact
+bool renderer2D_clip(float rect[4], float uv[4]) {
+    if (clipDepth2D == 0) return true;
+    const float* clip = clipStack2D[clipDepth2D - 1];
+    
+    for (int axis = 0; axis < 2; axis++) {
+        float start = rect[axis];
+        float size = rect[axis + 2];
+        float uv_start = uv[axis];
+        float uv_end = uv[axis + 2];
         
-        {{x, y}, color, {0.0f, 0.0f}, 0},
-        {{x + w, y + h}, color, {1.0f, 1.0f}, 0},
-        {{x, y + h}, color, {0.0f, 1.0f}, 0}
-    };
-
-    // If we already have textured vertices, we need to shift them right
-    if (textureBatchCount > 0) {
-        shift_textured_vertices_right(6);
+        // Negative sizes mirror, normalize so start is the low edge
+        if (size < 0.0f) {
+            start += size;
+            size = -size;
+            float swap = uv_start;
+            uv_start = uv_end;
+            uv_end = swap;
+        }
+        
+        float end = start + size;
+        float lo = fmaxf(start, clip[axis]);
+        float hi = fminf(end, clip[axis + 2]);
+        if (hi <= lo) return false;
+        
+        if (lo > start || hi < end) {
+            float uv_scale = (uv_end - uv_start) / size;
+            uv_end = uv_start + (hi - start) * uv_scale;
+            uv_start = uv_start + (lo - start) * uv_scale;
+        }
+        
+        rect[axis] = lo;
+        rect[axis + 2] = hi - lo;
+        uv[axis] = uv_start;
+        uv[axis + 2] = uv_end;
     }
+    return true;
+}
 
-    // Insert colored vertices at the end of the colored section
-    memcpy(&vertices2D[coloredVertexCount], quad, sizeof(quad));
-    coloredVertexCount += 6;
-    vertexCount2D += 6;
+uint32_t renderer2D_set_z(uint32_t z) {
+    uint32_t previous = z2D;
+    z2D = z > MAX_Z_2D ? MAX_Z_2D : z;
+    return previous;
 }
 
-void texture2D(vec2 position, vec2 size, Texture2D* texture, Color tint) {
-    if (vertexCount2D + 6 > MAX_VERTICES || !texture || !texture->loaded) {
-        if (!texture) printf("texture2D: NULL texture\n");
-        else if (!texture->loaded) printf("texture2D: texture not loaded\n");
-        return;
+// Make room for count more quads, retained layers grow, immediate doesn't
+static bool reserve2D(Layer2D* layer, uint32_t count) {
+    if (layer->quadCount + count <= layer->quadCapacity) return true;
+    if (layer == &immediate2D) return false;
+
+    uint32_t capacity = layer->quadCapacity ? layer->quadCapacity : 64;
+    while (capacity < layer->quadCount + count) capacity *= 2;
+    layer->quads = realloc(layer->quads, capacity * sizeof(Quad2D));
+    layer->quadCapacity = capacity;
+    return true;
+}
+
+// Room for one more batch, retained layers grow, immediate doesn't
+static bool reserve_batch2D(Layer2D* layer, TextureBatch** batches, uint32_t count, uint32_t* capacity) {
+    if (count < *capacity) return true;
+    if (layer == &immediate2D) {
+        fprintf(stderr, "Too many 2D batches!\n");
+        return false;
     }
+    *capacity = *capacity ? *capacity * 2 : 8;
+    *batches = realloc(*batches, *capacity * sizeof(TextureBatch));
+    return true;
+}
 
-    float x = position[0], y = position[1];
-    float w = size[0], h = size[1];
+Quad2D* renderer2D_reserve_colored(uint32_t count) {
+    Layer2D* layer = target2D;
+    if (!reserve2D(layer, count)) return NULL;
 
-    // Check if the LAST batch is for this texture (batching optimization)
-    int batchIndex = -1;
-    if (textureBatchCount > 0 && textureBatches[textureBatchCount - 1].texture == texture) {
-        // Continue the existing batch
-        batchIndex = textureBatchCount - 1;
-    } else {
-        // Create new batch for this texture
-        if (textureBatchCount >= MAX_TEXTURES) {
-            fprintf(stderr, "Too many texture batches!\n");
-            return;
+    // A new run whenever the z layer changes
+    if (layer->coloredBatchCount == 0 || layer->coloredBatches[layer->coloredBatchCount - 1].z != z2D) {
+        if (!reserve_batch2D(layer, &layer->coloredBatches, layer->coloredBatchCount,
+                             &layer->coloredBatchCapacity)) {
+            return NULL;
         }
-        batchIndex = textureBatchCount++;
-        textureBatches[batchIndex].texture = texture;
-        // Textured vertices always start after colored vertices
-        textureBatches[batchIndex].startVertex = coloredVertexCount + (vertexCount2D - coloredVertexCount);
-        textureBatches[batchIndex].vertexCount = 0;
+        layer->coloredBatches[layer->coloredBatchCount++] = (TextureBatch){
+            .texture = NULL,
+            .z = z2D,
+            .firstQuad = layer->coloredQuadCount,
+            .quadCount = 0,
+        };
     }
 
-    Vertex2D quad[6] = {
-        {{x, y}, tint, {0.0f, 1.0f}, 0},
-        {{x + w, y}, tint, {1.0f, 1.0f}, 0},
-        {{x + w, y + h}, tint, {1.0f, 0.0f}, 0},
+    // Colored quads stay in front of the textured batches, shift those right
+    uint32_t textured_quad_count = layer->quadCount - layer->coloredQuadCount;
+    if (textured_quad_count > 0) {
+        memmove(&layer->quads[layer->coloredQuadCount + count],
+                &layer->quads[layer->coloredQuadCount],
+                textured_quad_count * sizeof(Quad2D));
+        for (uint32_t i = 0; i < layer->batchCount; i++) {
+            layer->batches[i].firstQuad += count;
+        }
+    }
+
+    Quad2D* out = &layer->quads[layer->coloredQuadCount];
+    layer->coloredQuadCount += count;
+    layer->quadCount += count;
+    layer->coloredBatches[layer->coloredBatchCount - 1].quadCount += count;
+    return out;
+}
+
+Quad2D* renderer2D_reserve_textured(Texture2D* texture, uint32_t count) {
+    Layer2D* layer = target2D;
+    if (!reserve2D(layer, count)) return NULL;
+
+    // Check if the LAST batch is for this texture and z layer (batching optimization)
+    const TextureBatch* last = layer->batchCount ? &layer->batches[layer->batchCount - 1] : NULL;
+    if (!last || last->texture != texture || last->z != z2D) {
+        if (!reserve_batch2D(layer, &layer->batches, layer->batchCount, &layer->batchCapacity)) {
+            return NULL;
+        }
         
-        {{x, y}, tint, {0.0f, 1.0f}, 0},
-        {{x + w, y + h}, tint, {1.0f, 0.0f}, 0},
-        {{x, y + h}, tint, {0.0f, 0.0f}, 0}
-    };
+        // Textured quads always start after colored quads
+        layer->batches[layer->batchCount++] = (TextureBatch){
+            .texture = texture,
+            .z = z2D,
+            .firstQuad = layer->quadCount,
+            .quadCount = 0,
+        };
+    }
+
+    Quad2D* out = &layer->quads[layer->quadCount];
+    layer->quadCount += count;
+    layer->batches[layer->batchCount - 1].quadCount += count;
+    return out;
+}
+
+bool renderer2D_emit(Texture2D* texture, float x, float y, float w, float h,
+                     float u0, float v0, float u1, float v1, Color color) {
+    float rect[4] = {x, y, w, h};
+    float uv[4] = {u0, v0, u1, v1};
+    if (!renderer2D_clip(rect, uv)) return true;
+    
+    Quad2D* out = texture ? renderer2D_reserve_textured(texture, 1) : renderer2D_reserve_colored(1);
+    if (!out) return false;
+    
+    quad2D_set(out, rect[0], rect[1], rect[2], rect[3], uv[0], uv[1], uv[2], uv[3], color);
+    return true;
+}
+
+void quad2D(vec2 position, vec2 size, Color color) {
+    renderer2D_emit(NULL, position[0], position[1], size[0], size[1], 0.0f, 0.0f, 1.0f, 1.0f, color);
+}
+
+void texture2D(vec2 position, vec2 size, Texture2D* texture, Color tint) {
+    if (!texture || !texture->loaded) {
+        if (!texture) printf("texture2D: NULL texture\n");
+        else if (!texture->loaded) printf("texture2D: texture not loaded\n");
+        return;
+    }
+
+    // Sprites from the pool batch on their atlas page
+    Texture2D* source = texture->atlas ? texture->atlas : texture;
+    const float* rect = texture->atlas ? texture->atlasRect : (const float[4]){0.0f, 0.0f, 1.0f, 1.0f};
 
-    // Add vertices at the end of the buffer
-    memcpy(&vertices2D[vertexCount2D], quad, sizeof(quad));
-    vertexCount2D += 6;
-    textureBatches[batchIndex].vertexCount += 6;
+    // Flipped vertically, v = 1 at the top edge
+    renderer2D_emit(source, position[0], position[1], size[0], size[1], rect[0], rect[3], rect[2], rect[1], tint);
 }
 
 void renderer2D_upload() {
-    if (vertexCount2D == 0) return;
+    if (immediate2D.quadCount == 0) return;
     
     void* data;
-    vkMapMemory(context.device, context.vertexBufferMemory2D, 0, sizeof(vertices2D), 0, &data);
-    memcpy(data, vertices2D, vertexCount2D * sizeof(Vertex2D));
+    vkMapMemory(context.device, context.vertexBufferMemory2D, 0, sizeof(quads2D), 0, &data);
+    memcpy(data, quads2D, immediate2D.quadCount * sizeof(Quad2D));
     vkUnmapMemory(context.device, context.vertexBufferMemory2D);
 }
 
+// --- Retained 2D layers ---
 
-void renderer2D_draw(VkCommandBuffer cmd) {
-    if (vertexCount2D == 0) return;
+void layer2D_init(Layer2D* layer) {
+    memset(layer, 0, sizeof(*layer));
+    layer->dirty = true;
+}
 
-    mat4 projection;
-    glm_ortho(0.0f, (float)context.swapChainExtent.width,
-              (float)context.swapChainExtent.height, 0.0f,
-              -1.0f, 1.0f, projection);
+bool layer2D_begin(Layer2D* layer) {
+    if (layer->uvGeneration != uvGeneration2D) layer->dirty = true;
+    if (!layer->dirty) return false;
+    
+    if (target2D != &immediate2D) {
+        fprintf(stderr, "layer2D_begin: another layer is still being built\n");
+        return false;
+    }
+    
+    layer->quadCount = 0;
+    layer->coloredQuadCount = 0;
+    layer->coloredBatchCount = 0;
+    layer->batchCount = 0;
+    layer->uvGeneration = uvGeneration2D;  // A repack mid-build rebuilds again
+    target2D = layer;
+    return true;
+}
+
+void layer2D_end(Layer2D* layer) {
+    if (target2D != layer) return;
+    
+    target2D = &immediate2D;
+    layer->generation++;
+    layer->dirty = false;
+}
+
+void layer2D_mark_dirty(Layer2D* layer) {
+    layer->dirty = true;
+}
+
+void layer2D_draw(Layer2D* layer) {
+    if (layer->quadCount == 0) return;
+    if (queuedLayerCount2D == MAX_LAYERS_2D) {
+        fprintf(stderr, "Too many 2D layers queued!\n");
+        return;
+    }
+    queuedLayers2D[queuedLayerCount2D++] = layer;
+    
+    // A clean layer fetched no glyphs this frame, keep its atlas pages
+    for (uint32_t i = 0; i < layer->batchCount; i++) {
+        font_mark_texture_used(layer->batches[i].texture);
+    }
+}
+
+void layer2D_destroy(Layer2D* layer) {
+    // In-flight frames may still read the buffers
+    vkDeviceWaitIdle(context.device);
+    
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (layer->buffers[i]) vkDestroyBuffer(context.device, layer->buffers[i], NULL);
+        if (layer->memories[i]) vkFreeMemory(context.device, layer->memories[i], NULL);
+    }
+    free(layer->quads);
+    free(layer->coloredBatches);
+    free(layer->batches);
+    memset(layer, 0, sizeof(*layer));
+}
+
+void renderer2D_invalidate_layers() {
+    uvGeneration2D++;
+}
+
+// Bring this frame's copy of the layer up to date. Called while recording,
+// after the frame's fence, so the GPU is done with the buffer.
+static VkBuffer layer2D_sync(Layer2D* layer, uint32_t frameIndex) {
+    if (layer->uploadedGeneration[frameIndex] == layer->generation) {
+        return layer->buffers[frameIndex];
+    }
+    
+    VkDeviceSize size = layer->quadCount * sizeof(Quad2D);
+    if (size > layer->bufferSizes[frameIndex]) {
+        if (layer->buffers[frameIndex]) vkDestroyBuffer(context.device, layer->buffers[frameIndex], NULL);
+        if (layer->memories[frameIndex]) vkFreeMemory(context.device, layer->memories[frameIndex], NULL);
+        
+        layer->bufferSizes[frameIndex] = layer->quadCapacity * sizeof(Quad2D);
+        create_host_buffer(layer->bufferSizes[frameIndex], VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                           &layer->buffers[frameIndex], &layer->memories[frameIndex]);
+    }
+    
+    void* data;
+    vkMapMemory(context.device, layer->memories[frameIndex], 0, size, 0, &data);
+    memcpy(data, layer->quads, size);
+    vkUnmapMemory(context.device, layer->memories[frameIndex]);
+    
+    layer->uploadedGeneration[frameIndex] = layer->generation;
+    return layer->buffers[frameIndex];
+}
 
+// Lowest z layer at least from the layer has quads on, UINT32_MAX if none
+static uint32_t layer2D_next_z(const Layer2D* layer, uint32_t from) {
+    uint32_t next = UINT32_MAX;
+    for (uint32_t i = 0; i < layer->coloredBatchCount; i++) {
+        uint32_t z = layer->coloredBatches[i].z;
+        if (z >= from && z < next) next = z;
+    }
+    for (uint32_t i = 0; i < layer->batchCount; i++) {
+        uint32_t z = layer->batches[i].z;
+        if (layer->batches[i].quadCount > 0 && z >= from && z < next) next = z;
+    }
+    return next;
+}
 
+// Every quad is 6 vertices of the unit quad in 2D.vert, one instance each.
+// Only the quads on z layer z are drawn.
+static void draw_layer2D(VkCommandBuffer cmd, const Layer2D* layer, VkBuffer buffer, mat4 projection,
+                         uint32_t z) {
     VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(cmd, 0, 1, &context.vertexBuffer2D, offsets);
+    vkCmdBindVertexBuffers(cmd, 0, 1, &buffer, offsets);
 
     // Draw colored content first (non-textured quads)
-    if (coloredVertexCount > 0) {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipeline2D);
+    bool coloredBound = false;
+    for (uint32_t i = 0; i < layer->coloredBatchCount; i++) {
+        const TextureBatch* run = &layer->coloredBatches[i];
+        if (run->z != z) continue;
         
-        vkCmdPushConstants(
-            cmd,
-            context.pipelineLayout2D,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            0,
-            sizeof(mat4),
-            &projection
-        );
+        if (!coloredBound) {
+            coloredBound = true;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipeline2D);
+            
+            vkCmdPushConstants(
+                cmd,
+                context.pipelineLayout2D,
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0,
+                sizeof(mat4),
+                projection
+            );
+        }
         
-        vkCmdDraw(cmd, coloredVertexCount, 1, 0, 0);
+        vkCmdDraw(cmd, 6, run->quadCount, 0, run->firstQuad);
     }
 
-    // Draw each texture batch (text and textured quads)
-    if (textureBatchCount > 0) {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipelineTextured2D);
+    // Draw each texture batch (text and textured quads), SDF font pages
+    // switch to their own pipeline
+    bool texturedBound = false;
+    bool sdfBound = false;
+    for (uint32_t i = 0; i < layer->batchCount; i++) {
+        const TextureBatch* batch = &layer->batches[i];
         
-        vkCmdPushConstants(
-            cmd,
-            context.pipelineLayoutTextured2D,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            0,
-            sizeof(mat4),
-            &projection
-        );
-
-        for (uint32_t i = 0; i < textureBatchCount; i++) {
-            TextureBatch* batch = &textureBatches[i];
-            
-            if (batch->vertexCount == 0) continue;
+        if (batch->quadCount == 0 || batch->z != z) continue;
+        
+        if (!texturedBound) {
+            texturedBound = true;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipelineTextured2D);
             
-            // Bind this texture's descriptor set
-            vkCmdBindDescriptorSets(
+            vkCmdPushConstants(
                 cmd,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
                 context.pipelineLayoutTextured2D,
-                0, 1,
-                &batch->texture->descriptorSet,
-                0, NULL
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0,
+                sizeof(mat4),
+                projection
             );
-            
-            // Draw this batch
-            vkCmdDraw(cmd, batch->vertexCount, 1, batch->startVertex, 0);
         }
+        
+        if (batch->texture->sdf != sdfBound) {
+            sdfBound = batch->texture->sdf;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              sdfBound ? context.graphicsPipelineTextured2DSDF
+                                       : context.graphicsPipelineTextured2D);
+        }
+        
+        // Bind this texture's descriptor set
+        vkCmdBindDescriptorSets(
+            cmd,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            context.pipelineLayoutTextured2D,
+            0, 1,
+            &batch->texture->descriptorSet,
+            0, NULL
+        );
+        
+        // Draw this batch
+        vkCmdDraw(cmd, 6, batch->quadCount, 0, batch->firstQuad);
+    }
+}
+
+void renderer2D_draw(VkCommandBuffer cmd) {
+    if (immediate2D.quadCount == 0 && queuedLayerCount2D == 0) return;
+
+    mat4 projection;
+    glm_ortho(0.0f, (float)context.swapChainExtent.width,
+              (float)context.swapChainExtent.height, 0.0f,
+              -1.0f, 1.0f, projection);
+
+    // Retained layers in the order they were queued, immediate content on top
+    const Layer2D* layers[MAX_LAYERS_2D + 1];
+    VkBuffer buffers[MAX_LAYERS_2D + 1];
+    uint32_t layerCount = 0;
+    for (uint32_t i = 0; i < queuedLayerCount2D; i++) {
+        layers[layerCount] = queuedLayers2D[i];
+        buffers[layerCount++] = layer2D_sync(queuedLayers2D[i], context.currentFrame);
+    }
+    layers[layerCount] = &immediate2D;
+    buffers[layerCount++] = context.vertexBuffer2D;
+
+    // z layers sort on the CPU, each drawn over everything below it. There
+    // is no depth test, translucent edges blend over lower layers instead
+    // of hiding them.
+    for (uint32_t from = 0; from <= MAX_Z_2D;) {
+        uint32_t z = UINT32_MAX;
+        for (uint32_t i = 0; i < layerCount; i++) {
+            uint32_t next = layer2D_next_z(layers[i], from);
+            if (next < z) z = next;
+        }
+        if (z == UINT32_MAX) break;
+        
+        for (uint32_t i = 0; i < layerCount; i++) {
+            if (layer2D_next_z(layers[i], z) == z) draw_layer2D(cmd, layers[i], buffers[i], projection, z);
+        }
+        from = z + 1;
     }
 }
 
 void renderer2D_clear(void) {
-    vertexCount2D = 0;
-    coloredVertexCount = 0;
-    textureBatchCount = 0;
-    texturedStartVertex = 0;
+    immediate2D.quadCount = 0;
+    immediate2D.coloredQuadCount = 0;
+    immediate2D.coloredBatchCount = 0;
+    immediate2D.batchCount = 0;
+    queuedLayerCount2D = 0;
+    
+    if (clipDepth2D > 0) {
+        fprintf(stderr, "2D clip stack not empty at frame end, %u unpopped\n", clipDepth2D);
+        clipDepth2D = 0;
+    }
+    renderer2D_set_z(0);
 }
 
 // --- Texture Loading ---
 
-bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data, 
-                            uint32_t width, uint32_t height, Texture2D* texture) {
-    VkDeviceSize imageSize = width * height * 4;
+static uint32_t texel_size(VkFormat format) {
+    return format == VK_FORMAT_R8_UNORM ? 1 : 4;
+}
+
+// Image, view, sampler and descriptor set filled from tightly packed pixels.
+// components swizzles the view, e.g. to expand a single channel image,
+// addressMode applies to every axis of the sampler.
+static bool create_texture(VulkanContext* context, const unsigned char* pixels,
+                           uint32_t width, uint32_t height, VkFormat format,
+                           VkComponentMapping components, VkSamplerAddressMode addressMode,
+                           Texture2D* texture) {
+    VkDeviceSize imageSize = (VkDeviceSize)width * height * texel_size(format);
 
     // Create staging buffer
     VkBuffer stagingBuffer;
@@ -960,10 +1699,10 @@ bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data,
 
     vkBindBufferMemory(context->device, stagingBuffer, stagingBufferMemory, 0);
 
-    // Copy RGBA data to staging buffer
+    // Copy pixels to staging buffer
     void* mappedData;
     vkMapMemory(context->device, stagingBufferMemory, 0, imageSize, 0, &mappedData);
-    memcpy(mappedData, rgba_data, imageSize);
+    memcpy(mappedData, pixels, imageSize);
     vkUnmapMemory(context->device, stagingBufferMemory);
 
     // Create image
@@ -975,7 +1714,7 @@ bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data,
         .extent.depth = 1,
         .mipLevels = 1,
         .arrayLayers = 1,
-        .format = VK_FORMAT_R8G8B8A8_SRGB,
+        .format = format,
         .tiling = VK_IMAGE_TILING_OPTIMAL,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
         .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
@@ -1009,12 +1748,12 @@ bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data,
     // Transition and copy
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(context->device, context->commandPool);
     
-    transitionImageLayout(commandBuffer, texture->image, VK_FORMAT_R8G8B8A8_SRGB, 
+    transitionImageLayout(commandBuffer, texture->image, format, 
                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
     
     copyBufferToImage(commandBuffer, stagingBuffer, texture->image, width, height);
     
-    transitionImageLayout(commandBuffer, texture->image, VK_FORMAT_R8G8B8A8_SRGB,
+    transitionImageLayout(commandBuffer, texture->image, format,
                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     
     endSingleTimeCommands(context->device, context->commandPool, context->graphicsQueue, commandBuffer);
@@ -1027,7 +1766,8 @@ bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data,
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = texture->image,
         .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = VK_FORMAT_R8G8B8A8_SRGB,
+        .format = format,
+        .components = components,
         .subresourceRange = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
             .baseMipLevel = 0,
@@ -1049,9 +1789,9 @@ bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data,
         .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = VK_FILTER_LINEAR,
         .minFilter = VK_FILTER_LINEAR,
-        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeU = addressMode,
+        .addressModeV = addressMode,
+        .addressModeW = addressMode,
         .anisotropyEnable = VK_FALSE,
         .maxAnisotropy = 1.0f,
         .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
@@ -1109,11 +1849,32 @@ bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data,
 
     texture->width = width;
     texture->height = height;
+    texture->format = format;
+    texture->sdf = false;
     texture->loaded = true;
 
     return true;
 }
 
+bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data, 
+                            uint32_t width, uint32_t height, Texture2D* texture) {
+    return create_texture(context, rgba_data, width, height, VK_FORMAT_R8G8B8A8_SRGB,
+                          (VkComponentMapping){0}, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, texture);
+}
+
+bool load_texture_from_coverage(VulkanContext* context, const unsigned char* coverage,
+                                uint32_t width, uint32_t height, Texture2D* texture) {
+    // Samples as (1, 1, 1, coverage), like a white RGBA image would
+    VkComponentMapping whiteAlpha = {
+        .r = VK_COMPONENT_SWIZZLE_ONE,
+        .g = VK_COMPONENT_SWIZZLE_ONE,
+        .b = VK_COMPONENT_SWIZZLE_ONE,
+        .a = VK_COMPONENT_SWIZZLE_R
+    };
+    return create_texture(context, coverage, width, height, VK_FORMAT_R8_UNORM, whiteAlpha,
+                          VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, texture);
+}
+
 bool update_texture_from_rgba(VulkanContext* context, Texture2D* texture, 
                               unsigned char* rgba_data, int width, int height) {
     // Verify dimensions match (we're updating, not resizing drastically)
@@ -1265,6 +2026,8 @@ bool update_texture_from_rgba(VulkanContext* context, Texture2D* texture,
         vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0, NULL);
         
         texture->width = width;
+        texture->format = VK_FORMAT_R8G8B8A8_SRGB;
+        texture->sdf = false;
         texture->height = height;
         
         return true;
@@ -1330,6 +2093,85 @@ bool update_texture_from_rgba(VulkanContext* context, Texture2D* texture,
 }
 
 
+bool update_texture_region(VulkanContext* context, Texture2D* texture, const unsigned char* pixels,
+                           uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (x + width > texture->width || y + height > texture->height) {
+        fprintf(stderr, "Texture region out of bounds\n");
+        return false;
+    }
+    
+    VkDeviceSize regionSize = (VkDeviceSize)width * height * texel_size(texture->format);
+    
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = regionSize,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    
+    if (vkCreateBuffer(context->device, &bufferInfo, NULL, &stagingBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create staging buffer for texture region\n");
+        return false;
+    }
+    
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(context->device, stagingBuffer, &memRequirements);
+    
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(context->physicalDevice, memRequirements.memoryTypeBits,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    };
+    
+    if (vkAllocateMemory(context->device, &allocInfo, NULL, &stagingBufferMemory) != VK_SUCCESS) {
+        vkDestroyBuffer(context->device, stagingBuffer, NULL);
+        fprintf(stderr, "Failed to allocate staging buffer memory\n");
+        return false;
+    }
+    
+    vkBindBufferMemory(context->device, stagingBuffer, stagingBufferMemory, 0);
+    
+    void* data;
+    vkMapMemory(context->device, stagingBufferMemory, 0, regionSize, 0, &data);
+    memcpy(data, pixels, regionSize);
+    vkUnmapMemory(context->device, stagingBufferMemory);
+    
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(context->device, context->commandPool);
+    
+    transitionImageLayout(commandBuffer, texture->image, texture->format,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .imageOffset = {(int32_t)x, (int32_t)y, 0},
+        .imageExtent = {width, height, 1}
+    };
+    
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    
+    transitionImageLayout(commandBuffer, texture->image, texture->format,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    
+    endSingleTimeCommands(context->device, context->commandPool, context->graphicsQueue, commandBuffer);
+    
+    vkDestroyBuffer(context->device, stagingBuffer, NULL);
+    vkFreeMemory(context->device, stagingBufferMemory, NULL);
+    
+    return true;
+}
+
 bool load_texture_from_memory(VulkanContext* context, unsigned char* data, size_t data_size, Texture2D* texture) {
     int texWidth, texHeight, texChannels;
     stbi_uc* pixels = stbi_load_from_memory(data, data_size, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
@@ -1529,6 +2371,8 @@ bool load_texture_from_memory(VulkanContext* context, unsigned char* data, size_
     vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0, NULL);
 
     texture->width = texWidth;
+    texture->format = VK_FORMAT_R8G8B8A8_SRGB;
+    texture->sdf = false;
     texture->height = texHeight;
 
     return true;
@@ -1542,14 +2386,17 @@ int32_t texture_pool_add_from_memory(unsigned char* data, size_t data_size) {
     
     printf("Loading texture %u from memory (%zu bytes)\n", textureCount, data_size);
     
-    if (load_texture_from_memory(&context, data, data_size, &texturePool[textureCount])) {
-        texturePool[textureCount].loaded = true;
-        printf("  -> Successfully loaded as texture #%u\n", textureCount);
-        return textureCount++;
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load_from_memory(data, data_size, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        fprintf(stderr, "Failed to decode texture from memory\n");
+        printf("  -> Failed to load\n");
+        return -1;
     }
     
-    printf("  -> Failed to load\n");
-    return -1;
+    int32_t index = texture_pool_add_pixels(&context, pixels, width, height);
+    stbi_image_free(pixels);
+    return index;
 }
 
 bool load_texture(VulkanContext* context, const char* filename, Texture2D* texture) {
@@ -1744,6 +2591,8 @@ bool load_texture(VulkanContext* context, const char* filename, Texture2D* textu
     vkUpdateDescriptorSets(context->device, 1, &descriptorWrite, 0, NULL);
 
     texture->width = texWidth;
+    texture->format = VK_FORMAT_R8G8B8A8_SRGB;
+    texture->sdf = false;
     texture->height = texHeight;
 
     return true;
@@ -1875,19 +2724,27 @@ void renderer_draw_textured3D(VkCommandBuffer cmd) {
     /* printf("Drawing %u 3D texture batches (%u vertices total)\n",  */
     /*        texture3DBatchCount, vertex_count_3D_textured); */
     
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.graphicsPipelineTextured3D);
+    bool sdfBound = false;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipelineVariant(true, 0));
     
     VkDeviceSize offsets[] = {0};
     vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer3D_textured, offsets);
     
     // Identity model matrix for billboards
-    glm_mat4_identity(pushConstants.model);
+    push_constants_set_model(GLM_MAT4_IDENTITY);
     
     for (uint32_t i = 0; i < texture3DBatchCount; i++) {
         Texture3DBatch* batch = &texture3DBatches[i];
         
         if (batch->vertexCount == 0) continue;
         
+        // text3D() with an SDF font
+        if (batch->texture->sdf != sdfBound) {
+            sdfBound = batch->texture->sdf;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              sdfBound ? getSDFTextPipeline3D() : getPipelineVariant(true, 0));
+        }
+        
         /* printf("  Batch %u: texture=%p, start=%u, count=%u\n",  */
         /*        i, (void*)batch->texture, batch->startVertex, batch->vertexCount); */
         
@@ -1903,7 +2760,7 @@ void renderer_draw_textured3D(VkCommandBuffer cmd) {
                                 context.pipelineLayoutTextured3D,
                                 0, 2,
                                 descriptorSets,
-                                0, NULL
+                                1, &uniformDynamicOffset
                                 );
         
         // Push constants for model matrix and AO
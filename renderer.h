@@ -1,6 +1,7 @@
 #pragma once
 
 #include "context.h"
+#include "vulkan_setup.h"
 #include "common.h"
 #include <vulkan/vulkan.h>
 #include <cglm/cglm.h>
@@ -8,6 +9,11 @@
 #define MAX_VERTICES 65536 * 32
 #define MAX_TEXTURES 256  // Maximum number of textures we can handle
 
+#define SPRITE_ATLAS_SIZE       1024  // Sprite atlas page width and height
+#define SPRITE_ATLAS_MAX_PAGES  4
+#define SPRITE_MAX_SIZE         128   // Larger pool images are not atlased
+#define SPRITE_PADDING          1     // Border extruded around each sprite
+
 extern VkDescriptorSet descriptorSet;
 
 typedef struct {
@@ -18,12 +24,43 @@ typedef struct {
     uint32_t textureIndex;  // 0 = no texture, >0 = texture index
 } Vertex;
 
+// One 2D quad, drawn as an instance of a unit quad expanded by 2D.vert.
+// 28 bytes instead of six 36 byte vertices. The texture and z layer come
+// from the batch the quad was reserved in.
 typedef struct {
-    vec2 pos;
-    Color color;
-    vec2 texCoord;
-    uint32_t textureIndex;  // Which texture to use
-} Vertex2D;
+    float rect[4];           // x, y, width, height in pixels
+    uint16_t uv[4];          // R16G16B16A16_UNORM, uv at (x, y) then at (x + width, y + height)
+    uint32_t color;          // R8G8B8A8_UNORM, see colorToRGBA8()
+} Quad2D;
+
+#define MAX_QUADS_2D (MAX_VERTICES / 6)  // Immediate mode quads per frame
+#define MAX_CLIP_DEPTH_2D 32             // Nested clip rects
+#define MAX_Z_2D 65535                   // Highest z layer
+
+// Fill a quad, UVs in [0, 1]
+void quad2D_set(Quad2D* quad, float x, float y, float w, float h,
+                float u0, float v0, float u1, float v1, Color color);
+
+// Clip, reserve and fill one quad in the current 2D target, colored when
+// texture is NULL. Returns false only when the target is full.
+bool renderer2D_emit(struct Texture2D* texture, float x, float y, float w, float h,
+                     float u0, float v0, float u1, float v1, Color color);
+
+// Clip rects nest, each push is intersected with the one below. Quads fully
+// outside are dropped on the CPU and partially visible ones are trimmed,
+// texture coordinates included, so no scissor state splits the batches.
+void renderer2D_push_clip(float x, float y, float width, float height);
+void renderer2D_pop_clip(void);
+// Trim rect (x, y, width, height) and uv (u0, v0, u1, v1) in place, false
+// when nothing is left. For code filling reserved quads itself.
+bool renderer2D_clip(float rect[4], float uv[4]);
+
+// Quads reserved after this sit on layer z. renderer2D_draw() draws the
+// layers in increasing z across every retained layer and the immediate
+// content, so higher ones cover (and blend over) lower ones whatever the
+// submission order. Within one z the usual order holds. Returns the
+// previous layer.
+uint32_t renderer2D_set_z(uint32_t z);
 
 void renderer2D_init();
 void renderer2D_clear(void);
@@ -31,14 +68,21 @@ void quad2D(vec2 position, vec2 size, Color color);
 void renderer2D_upload();
 void renderer2D_draw(VkCommandBuffer cmd);
 
-typedef struct {
+typedef struct Texture2D {
     VkImage image;
     VkDeviceMemory memory;
     VkImageView view;
     VkSampler sampler;
     VkDescriptorSet descriptorSet;  // Each texture has its own descriptor set
     uint32_t width, height;
+    VkFormat format;                // R8G8B8A8_SRGB, or R8_UNORM for glyph coverage
+    bool sdf;                       // Alpha is a glyph distance field (SDF fonts)
     bool loaded;
+    
+    // Small pool images also live in a shared sprite atlas page, texture2D()
+    // draws from there so sprites batch together. 3D keeps the own image.
+    struct Texture2D* atlas;        // NULL = not in an atlas
+    float atlasRect[4];             // u0, v0, u1, v1 inside the page
 } Texture2D;
 
 typedef struct {
@@ -48,17 +92,56 @@ typedef struct {
 } Texture3DBatch;
 
 typedef struct {
-    Texture2D* texture;
-    uint32_t startVertex;
-    uint32_t vertexCount;
+    Texture2D* texture;      // NULL for a run of colored quads
+    uint32_t z;              // z layer, see renderer2D_set_z()
+    uint32_t firstQuad;
+    uint32_t quadCount;
 } TextureBatch;
 
+#define MAX_LAYERS_2D 64  // Retained layers drawn per frame
 
-extern Vertex2D vertices2D[MAX_VERTICES];
-extern uint32_t vertexCount2D;
-extern uint32_t coloredVertexCount;
-extern uint32_t textureBatchCount;
-extern TextureBatch textureBatches[MAX_TEXTURES];
+// A retained set of 2D geometry. Build it once between layer2D_begin() and
+// layer2D_end() with the usual quad2D/texture2D/text calls, then queue it
+// every frame with layer2D_draw(); it is only rebuilt when marked dirty.
+// The quads live in per frame-in-flight GPU buffers that are rewritten
+// once after each rebuild, so an unchanged layer costs no CPU work at all.
+typedef struct {
+    Quad2D* quads;
+    uint32_t quadCount;
+    uint32_t coloredQuadCount;    // Colored quads first, texture batches after
+    uint32_t quadCapacity;
+    TextureBatch* coloredBatches; // Runs of the colored quads on one z layer
+    uint32_t coloredBatchCount;
+    uint32_t coloredBatchCapacity;
+    TextureBatch* batches;
+    uint32_t batchCount;
+    uint32_t batchCapacity;
+    
+    VkBuffer buffers[MAX_FRAMES_IN_FLIGHT];
+    VkDeviceMemory memories[MAX_FRAMES_IN_FLIGHT];
+    VkDeviceSize bufferSizes[MAX_FRAMES_IN_FLIGHT];
+    uint32_t uploadedGeneration[MAX_FRAMES_IN_FLIGHT];
+    uint32_t generation;          // Bumped by every rebuild
+    uint32_t uvGeneration;        // renderer2D UV generation it was built against
+    bool dirty;
+} Layer2D;
+
+void layer2D_init(Layer2D* layer);
+// Returns false (and does nothing) while the layer is clean. When it returns
+// true, emit the layer's geometry and finish with layer2D_end().
+bool layer2D_begin(Layer2D* layer);
+void layer2D_end(Layer2D* layer);
+void layer2D_mark_dirty(Layer2D* layer);
+void layer2D_draw(Layer2D* layer);   // Queue for this frame, below immediate 2D of the same z
+void layer2D_destroy(Layer2D* layer);
+
+// Texture coordinates handed out earlier are stale (e.g. a glyph atlas was
+// repacked), every layer rebuilds on its next layer2D_begin()
+void renderer2D_invalidate_layers();
+
+// Room for count quads in the current 2D target, NULL when full
+Quad2D* renderer2D_reserve_colored(uint32_t count);
+Quad2D* renderer2D_reserve_textured(Texture2D* texture, uint32_t count);
 
 
 extern Vertex vertices3D_textured[MAX_VERTICES];
@@ -79,6 +162,14 @@ void renderer_clear_textured3D();
 // Texture management
 bool load_texture_from_rgba(VulkanContext* context, unsigned char* rgba_data, uint32_t width, uint32_t height, Texture2D* texture);
 bool update_texture_from_rgba(VulkanContext* context, Texture2D* texture, unsigned char* rgba_data, int width, int height);
+// R8_UNORM image whose view samples as white with the byte as alpha
+bool load_texture_from_coverage(VulkanContext* context, const unsigned char* coverage, uint32_t width, uint32_t height, Texture2D* texture);
+// Host visible, coherent buffer for per-frame uploads
+void create_host_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer, VkDeviceMemory* memory);
+// Overwrite a width x height rectangle at (x, y) of an existing texture,
+// pixels in the texture's own format
+bool update_texture_region(VulkanContext* context, Texture2D* texture, const unsigned char* pixels,
+                           uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 bool load_texture_from_memory(VulkanContext* context, unsigned char* data, size_t data_size, Texture2D* texture);
 int32_t texture_pool_add_from_memory(unsigned char* data, size_t data_size);
 
@@ -93,25 +184,22 @@ void texture_pool_cleanup(VulkanContext* context);
 int32_t texture_pool_add(VulkanContext* context, const char* filename);
 Texture2D* texture_pool_get(int32_t index);
 
-/* typedef struct { */
-/*     mat4 model; */
-/*     int ambientOcclusionEnabled; */
-/*     int isUnlit; */
-/*     int padding[2]; */
-/* } PushConstants; */
-
+// Per-draw data only, global state lives in the per-frame UBO.
+// 128 bytes, the minimum maxPushConstantsSize every device guarantees.
 typedef struct {
     mat4 model;
-    int ambientOcclusionEnabled;
-    int isUnlit;
-    int alphaMode;
-    float alphaCutoff;
+    vec4 normalMatrix[3];  // mat3 inverse-transpose of model, columns padded to vec4
+    float alphaCutoff;     // Only read by the ALPHA_MASK pipeline variants
+    uint32_t baseColor;    // RGBA8, only read by packed.vert
+    float _pad[2];
 } PushConstants;
 
 
 
 extern PushConstants pushConstants;
 
+void push_constants_set_model(mat4 model);
+
 typedef struct {
     vec3* positions;     // Morph target position deltas
     vec3* normals;       // Morph target normal deltas (optional)
@@ -127,10 +215,33 @@ typedef struct {
     uint32_t* index_map;      // Maps expanded vertex index to original vertex 
 } MorphData;
 
+#define MESH_MAX_LODS 4
+
+typedef struct {
+    uint32_t firstIndex;     // Range inside the mesh index buffer
+    uint32_t indexCount;
+    float error;             // Object space deviation from LOD 0
+} MeshLOD;
+
 typedef struct {
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
     uint32_t vertexCount;
+    VkBuffer indexBuffer;    // VK_NULL_HANDLE = non-indexed, drawn with vertexCount
+    VkDeviceMemory indexBufferMemory;
+    MeshLOD lods[MESH_MAX_LODS];
+    uint32_t lod_count;
+    vec3 bounds_center;      // Local space bounding sphere
+    float bounds_radius;
+    vec3 bounds_min;         // Local space bounding box
+    vec3 bounds_max;
+    bool packed;             // vertexBuffer holds PackedVertex
+    mat4 dequantize;         // Packed position -> local space
+    uint32_t base_color;     // RGBA8 color of packed vertices
+    struct MeshletSet* meshlets;  // LOD 0 clusters for CPU culling, NULL if none
+    struct Occluder* occluder;    // Simplified triangles for occlusion culling, NULL if none
+    bool animated;           // model written by animate_scene()
+    bool occluded;           // Hidden this frame, see occlusion.h
     mat4 model;              // World transform
     mat4 local_transform;    // Local transform (for animation)
     void* node;              // cgltf_node* (stored as void* to avoid header dependency)
@@ -143,12 +254,21 @@ typedef struct {
 
     int alpha_mode;          // 0 = OPAQUE, 1 = MASK, 2 = BLEND
     float alpha_cutoff;      // For MASK mode
+    bool double_sided;       // false = back faces are culled
 } Mesh;
 
 typedef struct {
     Mesh* items;
     size_t count;
     size_t capacity;
+    uint32_t* draw_order;    // Indices into items, built by sort_meshes_by_alpha()
+    struct MeshSortKey* draw_keys;  // Its scratch, draw_order_capacity long
+    size_t draw_order_count;
+    size_t draw_order_capacity;
+    struct OcclusionItem* occlusion_items;  // Handed to the occlusion pass, one per item
+    size_t occlusion_capacity;
+    struct MeshletCullItem* meshlet_items;  // Handed to the meshlet cull, LOD 0 meshes only
+    size_t meshlet_capacity;
 } Meshes;
 
 void renderer_init(
@@ -174,8 +294,20 @@ void sphere(vec3 center, float radius, int latDiv, int longDiv, Color color);
 
 
 void sort_meshes_by_alpha(Meshes *meshes, vec3 cameraPos);
+// occlusion_begin() over the meshes, their occluded flags are final after
+// occlusion_end()
+void meshes_occlusion_begin(Meshes* meshes, mat4 view_projection, vec3 camera_position);
+// meshlets_cull() over the visible meshes drawing LOD 0, the others are
+// drawn whole
+void meshes_meshlets_cull(Meshes* meshes, mat4 view_projection, vec3 camera_position);
+
+extern bool lodEnabled;
+extern float lodPixelThreshold;  // Largest tolerated LOD error in pixels
 
 void mesh(VkCommandBuffer cmd, Mesh* mesh);
+void mesh_compute_bounds(Mesh* mesh, const Vertex* vertices, size_t vertex_count);
+uint32_t mesh_select_lod(const Mesh* mesh);
+bool mesh_culls_back_faces(const Mesh* mesh);
 void mesh_update_morph(Mesh* mesh);
 void mesh_destroy(VkDevice device, Mesh* mesh);
 
@@ -184,6 +316,7 @@ void meshes_add(Meshes* meshes, Mesh mesh);
 void meshes_remove(Meshes* meshes, size_t index);
 void meshes_destroy(VkDevice device, Meshes* meshes);
 void meshes_draw(VkCommandBuffer cmd, Meshes* meshes);
+void meshes_draw_depth_prepass(VkCommandBuffer cmd, Meshes* meshes);
 Mesh* get_mesh(const char* name);
 
 /// LINE
@@ -66,7 +66,11 @@ void print_scene_meshes() {
         printf("  Name: %s\n", mesh->name ? mesh->name : "(null)");
         printf("  Vertex Buffer: %p\n", (void*)mesh->vertexBuffer);
         printf("  Vertex Buffer Memory: %p\n", (void*)mesh->vertexBufferMemory);
-        printf("  Vertex Count: %u\n", mesh->vertexCount);
+        printf("  Vertex Count: %u%s\n", mesh->vertexCount, mesh->packed ? " (packed)" : "");
+        for (uint32_t l = 0; l < mesh->lod_count; l++) {
+            printf("  LOD %u: %u triangles, error %.4f%s\n", l, mesh->lods[l].indexCount / 3,
+                   mesh->lods[l].error, l == mesh_select_lod(mesh) ? " (active)" : "");
+        }
         printf("  Node Pointer: %p\n", mesh->node);
         printf("  Texture Index: %d\n", mesh->textureIndex);
         printf("  Texture Pointer: %p\n", (void*)mesh->texture);
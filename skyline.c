@@ -0,0 +1,141 @@
+#include "skyline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void skyline_init(Skyline* skyline, uint32_t width, uint32_t height) {
+    memset(skyline, 0, sizeof(*skyline));
+    skyline->width = width;
+    skyline->height = height;
+    skyline->capacity = 16;
+    skyline->nodes = malloc(skyline->capacity * sizeof(SkylineNode));
+    if (!skyline->nodes) {
+        fprintf(stderr, "Failed to allocate skyline\n");
+        exit(EXIT_FAILURE);
+    }
+    skyline_reset(skyline);
+}
+
+void skyline_reset(Skyline* skyline) {
+    skyline->nodes[0] = (SkylineNode){0, 0, skyline->width};
+    skyline->count = 1;
+    skyline->used_area = 0;
+}
+
+bool skyline_restore(Skyline* skyline, const SkylineNode* nodes, uint32_t count, uint64_t used_area) {
+    uint32_t x = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (nodes[i].x != x || nodes[i].width == 0 || nodes[i].width > skyline->width - x ||
+            nodes[i].y > skyline->height) {
+            return false;
+        }
+        x += nodes[i].width;
+    }
+    if (count == 0 || x != skyline->width) return false;
+
+    if (count > skyline->capacity) {
+        SkylineNode* grown = realloc(skyline->nodes, count * sizeof(SkylineNode));
+        if (!grown) {
+            fprintf(stderr, "Failed to grow skyline\n");
+            return false;
+        }
+        skyline->nodes = grown;
+        skyline->capacity = count;
+    }
+    memcpy(skyline->nodes, nodes, count * sizeof(SkylineNode));
+    skyline->count = count;
+    skyline->used_area = used_area;
+    return true;
+}
+
+void skyline_destroy(Skyline* skyline) {
+    free(skyline->nodes);
+    memset(skyline, 0, sizeof(*skyline));
+}
+
+// Lowest y a rectangle starting at node index can sit at, UINT32_MAX if it
+// runs off the right or top edge
+static uint32_t skyline_fit(const Skyline* skyline, uint32_t index, uint32_t width, uint32_t height) {
+    uint32_t x = skyline->nodes[index].x;
+    if (x + width > skyline->width) return UINT32_MAX;
+
+    uint32_t y = 0;
+    uint32_t remaining = width;
+    for (uint32_t i = index; remaining > 0; i++) {
+        const SkylineNode* node = &skyline->nodes[i];
+        if (node->y > y) y = node->y;
+        if (y + height > skyline->height) return UINT32_MAX;
+        remaining -= node->width < remaining ? node->width : remaining;
+    }
+    return y;
+}
+
+bool skyline_pack(Skyline* skyline, uint32_t width, uint32_t height, uint32_t* x, uint32_t* y) {
+    if (width == 0 || height == 0 || width > skyline->width || height > skyline->height) return false;
+
+    uint32_t best_index = UINT32_MAX;
+    uint32_t best_top = UINT32_MAX;
+    uint32_t best_width = UINT32_MAX;
+    uint32_t best_y = 0;
+
+    for (uint32_t i = 0; i < skyline->count; i++) {
+        uint32_t fit_y = skyline_fit(skyline, i, width, height);
+        if (fit_y == UINT32_MAX) continue;
+
+        uint32_t top = fit_y + height;
+        if (top < best_top || (top == best_top && skyline->nodes[i].width < best_width)) {
+            best_index = i;
+            best_top = top;
+            best_width = skyline->nodes[i].width;
+            best_y = fit_y;
+        }
+    }
+    if (best_index == UINT32_MAX) return false;
+
+    if (skyline->count == skyline->capacity) {
+        skyline->capacity *= 2;
+        skyline->nodes = realloc(skyline->nodes, skyline->capacity * sizeof(SkylineNode));
+        if (!skyline->nodes) {
+            fprintf(stderr, "Failed to grow skyline\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // New segment on top of the rectangle
+    SkylineNode* nodes = skyline->nodes;
+    memmove(&nodes[best_index + 1], &nodes[best_index], (skyline->count - best_index) * sizeof(SkylineNode));
+    nodes[best_index] = (SkylineNode){nodes[best_index + 1].x, best_top, width};
+    skyline->count++;
+
+    // Trim or drop the segments it now covers
+    uint32_t left = nodes[best_index].x;
+    uint32_t right = left + width;
+    uint32_t i = best_index + 1;
+    while (i < skyline->count && nodes[i].x < right) {
+        uint32_t end = nodes[i].x + nodes[i].width;
+        if (end <= right) {
+            memmove(&nodes[i], &nodes[i + 1], (skyline->count - i - 1) * sizeof(SkylineNode));
+            skyline->count--;
+        } else {
+            nodes[i].width = end - right;
+            nodes[i].x = right;
+            break;
+        }
+    }
+
+    // Merge neighbours at the same height
+    for (uint32_t j = 0; j + 1 < skyline->count;) {
+        if (nodes[j].y == nodes[j + 1].y) {
+            nodes[j].width += nodes[j + 1].width;
+            memmove(&nodes[j + 1], &nodes[j + 2], (skyline->count - j - 2) * sizeof(SkylineNode));
+            skyline->count--;
+        } else {
+            j++;
+        }
+    }
+
+    skyline->used_area += (uint64_t)width * height;
+    *x = left;
+    *y = best_y;
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Skyline bottom-left rectangle packer for atlas pages. The skyline is the
+// top edge of everything packed so far, a list of horizontal segments; a
+// new rectangle goes where its top ends lowest, ties to the narrowest fit.
+
+typedef struct {
+    uint32_t x, y, width;
+} SkylineNode;
+
+typedef struct {
+    uint32_t width, height;
+    SkylineNode* nodes;      // Sorted by x, covering [0, width)
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t used_area;      // Sum of packed rectangles, for occupancy stats
+} Skyline;
+
+void skyline_init(Skyline* skyline, uint32_t width, uint32_t height);
+void skyline_reset(Skyline* skyline);
+void skyline_destroy(Skyline* skyline);
+// Replace the skyline with saved nodes, false (and left as it was) unless
+// they cover [0, width) in order within the height
+bool skyline_restore(Skyline* skyline, const SkylineNode* nodes, uint32_t count, uint64_t used_area);
+
+// Place a width x height rectangle, false when the page is full
+bool skyline_pack(Skyline* skyline, uint32_t width, uint32_t height, uint32_t* x, uint32_t* y);
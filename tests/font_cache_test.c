@@ -0,0 +1,157 @@
+// Font cache parser against truncated and corrupt files.
+// Built by `make check` with font_cache.c and skyline.c only.
+
+#include "font_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH      64
+#define HEIGHT     64
+#define TEXEL_SIZE 1
+#define GLYPH_SIZE 36
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+} Buffer;
+
+static void put(Buffer* buffer, const void* bytes, size_t size) {
+    buffer->data = realloc(buffer->data, buffer->size + size);
+    if (!buffer->data) exit(EXIT_FAILURE);
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+}
+
+static FontCacheHeader key(void) {
+    FontCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FONT_CACHE_MAGIC, sizeof(header.magic));
+    header.version = 1;
+    header.size = 24;
+    header.atlas_size = WIDTH;
+    header.glyph_size = GLYPH_SIZE;
+    return header;
+}
+
+// One glyph and one page whose skyline steps from y 5 to y 3
+static Buffer valid_file(uint32_t rows) {
+    Buffer file = {0};
+    FontCacheHeader header = key();
+    header.glyph_count = 1;
+    header.page_count = 1;
+    put(&file, &header, sizeof(header));
+
+    unsigned char glyph[sizeof(uint32_t) + GLYPH_SIZE] = {'A'};
+    put(&file, glyph, sizeof(glyph));
+
+    FontCachePage page = {rows, 2, 5 * 10 + 3 * 54};
+    SkylineNode nodes[2] = {{0, 5, 10}, {10, 3, WIDTH - 10}};
+    put(&file, &page, sizeof(page));
+    put(&file, nodes, sizeof(nodes));
+    unsigned char row[WIDTH * TEXEL_SIZE];
+    for (uint32_t y = 0; y < rows; y++) {
+        memset(row, (int)y, sizeof(row));
+        put(&file, row, sizeof(row));
+    }
+    return file;
+}
+
+static bool parse(const Buffer* file, FontCacheView* view) {
+    FontCacheHeader expected = key();
+    return font_cache_parse(file->data, file->size, &expected, WIDTH, HEIGHT, TEXEL_SIZE, 4, view);
+}
+
+static size_t page_offset(void) {
+    return sizeof(FontCacheHeader) + sizeof(uint32_t) + GLYPH_SIZE;
+}
+
+int main(void) {
+    FontCacheView view;
+
+    Buffer file = valid_file(5);
+    CHECK(parse(&file, &view));
+    CHECK(view.glyph_count == 1 && view.page_count == 1);
+    CHECK(view.glyph_stride == sizeof(uint32_t) + GLYPH_SIZE);
+    CHECK(view.pages[0].info.rows == 5 && view.pages[0].info.node_count == 2);
+    CHECK(view.pages[0].texels + 5 * WIDTH * TEXEL_SIZE == file.data + file.size);
+    CHECK(view.pages[0].texels[4 * WIDTH] == 4);
+
+    // Every truncation is rejected
+    for (size_t size = 0; size < file.size; size++) {
+        Buffer truncated = {file.data, size};
+        CHECK(!parse(&truncated, &view));
+    }
+
+    // Stale key
+    FontCacheHeader expected = key();
+    expected.version = 2;
+    CHECK(!font_cache_parse(file.data, file.size, &expected, WIDTH, HEIGHT, TEXEL_SIZE, 4, &view));
+
+    // A glyph count the file can't hold
+    FontCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    header.glyph_count = UINT32_MAX;
+    memcpy(file.data, &header, sizeof(header));
+    CHECK(!parse(&file, &view));
+    header.glyph_count = 1;
+
+    // More pages than the font allows, or none
+    header.page_count = 5;
+    memcpy(file.data, &header, sizeof(header));
+    CHECK(!parse(&file, &view));
+    header.page_count = 0;
+    memcpy(file.data, &header, sizeof(header));
+    CHECK(!parse(&file, &view));
+    header.page_count = 1;
+    memcpy(file.data, &header, sizeof(header));
+    CHECK(parse(&file, &view));
+    free(file.data);
+
+    // Fewer rows than the skyline is high, the texels under it are missing
+    file = valid_file(4);
+    CHECK(!parse(&file, &view));
+    free(file.data);
+
+    // More rows than the atlas page holds, even with the bytes present
+    file = valid_file(HEIGHT + 1);
+    CHECK(!parse(&file, &view));
+    free(file.data);
+
+    // Node counts and skylines that don't cover the page
+    file = valid_file(5);
+    FontCachePage page;
+    memcpy(&page, file.data + page_offset(), sizeof(page));
+    page.node_count = UINT32_MAX;
+    memcpy(file.data + page_offset(), &page, sizeof(page));
+    CHECK(!parse(&file, &view));
+    page.node_count = 0;
+    memcpy(file.data + page_offset(), &page, sizeof(page));
+    CHECK(!parse(&file, &view));
+    page.node_count = 2;
+    memcpy(file.data + page_offset(), &page, sizeof(page));
+
+    SkylineNode node = {0, 5, 9};
+    memcpy(file.data + page_offset() + sizeof(page), &node, sizeof(node));
+    CHECK(!parse(&file, &view));
+    node = (SkylineNode){0, 5, WIDTH};
+    memcpy(file.data + page_offset() + sizeof(page), &node, sizeof(node));
+    CHECK(!parse(&file, &view));
+    free(file.data);
+
+    if (failures) {
+        fprintf(stderr, "font_cache_test: %d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("font_cache_test: ok\n");
+    return EXIT_SUCCESS;
+}
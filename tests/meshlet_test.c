@@ -0,0 +1,197 @@
+// Meshlet build and cull on the CPU: a flat grid split into clusters is
+// drawn whole in front of the camera, partly at the edge of the frustum
+// and not at all from behind or out of view.
+// Built by `make check` with meshlet.c only.
+
+#include "meshlet.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define GRID 48  // Quads per side, two triangles each
+
+// Strided like Vertex, positions first
+typedef struct {
+    float pos[3];
+    float uv[2];
+} GridVertex;
+
+static GridVertex vertices[(GRID + 1) * (GRID + 1)];
+static uint32_t indices[GRID * GRID * 6];
+
+// Spans -1..1 in x and y at z = 0, counter-clockwise seen from +z
+static void build_grid() {
+    for (uint32_t y = 0; y <= GRID; y++) {
+        for (uint32_t x = 0; x <= GRID; x++) {
+            GridVertex* v = &vertices[y * (GRID + 1) + x];
+            v->pos[0] = -1.0f + 2.0f * x / GRID;
+            v->pos[1] = -1.0f + 2.0f * y / GRID;
+            v->pos[2] = 0.0f;
+            v->uv[0] = (float)x / GRID;
+            v->uv[1] = (float)y / GRID;
+        }
+    }
+
+    uint32_t* i = indices;
+    for (uint32_t y = 0; y < GRID; y++) {
+        for (uint32_t x = 0; x < GRID; x++) {
+            uint32_t a = y * (GRID + 1) + x;
+            uint32_t b = a + 1, c = a + GRID + 1, d = c + 1;
+            *i++ = a; *i++ = b; *i++ = d;
+            *i++ = a; *i++ = d; *i++ = c;
+        }
+    }
+}
+
+// Camera at the origin looking down -z, zero to one depth
+static void perspective(float fov_y, float aspect, float near, float far, float out[16]) {
+    float f = 1.0f / tanf(fov_y * 0.5f);
+    memset(out, 0, 16 * sizeof(float));
+    out[0] = f / aspect;
+    out[5] = f;
+    out[10] = far / (near - far);
+    out[11] = -1.0f;
+    out[14] = near * far / (near - far);
+}
+
+static void item_at(MeshletCullItem* item, MeshletSet* set, float x, float y, float z) {
+    memset(item, 0, sizeof(*item));
+    item->meshlets = set;
+    item->model[0] = item->model[5] = item->model[10] = item->model[15] = 1.0f;
+    item->model[12] = x;
+    item->model[13] = y;
+    item->model[14] = z;
+    item->bounds_radius = sqrtf(2.0f);
+    item->cull_back_faces = true;
+}
+
+static void cull(MeshletCullItem* items, size_t count) {
+    float view_projection[16];
+    perspective(1.5707964f, 1.0f, 0.1f, 100.0f, view_projection);
+    float camera[3] = {0.0f, 0.0f, 0.0f};
+    meshlets_cull(items, count, view_projection, camera);
+}
+
+// The ranges cover exactly the visible meshlets' indices
+static uint32_t range_indices(const MeshletSet* set) {
+    uint32_t total = 0;
+    for (uint32_t r = 0; r < set->range_total; r++) total += set->range_count[r];
+    return total;
+}
+
+int main(void) {
+    build_grid();
+    size_t index_count = sizeof(indices) / sizeof(indices[0]);
+    size_t vertex_count = sizeof(vertices) / sizeof(vertices[0]);
+
+    CHECK(meshlets_build(indices, 6 * 4, vertices[0].pos, sizeof(GridVertex), vertex_count) == NULL);
+
+    MeshletSet* set = meshlets_build(indices, index_count, vertices[0].pos, sizeof(GridVertex), vertex_count);
+    CHECK(set != NULL);
+    if (!set) return EXIT_FAILURE;
+    CHECK(set->count >= MESHLET_MIN_COUNT);
+
+    // Consecutive runs covering every triangle, each inside its sphere and
+    // facing +z with a zero width cone
+    uint32_t next = 0;
+    for (uint32_t m = 0; m < set->count; m++) {
+        CHECK(set->first_index[m] == next);
+        CHECK(set->index_count[m] > 0 && set->index_count[m] <= MESHLET_MAX_TRIANGLES * 3);
+        next += set->index_count[m];
+
+        for (uint32_t i = 0; i < set->index_count[m]; i++) {
+            const float* p = vertices[indices[set->first_index[m] + i]].pos;
+            float dx = p[0] - set->center_x[m], dy = p[1] - set->center_y[m], dz = p[2] - set->center_z[m];
+            CHECK(sqrtf(dx * dx + dy * dy + dz * dz) <= set->radius[m] * 1.0001f);
+        }
+        CHECK(set->cone_z[m] > 0.999f && set->cone_cutoff[m] < 1e-3f);
+    }
+    CHECK(next == index_count);
+
+    uint32_t triangles = (uint32_t)(index_count / 3);
+    for (int threaded = 0; threaded < 2; threaded++) {
+        if (threaded) meshlets_init();
+
+        // Facing the camera in the middle of the view, one merged range
+        MeshletCullItem item;
+        item_at(&item, set, 0.0f, 0.0f, -5.0f);
+        cull(&item, 1);
+        CHECK(set->culled && set->visible_count == set->count);
+        CHECK(set->range_total == 1 && range_indices(set) == index_count);
+        CHECK(meshletStats.meshes == 1 && meshletStats.meshes_culled == 0);
+        CHECK(meshletStats.triangles == triangles && meshletStats.triangles_meshlet == triangles);
+
+        // Straddling the top frustum plane, y = 5 at this depth. Clusters
+        // are runs of rows, so some end up wholly above it
+        item_at(&item, set, 0.0f, 5.0f, -5.0f);
+        cull(&item, 1);
+        CHECK(set->visible_count > 0 && set->visible_count < set->count);
+        CHECK(meshletStats.meshlets_frustum == set->count - set->visible_count);
+        CHECK(meshletStats.meshlets_backface == 0);
+        CHECK(range_indices(set) == meshletStats.triangles_meshlet * 3);
+
+        // Turned around, every cluster faces away...
+        item_at(&item, set, 0.0f, 0.0f, -5.0f);
+        item.model[0] = item.model[10] = -1.0f;
+        cull(&item, 1);
+        CHECK(set->culled && set->visible_count == 0 && set->range_total == 0);
+        CHECK(meshletStats.meshlets_backface == set->count);
+
+        // ...unless back faces are drawn
+        item.cull_back_faces = false;
+        cull(&item, 1);
+        CHECK(set->visible_count == set->count);
+
+        // Behind the camera, rejected by the mesh sphere alone
+        item_at(&item, set, 0.0f, 0.0f, 5.0f);
+        cull(&item, 1);
+        CHECK(set->culled && set->range_total == 0);
+        CHECK(meshletStats.meshes_culled == 1 && meshletStats.meshlets_frustum == set->count);
+        CHECK(meshletStats.triangles_mesh == 0);
+
+        // Several items share the pool, stats add up
+        MeshletSet* sets[3] = {
+            set,
+            meshlets_build(indices, index_count, vertices[0].pos, sizeof(GridVertex), vertex_count),
+            meshlets_build(indices, index_count, vertices[0].pos, sizeof(GridVertex), vertex_count),
+        };
+        MeshletCullItem items[3];
+        item_at(&items[0], sets[0], 0.0f, 0.0f, -5.0f);
+        item_at(&items[1], sets[1], 0.0f, 5.0f, -5.0f);
+        item_at(&items[2], sets[2], 0.0f, 0.0f, 5.0f);
+        cull(items, 3);
+        CHECK(meshletStats.meshes == 3 && meshletStats.meshes_culled == 1);
+        CHECK(sets[0]->visible_count == set->count);
+        CHECK(sets[1]->visible_count > 0 && sets[1]->visible_count < set->count);
+        CHECK(sets[2]->range_total == 0);
+        CHECK(meshletStats.triangles_meshlet * 3 == range_indices(sets[0]) + range_indices(sets[1]));
+
+        // Disabled, the whole LOD is drawn
+        meshletCullingEnabled = false;
+        cull(items, 3);
+        CHECK(!sets[0]->culled && !sets[1]->culled && !sets[2]->culled);
+        meshletCullingEnabled = true;
+
+        meshlets_destroy(sets[1]);
+        meshlets_destroy(sets[2]);
+    }
+    meshlets_shutdown();
+    meshlets_destroy(set);
+
+    if (failures) {
+        fprintf(stderr, "meshlet_test: %d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("meshlet_test: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Occlusion pass on the CPU: a wall in front of the camera hides the box
+// behind it but not the one before it.
+// Built by `make check` with occlusion.c only.
+
+#include "occlusion.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+enum { WALL, BEHIND, IN_FRONT, BESIDE, ITEM_COUNT };
+
+// Camera at the origin looking down -z, zero to one depth
+static void perspective(float fov_y, float aspect, float near, float far, float out[16]) {
+    float f = 1.0f / tanf(fov_y * 0.5f);
+    memset(out, 0, 16 * sizeof(float));
+    out[0] = f / aspect;
+    out[5] = f;
+    out[10] = far / (near - far);
+    out[11] = -1.0f;
+    out[14] = near * far / (near - far);
+}
+
+static void translation(float x, float y, float z, float out[16]) {
+    memset(out, 0, 16 * sizeof(float));
+    out[0] = out[5] = out[10] = out[15] = 1.0f;
+    out[12] = x;
+    out[13] = y;
+    out[14] = z;
+}
+
+static void box(OcclusionItem* item, bool* occluded, float x, float y, float z, float half) {
+    memset(item, 0, sizeof(*item));
+    translation(x, y, z, item->model);
+    for (int i = 0; i < 3; i++) {
+        item->bounds_min[i] = -half;
+        item->bounds_max[i] = half;
+    }
+    item->triangles = 12;
+    item->occluded = occluded;
+}
+
+// Run the pass over the wall at z = -5 and three unit boxes
+static void run(Occluder* wall, bool double_sided, float wall_scale_x, bool occluded[ITEM_COUNT]) {
+    OcclusionItem items[ITEM_COUNT];
+    box(&items[WALL], &occluded[WALL], 0.0f, 0.0f, -5.0f, 2.0f);
+    items[WALL].bounds_min[2] = items[WALL].bounds_max[2] = 0.0f;
+    items[WALL].model[0] = wall_scale_x;
+    items[WALL].occluder = wall;
+    items[WALL].double_sided = double_sided;
+    box(&items[BEHIND], &occluded[BEHIND], 0.0f, 0.0f, -9.5f, 0.5f);
+    box(&items[IN_FRONT], &occluded[IN_FRONT], 0.0f, 0.0f, -2.5f, 0.5f);
+    box(&items[BESIDE], &occluded[BESIDE], 8.0f, 0.0f, -9.5f, 0.5f);
+
+    for (int i = 0; i < ITEM_COUNT; i++) occluded[i] = !occluded[i];
+
+    float view_projection[16];
+    perspective(1.5707964f, 2.0f, 0.1f, 100.0f, view_projection);
+    float camera[3] = {0.0f, 0.0f, 0.0f};
+    occlusion_begin(items, ITEM_COUNT, view_projection, camera);
+    occlusion_end();
+}
+
+int main(void) {
+    // 4x4 quad facing the camera, counter-clockwise seen from +z
+    float quad[4][3] = {{-2, -2, 0}, {2, -2, 0}, {2, 2, 0}, {-2, 2, 0}};
+    uint32_t front[6] = {0, 1, 2, 0, 2, 3};
+    uint32_t back[6] = {0, 2, 1, 0, 3, 2};
+    Occluder* wall = occluder_build(front, 6, quad[0], sizeof(quad[0]), 4);
+    Occluder* wall_back = occluder_build(back, 6, quad[0], sizeof(quad[0]), 4);
+    CHECK(wall && wall->vertex_count == 4 && wall->index_count == 6);
+
+    bool occluded[ITEM_COUNT];
+    for (int threaded = 0; threaded < 2; threaded++) {
+        if (threaded) occlusion_init();
+
+        memset(occluded, 0, sizeof(occluded));
+        run(wall, false, 1.0f, occluded);
+        CHECK(!occluded[WALL]);
+        CHECK(occluded[BEHIND]);
+        CHECK(!occluded[IN_FRONT]);
+        CHECK(!occluded[BESIDE]);
+        CHECK(occlusionStats.occluders == 1 && occlusionStats.tested == ITEM_COUNT);
+        CHECK(occlusionStats.culled == 1 && occlusionStats.culled_triangles == 12);
+
+        // Back faces are culled on the GPU, so they hide nothing...
+        run(wall_back, false, 1.0f, occluded);
+        CHECK(!occluded[BEHIND]);
+
+        // ...unless the surface is double sided
+        run(wall_back, true, 1.0f, occluded);
+        CHECK(occluded[BEHIND]);
+
+        // A mirroring transform flips the winding, those draw unculled
+        run(wall_back, false, -1.0f, occluded);
+        CHECK(occluded[BEHIND]);
+        run(wall, false, -1.0f, occluded);
+        CHECK(occluded[BEHIND]);
+
+        // Animated meshes neither occlude nor get culled
+        OcclusionItem item;
+        box(&item, &occluded[BEHIND], 0.0f, 0.0f, -9.5f, 0.5f);
+        item.dynamic = true;
+        occluded[BEHIND] = true;
+        float identity[16];
+        translation(0.0f, 0.0f, 0.0f, identity);
+        float camera[3] = {0.0f, 0.0f, 0.0f};
+        occlusion_begin(&item, 1, identity, camera);
+        occlusion_end();
+        CHECK(!occluded[BEHIND]);
+
+        // Disabled, nothing is hidden
+        occlusionCullingEnabled = false;
+        run(wall, false, 1.0f, occluded);
+        CHECK(!occluded[BEHIND]);
+        occlusionCullingEnabled = true;
+    }
+    occlusion_shutdown();
+
+    float mirror[16];
+    translation(1.0f, 2.0f, 3.0f, mirror);
+    CHECK(occlusion_culls_back_faces(mirror, false));
+    CHECK(!occlusion_culls_back_faces(mirror, true));
+    mirror[5] = -1.0f;
+    CHECK(!occlusion_culls_back_faces(mirror, false));
+
+    occluder_destroy(wall);
+    occluder_destroy(wall_back);
+
+    if (failures) {
+        fprintf(stderr, "occlusion_test: %d failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("occlusion_test: ok\n");
+    return EXIT_SUCCESS;
+}
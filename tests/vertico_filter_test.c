@@ -0,0 +1,171 @@
+// Incremental vertico narrowing against a full rescan: random appends,
+// backspaces and mid-input edits must give the same matches in the same
+// order as scoring every candidate from scratch.
+// Built by `make check` with vertico_filter.c only.
+
+#include "vertico_filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CANDIDATES 800
+#define MAX_CANDIDATES 1024
+#define STEPS 20000
+#define MAX_INPUT 40
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// Strided like VerticoCandidate
+typedef struct {
+    char text[48];
+    void* data;
+} Candidate;
+
+static Candidate candidates[MAX_CANDIDATES];
+static size_t candidate_count = 0;
+
+// Few letters so inputs keep matching, upper case and UTF-8 bytes for the
+// case folding
+static const char* const pieces[] = {"a", "b", "c", "d", "e", "A", "B", " ", "\xC3\xA9", "ab", "de"};
+#define PIECE_COUNT (sizeof(pieces) / sizeof(pieces[0]))
+
+static uint32_t rng_state = 0x9E3779B9u;
+
+static uint32_t rng(uint32_t n) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % n;
+}
+
+static void random_text(char* out, size_t size) {
+    size_t length = 0;
+    size_t target = 1 + rng(20);
+    while (length < target) {
+        const char* piece = pieces[rng(PIECE_COUNT)];
+        size_t n = strlen(piece);
+        if (length + n >= size) break;
+        memcpy(out + length, piece, n);
+        length += n;
+    }
+    out[length] = '\0';
+}
+
+static void add_candidate(void) {
+    Candidate* candidate = &candidates[candidate_count++];
+    // Some duplicates, ties are then broken by text alone
+    if (candidate_count > 1 && rng(10) == 0) {
+        memcpy(candidate->text, candidates[rng((uint32_t)candidate_count - 1)].text, sizeof(candidate->text));
+    } else {
+        random_text(candidate->text, sizeof(candidate->text));
+    }
+}
+
+static int compare_display(const void* a, const void* b) {
+    const VerticoMatch* ma = (const VerticoMatch*)a;
+    const VerticoMatch* mb = (const VerticoMatch*)b;
+    if (ma->score > mb->score) return -1;
+    if (ma->score < mb->score) return 1;
+    return strcmp(candidates[ma->candidate].text, candidates[mb->candidate].text);
+}
+
+// Score everything and compare with what the filter kept, candidates with
+// the same text and score may come in either order
+static bool same_as_rescan(const VerticoFilter* filter, const VerticoFilterLevel* level, const char* input) {
+    static VerticoMatch expected[MAX_CANDIDATES];
+    size_t count = 0;
+    for (size_t i = 0; i < candidate_count; i++) {
+        float score = vertico_fuzzy_match(input, candidates[i].text);
+        if (score > 0.0f) expected[count++] = (VerticoMatch){(uint32_t)i, score};
+    }
+    qsort(expected, count, sizeof(VerticoMatch), compare_display);
+
+    if (level->count != count) return false;
+    for (size_t i = 0; i < count; i++) {
+        const VerticoMatch* match = &filter->matches[level->first + i];
+        if (match->score != expected[i].score) return false;
+        if (strcmp(candidates[match->candidate].text, candidates[expected[i].candidate].text) != 0) return false;
+    }
+    return true;
+}
+
+int main(void) {
+    for (size_t i = 0; i < CANDIDATES; i++) add_candidate();
+
+    VerticoFilter filter = {0};
+    char input[VERTICO_INPUT_BUFFER_SIZE] = "";
+    size_t length = 0;
+    size_t mismatches = 0;
+
+    for (int step = 0; step < STEPS; step++) {
+        uint32_t op = rng(100);
+        if (op < 45) {
+            // Type
+            const char* piece = pieces[rng(PIECE_COUNT)];
+            size_t n = strlen(piece);
+            if (length + n <= MAX_INPUT) {
+                memcpy(input + length, piece, n);
+                length += n;
+            }
+        } else if (op < 70) {
+            // Backspace, possibly through the middle of a UTF-8 sequence
+            if (length > 0) length--;
+        } else if (op < 80) {
+            // Overwrite a byte somewhere before the end
+            if (length > 0) input[rng((uint32_t)length)] = pieces[rng(PIECE_COUNT)][0];
+        } else if (op < 90) {
+            // Insert somewhere in the middle
+            if (length < MAX_INPUT) {
+                size_t at = rng((uint32_t)length + 1);
+                memmove(input + at + 1, input + at, length - at);
+                input[at] = pieces[rng(PIECE_COUNT)][0];
+                length++;
+            }
+        } else if (op < 95) {
+            // Delete somewhere in the middle
+            if (length > 0) {
+                size_t at = rng((uint32_t)length);
+                memmove(input + at, input + at + 1, length - at - 1);
+                length--;
+            }
+        } else if (op < 98) {
+            length = 0;
+        } else if (candidate_count < MAX_CANDIDATES) {
+            // New candidate, the levels don't know it
+            add_candidate();
+            vertico_filter_reset(&filter);
+        }
+        input[length] = '\0';
+
+        const VerticoFilterLevel* level = vertico_filter_narrow(&filter, input, length, candidates[0].text,
+                                                                sizeof(Candidate), candidate_count);
+        CHECK(level != NULL);
+        if (!level) break;
+        CHECK(level->input_length == length);
+        if (!same_as_rescan(&filter, level, input)) mismatches++;
+    }
+    CHECK(mismatches == 0);
+
+    // The stack only grows one level per prefix
+    CHECK(filter.level_count <= MAX_INPUT + 1);
+
+    // An empty input keeps every candidate
+    const VerticoFilterLevel* level = vertico_filter_narrow(&filter, "", 0, candidates[0].text,
+                                                            sizeof(Candidate), candidate_count);
+    CHECK(level && level->count == candidate_count);
+    vertico_filter_free(&filter);
+
+    if (failures) {
+        fprintf(stderr, "vertico_filter_test: %d failed, %zu of %d steps differ\n", failures, mismatches, STEPS);
+        return EXIT_FAILURE;
+    }
+    printf("vertico_filter_test: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -7,7 +7,18 @@ layout(location = 0) out vec4 outColor;
 
 layout(binding = 0) uniform sampler2D texSampler;
 
+// Same id as in texture3D.frag, see createSDFPipeline() in vulkan_setup.c
+layout(constant_id = 3) const bool SDF = false;
+
+// Alpha is a distance field with the glyph edge at 0.5, antialias over
+// about one screen pixel whatever the scale
+float sdfCoverage(float distance) {
+    float width = max(fwidth(distance) * 0.75, 1.0 / 255.0);
+    return smoothstep(0.5 - width, 0.5 + width, distance);
+}
+
 void main() {
     vec4 texColor = texture(texSampler, fragTexCoord);
+    if (SDF) texColor.a = sdfCoverage(texColor.a);
     outColor = fragColor * texColor;
 }
@@ -3,11 +3,34 @@
 layout(location = 0) in vec4 fragColor;
 layout(location = 1) in vec3 fragNormal;
 layout(location = 2) in vec3 fragWorldPos;
-layout(location = 3) in flat int fragAmbientOcclusionEnabled;
 layout(location = 4) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 vp;
+    vec4 cameraPos;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 skyColor;
+    vec4 groundColor;
+    float time;
+    float deltaTime;
+    float fogDensity;
+} ubo;
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    mat3 normalMatrix;    // Inverse-transpose of model, computed on the CPU
+    float alphaCutoff;
+} pc;
+
+// Pipeline variants, see createPipelineVariants() in vulkan_setup.c
+layout(constant_id = 0) const bool UNLIT = false;
+layout(constant_id = 1) const bool ALPHA_MASK = false;
+layout(constant_id = 2) const bool AMBIENT_OCCLUSION = true;
+layout(constant_id = 3) const bool SDF = false;  // SDF font pages only
+
 // Change to set 1, binding 0
 layout(set = 1, binding = 0) uniform sampler2D texSampler;
 
@@ -20,35 +43,52 @@ float cheapAO(vec3 normal) {
     return mix(0.2, 1.0, upFactor);
 }
 
+// Alpha is a distance field with the glyph edge at 0.5, antialias over
+// about one screen pixel whatever the scale
+float sdfCoverage(float distance) {
+    float width = max(fwidth(distance) * 0.75, 1.0 / 255.0);
+    return smoothstep(0.5 - width, 0.5 + width, distance);
+}
+
 void main() {
     // Sample the texture
     vec4 texColor = texture(texSampler, fragTexCoord);
+    if (SDF) texColor.a = sdfCoverage(texColor.a);
     
     // Apply color tint
     vec4 baseColor = fragColor * texColor;
     
+    if (ALPHA_MASK && baseColor.a < pc.alphaCutoff) {
+        discard;
+    }
+    
+    if (UNLIT) {
+        outColor = baseColor;
+        return;
+    }
+    
     // Apply simple lighting (same as regular 3D shader)
     vec3 N = normalize(fragNormal);
-    vec3 lightDir = normalize(vec3(0.3, 0.8, 0.5));
+    vec3 lightDir = ubo.lightDir.xyz;
     float diff = max(dot(N, lightDir), 0.0);
     
-    vec3 skyColor = vec3(0.3, 0.5, 0.7);
-    vec3 groundColor = vec3(0.2, 0.15, 0.1);
+    vec3 skyColor = ubo.skyColor.rgb;
+    vec3 groundColor = ubo.groundColor.rgb;
     
     float hemiBlend = dot(N, vec3(0, 1, 0)) * 0.5 + 0.5;
     
     // APPLY AMBIENT OCCLUSION HERE - THIS IS WHAT'S MISSING!
-    float ao = fragAmbientOcclusionEnabled != 0 ? cheapAO(N) : 1.0;
+    float ao = AMBIENT_OCCLUSION ? cheapAO(N) : 1.0;
     vec3 ambient = mix(groundColor, skyColor, hemiBlend) * ao;
     
-    vec3 sunColor = vec3(1.0, 0.95, 0.8);
+    vec3 sunColor = ubo.lightColor.rgb;
     vec3 direct = sunColor * diff;
     
     vec3 finalColor = baseColor.rgb * (ambient + direct);
     
     // Distance fog
-    float dist = length(fragWorldPos);
-    float fogFactor = exp(-dist * 0.01);
+    float dist = length(fragWorldPos - ubo.cameraPos.xyz);
+    float fogFactor = exp(-dist * ubo.fogDensity);
     finalColor = mix(skyColor * 0.5, finalColor, fogFactor);
     
     outColor = vec4(finalColor, baseColor.a);
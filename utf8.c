@@ -0,0 +1,163 @@
+#include "utf8.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+uint32_t utf8_decode(const char** p, const char* end) {
+    const unsigned char* s = (const unsigned char*)*p;
+    const unsigned char* e = (const unsigned char*)end;
+    unsigned char lead = *s++;
+
+    if (lead < 0x80) {
+        *p = (const char*)s;
+        return lead;
+    }
+
+    // Well-formed sequences per the Unicode standard, table 3-7. The first
+    // continuation byte's range rules out overlongs, surrogates and values
+    // past U+10FFFF.
+    uint32_t codepoint;
+    int continuations;
+    unsigned char lo = 0x80, hi = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        codepoint = lead & 0x1F;
+        continuations = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        codepoint = lead & 0x0F;
+        continuations = 2;
+        if (lead == 0xE0) lo = 0xA0;
+        if (lead == 0xED) hi = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        codepoint = lead & 0x07;
+        continuations = 3;
+        if (lead == 0xF0) lo = 0x90;
+        if (lead == 0xF4) hi = 0x8F;
+    } else {
+        // Continuation byte without a lead, C0, C1 or F5 and up
+        *p = (const char*)s;
+        return UTF8_REPLACEMENT;
+    }
+
+    while (continuations--) {
+        if (s == e || *s < lo || *s > hi) {
+            // The offending byte starts the next decode
+            *p = (const char*)s;
+            return UTF8_REPLACEMENT;
+        }
+        codepoint = (codepoint << 6) | (*s++ & 0x3F);
+        lo = 0x80;
+        hi = 0xBF;
+    }
+
+    *p = (const char*)s;
+    return codepoint;
+}
+
+size_t utf8_decode_bulk(const char** p, const char* end, uint32_t* out, size_t capacity) {
+    const unsigned char* s = (const unsigned char*)*p;
+    const unsigned char* e = (const unsigned char*)end;
+    size_t count = 0;
+
+    while (count < capacity && s < e) {
+#if defined(__AVX2__)
+        // 32 ASCII bytes at a time, zero extended 8 per store
+        while (capacity - count >= 32 && e - s >= 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i*)s);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(bytes);
+            if (mask) {
+                // Copy the ASCII prefix, the scalar path takes the rest
+                uint32_t ascii = (uint32_t)__builtin_ctz(mask);
+                for (uint32_t i = 0; i < ascii; i++) out[count++] = s[i];
+                s += ascii;
+                break;
+            }
+            for (int i = 0; i < 32; i += 8) {
+                __m128i eight = _mm_loadl_epi64((const __m128i*)(s + i));
+                _mm256_storeu_si256((__m256i*)(out + count + i), _mm256_cvtepu8_epi32(eight));
+            }
+            s += 32;
+            count += 32;
+        }
+#elif defined(__SSE2__)
+        // 16 ASCII bytes at a time, widened by interleaving with zero
+        const __m128i zero = _mm_setzero_si128();
+        while (capacity - count >= 16 && e - s >= 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)s);
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(bytes);
+            if (mask) {
+                uint32_t ascii = (uint32_t)__builtin_ctz(mask);
+                for (uint32_t i = 0; i < ascii; i++) out[count++] = s[i];
+                s += ascii;
+                break;
+            }
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128((__m128i*)(out + count + 0), _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128((__m128i*)(out + count + 4), _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128((__m128i*)(out + count + 8), _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128((__m128i*)(out + count + 12), _mm_unpackhi_epi16(hi, zero));
+            s += 16;
+            count += 16;
+        }
+#endif
+        if (count == capacity || s == e) break;
+
+        // One codepoint, then back to the wide path
+        if (*s < 0x80) {
+            out[count++] = *s++;
+        } else {
+            const char* c = (const char*)s;
+            out[count++] = utf8_decode(&c, end);
+            s = (const unsigned char*)c;
+        }
+    }
+
+    *p = (const char*)s;
+    return count;
+}
+
+size_t utf8_encode(uint32_t codepoint, char out[UTF8_MAX_BYTES]) {
+    if ((codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF) {
+        codepoint = UTF8_REPLACEMENT;
+    }
+
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+const char* utf8_prev(const char* start, const char* p) {
+    if (p <= start) return start;
+
+    // Back over up to three continuation bytes to a candidate lead, then
+    // accept it only if it decodes to exactly [lead, p)
+    const char* lead = p - 1;
+    while (lead > start && p - lead < UTF8_MAX_BYTES &&
+           ((unsigned char)*lead & 0xC0) == 0x80) {
+        lead--;
+    }
+
+    const char* next = lead;
+    utf8_decode(&next, p);
+    return next == p ? lead : p - 1;
+}
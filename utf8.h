@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// UTF-8 decoding shared by text layout and input. Malformed input never
+// stops a decode: each maximal invalid subpart (stray continuation byte,
+// overlong form, surrogate, value past U+10FFFF, truncated sequence)
+// becomes one U+FFFD, the substitution the Unicode standard recommends.
+
+#define UTF8_REPLACEMENT 0xFFFD
+#define UTF8_MAX_BYTES   4
+
+// Decode the codepoint at *p, which must be before end, and advance *p
+// past it. Never reads at or past end.
+uint32_t utf8_decode(const char** p, const char* end);
+
+// Decode up to capacity codepoints of [*p, end) into out and advance *p
+// past them, returns how many were written. Runs of ASCII are widened 32
+// (AVX2) or 16 (SSE2) bytes at a time.
+size_t utf8_decode_bulk(const char** p, const char* end, uint32_t* out, size_t capacity);
+
+// Write codepoint as UTF-8, returns the byte count. Surrogates and values
+// past U+10FFFF are written as U+FFFD.
+size_t utf8_encode(uint32_t codepoint, char out[UTF8_MAX_BYTES]);
+
+// Start of the codepoint ending at p, never before start. A malformed
+// tail steps back one byte, matching what utf8_decode() would consume.
+const char* utf8_prev(const char* start, const char* p);
@@ -3,6 +3,7 @@
 #include "common.h"
 #include "context.h"
 #include "theme.h"
+#include "utf8.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,9 +49,16 @@ void vertico_cleanup() {
         destroy_font(vertico.font);
         vertico.font = NULL;
     }
+    vertico_filter_free(&vertico.filter);
     keymap_free(&vertico.vertico_keymap);
 }
 
+// Control characters never reach the input, chords handle those keys
+static void vertico_text_input(unsigned int codepoint) {
+    if (codepoint < 32 || codepoint == 127) return;
+    vertico_insert_codepoint(codepoint);
+}
+
 void vertico_activate(const char* category, VerticoSelectCallback callback) {
     vertico.is_active = true;
     vertico.on_select = callback;
@@ -75,6 +83,13 @@ void vertico_activate(const char* category, VerticoSelectCallback callback) {
     keymap = vertico.vertico_keymap;
     vertico.vertico_keymap = temp;
     
+    // Typed text arrives from the GLFW char callback, already laid out by
+    // the keyboard and not limited to ASCII
+    if (currentTextCallback != vertico_text_input) {
+        vertico.saved_text_callback = currentTextCallback;
+        registerTextCallback(vertico_text_input);
+    }
+    
     // Filter candidates initially
     vertico_filter_candidates();
 }
@@ -83,6 +98,8 @@ void vertico_quit() {
     if (!vertico.is_active) return;
     
     vertico.is_active = false;
+    registerTextCallback(vertico.saved_text_callback);
+    vertico.saved_text_callback = NULL;
     
     // Restore the global keymap
     extern KeyChordMap keymap;
@@ -94,11 +111,15 @@ void vertico_quit() {
 void vertico_clear_candidates() {
     vertico.candidate_count = 0;
     vertico.filtered_count = 0;
+    vertico_filter_reset(&vertico.filter);
 }
 
 void vertico_add_candidate(const char* text, const char* annotation, void* data) {
     if (vertico.candidate_count >= VERTICO_MAX_CANDIDATES) return;
     
+    // Filtered levels don't know the new candidate
+    vertico_filter_reset(&vertico.filter);
+    
     VerticoCandidate* candidate = &vertico.candidates[vertico.candidate_count++];
     strncpy(candidate->text, text, sizeof(candidate->text) - 1);
     candidate->text[sizeof(candidate->text) - 1] = '\0';
@@ -114,88 +135,22 @@ void vertico_add_candidate(const char* text, const char* annotation, void* data)
     candidate->score = 0.0f;
 }
 
-float vertico_fuzzy_match(const char* pattern, const char* text) {
-    if (!pattern || !text) return 0.0f;
-    if (pattern[0] == '\0') return 1.0f; // Empty pattern matches everything
-    
-    // Convert both to lowercase for case-insensitive matching
-    char pattern_lower[256], text_lower[256];
-    strncpy(pattern_lower, pattern, sizeof(pattern_lower) - 1);
-    strncpy(text_lower, text, sizeof(text_lower) - 1);
-    pattern_lower[sizeof(pattern_lower) - 1] = '\0';
-    text_lower[sizeof(text_lower) - 1] = '\0';
-    
-    for (char* p = pattern_lower; *p; p++) *p = tolower(*p);
-    for (char* p = text_lower; *p; p++) *p = tolower(*p);
-    
-    // Split pattern into words
-    char* pattern_words[32];
-    int word_count = 0;
-    char* pattern_copy = strdup(pattern_lower);
-    char* token = strtok(pattern_copy, " ");
-    
-    while (token && word_count < 32) {
-        pattern_words[word_count++] = token;
-        token = strtok(NULL, " ");
-    }
-    
-    if (word_count == 0) {
-        free(pattern_copy);
-        return 1.0f;
-    }
-    
-    // Check if all words are present in text
-    float score = 1.0f;
-    int matches = 0;
-    
-    for (int i = 0; i < word_count; i++) {
-        if (strstr(text_lower, pattern_words[i]) != NULL) {
-            matches++;
-            // Bonus for earlier matches
-            char* pos = strstr(text_lower, pattern_words[i]);
-            float position_bonus = 1.0f - ((float)(pos - text_lower) / strlen(text_lower)) * 0.3f;
-            score += position_bonus;
-        }
-    }
-    
-    free(pattern_copy);
-    
-    // Only return non-zero score if all words matched
-    if (matches != word_count) return 0.0f;
-    
-    // Normalize score
-    return score / word_count;
-}
-
-// Compare function for qsort
-static int compare_candidates(const void* a, const void* b) {
-    const VerticoCandidate* ca = (const VerticoCandidate*)a;
-    const VerticoCandidate* cb = (const VerticoCandidate*)b;
-    
-    // Higher scores first
-    if (ca->score > cb->score) return -1;
-    if (ca->score < cb->score) return 1;
-    
-    // If scores are equal, sort alphabetically
-    return strcmp(ca->text, cb->text);
-}
-
+// Narrowing itself lives in vertico_filter.c, this copies the result out
 void vertico_filter_candidates() {
-    vertico.filtered_count = 0;
-    
-    // Filter and score candidates
-    for (size_t i = 0; i < vertico.candidate_count; i++) {
-        float score = vertico_fuzzy_match(vertico.input, vertico.candidates[i].text);
-        
-        if (score > 0.0f) {
-            vertico.filtered[vertico.filtered_count] = vertico.candidates[i];
-            vertico.filtered[vertico.filtered_count].score = score;
-            vertico.filtered_count++;
-        }
+    const VerticoFilterLevel* level = vertico_filter_narrow(&vertico.filter, vertico.input, vertico.input_length,
+                                                            vertico.candidates[0].text, sizeof(VerticoCandidate),
+                                                            vertico.candidate_count);
+    if (!level) {
+        vertico.filtered_count = 0;
+        return;
     }
     
-    // Sort by score
-    qsort(vertico.filtered, vertico.filtered_count, sizeof(VerticoCandidate), compare_candidates);
+    vertico.filtered_count = level->count;
+    for (size_t i = 0; i < level->count; i++) {
+        const VerticoMatch* match = &vertico.filter.matches[level->first + i];
+        vertico.filtered[i] = vertico.candidates[match->candidate];
+        vertico.filtered[i].score = match->score;
+    }
     
     // Reset selection if out of bounds
     if (vertico.selected_index >= (int)vertico.filtered_count) {
@@ -267,16 +222,26 @@ void vertico_select() {
 }
 
 void vertico_insert_char(char c) {
-    if (vertico.input_length < VERTICO_INPUT_BUFFER_SIZE - 1) {
-        vertico.input[vertico.input_length++] = c;
+    vertico_insert_codepoint((unsigned char)c);
+}
+
+void vertico_insert_codepoint(uint32_t codepoint) {
+    char bytes[UTF8_MAX_BYTES];
+    size_t length = utf8_encode(codepoint, bytes);
+    if (vertico.input_length + length < VERTICO_INPUT_BUFFER_SIZE) {
+        memcpy(vertico.input + vertico.input_length, bytes, length);
+        vertico.input_length += length;
         vertico.input[vertico.input_length] = '\0';
         vertico_filter_candidates();
     }
 }
 
+// Removes the last whole codepoint, not just its last byte
 void vertico_backspace() {
     if (vertico.input_length > 0) {
-        vertico.input[--vertico.input_length] = '\0';
+        const char* end = vertico.input + vertico.input_length;
+        vertico.input_length = utf8_prev(vertico.input, end) - vertico.input;
+        vertico.input[vertico.input_length] = '\0';
         vertico_filter_candidates();
     }
 }
@@ -287,74 +252,7 @@ void vertico_clear_input() {
     vertico_filter_candidates();
 }
 
-// Handle GLFW key input and convert to self-insert characters
-void vertico_handle_char_input(int key, int mods) {
-    char c = 0;
-    
-    // Letters A-Z
-    if (key >= KEY_A && key <= KEY_Z) {
-        if (mods & MOD_SHIFT) {
-            c = key; // Uppercase (A-Z)
-        } else {
-            c = key + 32; // Lowercase (a-z)
-        }
-    }
-    // Numbers 0-9
-    else if (key >= KEY_0 && key <= KEY_9) {
-        if (mods & MOD_SHIFT) {
-            // Shifted number keys produce symbols
-            const char shifted_nums[] = ")!@#$%^&*(";
-            c = shifted_nums[key - KEY_0];
-        } else {
-            c = key; // Regular digits
-        }
-    }
-    // Space
-    else if (key == KEY_SPACE) {
-        c = ' ';
-    }
-    // Punctuation and symbols
-    else if (key == KEY_MINUS) {
-        c = (mods & MOD_SHIFT) ? '_' : '-';
-    }
-    else if (key == KEY_EQUAL) {
-        c = (mods & MOD_SHIFT) ? '+' : '=';
-    }
-    else if (key == KEY_LEFT_BRACKET) {
-        c = (mods & MOD_SHIFT) ? '{' : '[';
-    }
-    else if (key == KEY_RIGHT_BRACKET) {
-        c = (mods & MOD_SHIFT) ? '}' : ']';
-    }
-    else if (key == KEY_BACKSLASH) {
-        c = (mods & MOD_SHIFT) ? '|' : '\\';
-    }
-    else if (key == KEY_SEMICOLON) {
-        c = (mods & MOD_SHIFT) ? ':' : ';';
-    }
-    else if (key == KEY_APOSTROPHE) {
-        c = (mods & MOD_SHIFT) ? '"' : '\'';
-    }
-    else if (key == KEY_COMMA) {
-        c = (mods & MOD_SHIFT) ? '<' : ',';
-    }
-    else if (key == KEY_PERIOD) {
-        c = (mods & MOD_SHIFT) ? '>' : '.';
-    }
-    else if (key == KEY_SLASH) {
-        c = (mods & MOD_SHIFT) ? '?' : '/';
-    }
-    else if (key == KEY_GRAVE_ACCENT) {
-        c = (mods & MOD_SHIFT) ? '~' : '`';
-    }
-    
-    // Insert the character if we got one
-    if (c != 0) {
-        vertico_insert_char(c);
-    }
-}
-
-
+#define GLYPH_BATCH 64  // Codepoints looked up in one font_get_characters() call
 
 static void render_text_with_highlights(Font* font, const char* inputText, float x, float y,
                                         const char* pattern, Color default_color) {
@@ -371,8 +269,8 @@ static void render_text_with_highlights(Font* font, const char* inputText, float
     text_lower[sizeof(text_lower) - 1] = '\0';
     pattern_lower[sizeof(pattern_lower) - 1] = '\0';
     
-    for (char* p = text_lower; *p; p++) *p = tolower(*p);
-    for (char* p = pattern_lower; *p; p++) *p = tolower(*p);
+    for (char* p = text_lower; *p; p++) *p = tolower((unsigned char)*p);
+    for (char* p = pattern_lower; *p; p++) *p = tolower((unsigned char)*p);
     
     // Split pattern into words
     char* pattern_words[4];  // Max 4 words for 4 different colors
@@ -423,33 +321,49 @@ static void render_text_with_highlights(Font* font, const char* inputText, float
         CT.orderless_match_face_3_bg
     };
     
-    // Render character by character with appropriate colors
+    // Render character by character with appropriate colors, the glyphs
+    // of each run of codepoints looked up together. Highlights are per byte,
+    // a codepoint takes the one of its first byte.
     float current_x = x;
-    for (size_t i = 0; inputText[i] != '\0'; i++) {
-        float char_width = character_width(font, inputText[i]);
+    uint32_t codepoints[GLYPH_BATCH];
+    size_t offsets[GLYPH_BATCH];
+    Character* chars[GLYPH_BATCH];
+    const char* p = inputText;
+    const char* end = inputText + strlen(inputText);
+    while (p < end) {
+        size_t count = 0;
+        while (count < GLYPH_BATCH && p < end) {
+            offsets[count] = p - inputText;
+            codepoints[count++] = utf8_decode(&p, end);
+        }
+        font_get_characters(font, codepoints, count, chars);
         
-        if (highlight[i] > 0) {
-            int color_idx = highlight[i] - 1;
-            
-            // STEP 1 FIX: Background highlight height
-            // descent is negative, so ascent + descent gives correct height
-            float bg_height = font->ascent + font->descent;
-            float bg_y = y + font->descent;
+        for (size_t j = 0; j < count; j++) {
+            // Bytes past the lowercased copy are never highlighted
+            int h = offsets[j] < sizeof(text_lower) - 1 ? highlight[offsets[j]] : 0;
+            float char_width = chars[j] ? chars[j]->ax : 0.0f;
             
-            quad2D((vec2){current_x, bg_y},
-                   (vec2){char_width, bg_height},
-                   match_colors_bg[color_idx]);
+            if (h > 0) {
+                int color_idx = h - 1;
+                
+                // STEP 1 FIX: Background highlight height
+                // descent is negative, so ascent + descent gives correct height
+                float bg_height = font->ascent + font->descent;
+                float bg_y = y + font->descent;
+                
+                quad2D((vec2){current_x, bg_y},
+                       (vec2){char_width, bg_height},
+                       match_colors_bg[color_idx]);
+                
+                // Draw character with highlight foreground color
+                character(font, codepoints[j], current_x, y, match_colors_fg[color_idx]);
+            } else {
+                // Draw character normally
+                character(font, codepoints[j], current_x, y, default_color);
+            }
             
-            // Draw character with highlight foreground color
-            char single_char[2] = {inputText[i], '\0'};
-            text(font, single_char, current_x, y, match_colors_fg[color_idx]);
-        } else {
-            // Draw character normally
-            char single_char[2] = {inputText[i], '\0'};
-            text(font, single_char, current_x, y, default_color);
+            current_x += char_width;
         }
-        
-        current_x += char_width;
     }
 }
 
@@ -483,6 +397,10 @@ void vertico_render() {
         box_y = 0.0f;
     }
     
+    // Over other panels, and long candidates never spill out of the box
+    uint32_t previous_z = renderer2D_set_z(VERTICO_Z);
+    renderer2D_push_clip(0.0f, box_y, screen_width, total_height);
+    
     // Background - cover the entire vertico area
     quad2D((vec2){0.0f, box_y}, (vec2){screen_width, total_height}, CT.bg);
     
@@ -512,20 +430,14 @@ void vertico_render() {
     text(vertico.font, header, padding, current_y, CT.keyword);
     
     // Calculate input position
-    float header_width = 0.0f;
-    for (const char* p = header; *p; p++) {
-        header_width += character_width(vertico.font, *p);
-    }
+    float header_width = text_width(vertico.font, header);
     
     // Render input text
     float input_x = padding + header_width;
     text(vertico.font, vertico.input, input_x, current_y, CT.text);
     
     // Cursor - should be on the same line as header/input
-    float cursor_x = input_x;
-    for (size_t i = 0; i < vertico.input_length; i++) {
-        cursor_x += character_width(vertico.font, vertico.input[i]);
-    }
+    float cursor_x = input_x + text_caret_x(vertico.font, vertico.input, vertico.input_length);
     
     float cursor_width = character_width(vertico.font, ' ');
     float cursor_height = line_height;
@@ -564,10 +476,7 @@ void vertico_render() {
         
         // Render annotation
         if (candidate->annotation[0] != '\0') {
-            float annotation_width = 0.0f;
-            for (const char* p = candidate->annotation; *p; p++) {
-                annotation_width += character_width(vertico.font, *p);
-            }
+            float annotation_width = text_width(vertico.font, candidate->annotation);
             float annotation_x = screen_width - annotation_width - padding;
             text(vertico.font, candidate->annotation, annotation_x, current_y, CT.comment);
         }
@@ -575,6 +484,9 @@ void vertico_render() {
         // Move DOWN to next line
         current_y -= line_height;
     }
+    
+    renderer2D_pop_clip();
+    renderer2D_set_z(previous_z);
 }
 
 static void keybinding_selected(void* data) {
@@ -4,9 +4,10 @@
 #include "keychords.h"
 #include "renderer.h"
 #include "font.h"
+#include "vertico_filter.h"
 
 #define VERTICO_MAX_CANDIDATES 1024
-#define VERTICO_INPUT_BUFFER_SIZE 256
+#define VERTICO_Z 1000  // 2D z layer, above ordinary panels
 
 typedef struct {
     char text[256];       // Display text
@@ -24,6 +25,8 @@ typedef struct {
     VerticoCandidate filtered[VERTICO_MAX_CANDIDATES];
     size_t filtered_count;
     
+    VerticoFilter filter;  // Matches per input prefix, see vertico_filter.h
+    
     char input[VERTICO_INPUT_BUFFER_SIZE];
     size_t input_length;
     
@@ -35,6 +38,7 @@ typedef struct {
     
     KeyChordMap* saved_keymap;  // Store the previous keymap
     KeyChordMap vertico_keymap; // Vertico-specific keymap
+    TextCallback saved_text_callback;  // Typed text goes to the input while active
     
     char category[128];         // Category name (e.g., "keymap", "meshes")
     
@@ -65,13 +69,12 @@ void vertico_last();
 
 // Input handling
 void vertico_insert_char(char c);
+void vertico_insert_codepoint(uint32_t codepoint);  // Stored UTF-8 encoded
 void vertico_backspace();
 void vertico_clear_input();
-void vertico_handle_char_input(int key, int mods);
 
 // Rendering
 void vertico_render();
 
 // Utility
-float vertico_fuzzy_match(const char* pattern, const char* text);
 void vertico_show_keybindings();
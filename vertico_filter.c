@@ -0,0 +1,151 @@
+#include "vertico_filter.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+float vertico_fuzzy_match(const char* pattern, const char* text) {
+    if (!pattern || !text) return 0.0f;
+    if (pattern[0] == '\0') return 1.0f; // Empty pattern matches everything
+
+    // Convert both to lowercase for case-insensitive matching
+    char pattern_lower[256], text_lower[256];
+    strncpy(pattern_lower, pattern, sizeof(pattern_lower) - 1);
+    strncpy(text_lower, text, sizeof(text_lower) - 1);
+    pattern_lower[sizeof(pattern_lower) - 1] = '\0';
+    text_lower[sizeof(text_lower) - 1] = '\0';
+
+    for (char* p = pattern_lower; *p; p++) *p = tolower((unsigned char)*p);
+    for (char* p = text_lower; *p; p++) *p = tolower((unsigned char)*p);
+
+    // Split pattern into words
+    char* pattern_words[32];
+    int word_count = 0;
+    char* pattern_copy = strdup(pattern_lower);
+    char* token = strtok(pattern_copy, " ");
+
+    while (token && word_count < 32) {
+        pattern_words[word_count++] = token;
+        token = strtok(NULL, " ");
+    }
+
+    if (word_count == 0) {
+        free(pattern_copy);
+        return 1.0f;
+    }
+
+    // Check if all words are present in text
+    float score = 1.0f;
+    int matches = 0;
+
+    for (int i = 0; i < word_count; i++) {
+        if (strstr(text_lower, pattern_words[i]) != NULL) {
+            matches++;
+            // Bonus for earlier matches
+            char* pos = strstr(text_lower, pattern_words[i]);
+            float position_bonus = 1.0f - ((float)(pos - text_lower) / strlen(text_lower)) * 0.3f;
+            score += position_bonus;
+        }
+    }
+
+    free(pattern_copy);
+
+    // Only return non-zero score if all words matched
+    if (matches != word_count) return 0.0f;
+
+    // Normalize score
+    return score / word_count;
+}
+
+// qsort has no context argument, the texts being sorted go through here
+static const char* sort_texts;
+static size_t sort_stride;
+
+// Compare function for qsort, levels are kept in display order
+static int compare_matches(const void* a, const void* b) {
+    const VerticoMatch* ma = (const VerticoMatch*)a;
+    const VerticoMatch* mb = (const VerticoMatch*)b;
+
+    // Higher scores first
+    if (ma->score > mb->score) return -1;
+    if (ma->score < mb->score) return 1;
+
+    // If scores are equal, sort alphabetically
+    return strcmp(sort_texts + ma->candidate * sort_stride, sort_texts + mb->candidate * sort_stride);
+}
+
+static bool reserve_matches(VerticoFilter* filter, size_t count) {
+    if (filter->matches && count <= filter->match_capacity) return true;
+
+    size_t capacity = filter->match_capacity ? filter->match_capacity * 2 : 256;
+    while (capacity < count) capacity *= 2;
+
+    VerticoMatch* matches = realloc(filter->matches, capacity * sizeof(VerticoMatch));
+    if (!matches) {
+        fprintf(stderr, "Memory allocation failed for vertico matches\n");
+        return false;
+    }
+    filter->matches = matches;
+    filter->match_capacity = capacity;
+    return true;
+}
+
+// Every space separated word of the input must be a substring of a match,
+// so whatever matches an input also matched each of its prefixes. Only the
+// survivors of the longest filtered prefix are rescored, and going back to
+// a prefix (backspace) reuses its level as it is.
+const VerticoFilterLevel* vertico_filter_narrow(VerticoFilter* filter, const char* input, size_t input_length,
+                                                const char* texts, size_t stride, size_t candidate_count) {
+    if (input_length >= VERTICO_INPUT_BUFFER_SIZE) input_length = VERTICO_INPUT_BUFFER_SIZE - 1;
+
+    // Levels past what the input still shares with level_input are stale
+    size_t common = 0;
+    while (common < input_length && filter->level_input[common] == input[common]) {
+        common++;
+    }
+    while (filter->level_count > 0 && filter->levels[filter->level_count - 1].input_length > common) {
+        filter->level_count--;
+    }
+    memcpy(filter->level_input, input, input_length);
+    filter->level_input[input_length] = '\0';
+
+    VerticoFilterLevel* below = filter->level_count > 0 ? &filter->levels[filter->level_count - 1] : NULL;
+    if (!below || below->input_length != input_length) {
+        // Narrow the level below, or scan everything when there's none
+        size_t first = below ? below->first + below->count : 0;
+        size_t source = below ? below->count : candidate_count;
+        if (!reserve_matches(filter, first + source)) {
+            filter->level_count = 0;
+            return NULL;
+        }
+
+        VerticoMatch* matches = filter->matches + first;
+        size_t count = 0;
+        for (size_t i = 0; i < source; i++) {
+            uint32_t candidate = below ? filter->matches[below->first + i].candidate : (uint32_t)i;
+            float score = vertico_fuzzy_match(filter->level_input, texts + candidate * stride);
+            if (score > 0.0f) {
+                matches[count++] = (VerticoMatch){candidate, score};
+            }
+        }
+
+        // Sort by score
+        sort_texts = texts;
+        sort_stride = stride;
+        qsort(matches, count, sizeof(VerticoMatch), compare_matches);
+        filter->levels[filter->level_count++] = (VerticoFilterLevel){input_length, first, count};
+    }
+
+    return &filter->levels[filter->level_count - 1];
+}
+
+void vertico_filter_reset(VerticoFilter* filter) {
+    filter->level_count = 0;
+}
+
+void vertico_filter_free(VerticoFilter* filter) {
+    free(filter->matches);
+    filter->matches = NULL;
+    filter->match_capacity = 0;
+    filter->level_count = 0;
+}
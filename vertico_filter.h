@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Candidate filtering for vertico, kept apart from the window and renderer
+// so it can be checked against a full rescan on its own.
+
+#define VERTICO_INPUT_BUFFER_SIZE 256
+
+typedef struct {
+    uint32_t candidate;   // Index into candidates
+    float score;
+} VerticoMatch;
+
+// Candidates matching the first input_length bytes of the input, sorted
+typedef struct {
+    size_t input_length;
+    size_t first;         // Into matches
+    size_t count;
+} VerticoFilterLevel;
+
+// Incremental narrowing, one level per input prefix filtered so far.
+// Each level only rescans the one below it, backspace pops back to one.
+typedef struct {
+    VerticoFilterLevel levels[VERTICO_INPUT_BUFFER_SIZE];
+    size_t level_count;
+    char level_input[VERTICO_INPUT_BUFFER_SIZE];  // Input the levels are prefixes of
+    VerticoMatch* matches;                         // Every level's matches, bottom up
+    size_t match_capacity;
+} VerticoFilter;
+
+// Matches of input among candidate_count texts, stride bytes apart, in
+// display order: higher scores first, then alphabetical. Points into the
+// filter and stays valid until the next call. NULL when out of memory.
+const VerticoFilterLevel* vertico_filter_narrow(VerticoFilter* filter, const char* input, size_t input_length,
+                                                const char* texts, size_t stride, size_t candidate_count);
+
+// Drop every level, needed whenever the candidates change
+void vertico_filter_reset(VerticoFilter* filter);
+void vertico_filter_free(VerticoFilter* filter);
+
+// Nonzero when every space separated word of pattern is a case-insensitive
+// substring of text, higher for earlier matches
+float vertico_fuzzy_match(const char* pattern, const char* text);
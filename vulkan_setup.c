@@ -3,6 +3,11 @@
 #include "context.h"
 #include "window.h"
 #include "scene.h"
+#include "capture.h"
+#include "meshlet.h"
+#include "mesh_optimize.h"
+#include "occlusion.h"
+#include "font.h"
 #include <vulkan/vulkan_core.h>
 #include <cglm/types.h>
 #include <stdio.h>
@@ -15,6 +20,7 @@
 #include "2D.frag.spv.h"
 #include "texture.frag.spv.h"
 #include "texture3D.frag.spv.h"
+#include "packed.vert.spv.h"
 
 
 #define ENABLE_VALIDATION_LAYERS 1
@@ -31,12 +37,26 @@ const char** validationLayers = NULL;
 
 
 bool ambientOcclusionEnabled = true;
+bool depthPrepassEnabled = false;
+bool overdrawStatsEnabled = false;
+static bool overdrawQueryIssued[MAX_FRAMES_IN_FLIGHT];  // Query recorded for that frame in flight
 
 VkDescriptorPool descriptorPool;
 VkDescriptorSet descriptorSet;
 
 VkBuffer uniformBuffer;
 VkDeviceMemory uniformBufferMemory;
+VkDeviceSize uniformBufferStride;
+uint32_t uniformDynamicOffset = 0;
+static void *uniformBufferMapped = NULL;
+
+Lighting lighting = {
+    .sunDirection = {0.3f, 0.8f, 0.5f},
+    .sunColor     = {1.0f, 0.95f, 0.8f},
+    .skyColor     = {0.3f, 0.5f, 0.7f},
+    .groundColor  = {0.2f, 0.15f, 0.1f},
+    .fogDensity   = 0.01f,
+};
 
 
 int lineWidth = 2.0f;
@@ -67,14 +87,14 @@ void create2DDescriptorSetLayout(VulkanContext* context) {
 void create2DDescriptorPool(VulkanContext* context) {
     VkDescriptorPoolSize poolSize = {
         .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-        .descriptorCount = MAX_TEXTURES  // Allow for maximum textures
+        .descriptorCount = MAX_TEXTURES + SPRITE_ATLAS_MAX_PAGES  // Allow for maximum textures
     };
 
     VkDescriptorPoolCreateInfo poolInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         .poolSizeCount = 1,
         .pPoolSizes = &poolSize,
-        .maxSets = MAX_TEXTURES  // Allow for maximum sets
+        .maxSets = MAX_TEXTURES + SPRITE_ATLAS_MAX_PAGES  // Allow for maximum sets
     };
 
     if (vkCreateDescriptorPool(context->device, &poolInfo, NULL, &context->descriptorPool2D) != VK_SUCCESS) {
@@ -96,7 +116,7 @@ void createDescriptorSet(VulkanContext* context) {
     VkDescriptorBufferInfo bufferInfo = {
         .buffer = uniformBuffer,
         .offset = 0,
-        .range = sizeof(UniformBufferObject)
+        .range = sizeof(UniformBufferObject) // One frame region, selected by the dynamic offset
     };
 
     VkWriteDescriptorSet descriptorWrite = {
@@ -104,7 +124,7 @@ void createDescriptorSet(VulkanContext* context) {
         .dstSet = descriptorSet,
         .dstBinding = 0,
         .dstArrayElement = 0,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1,
         .pBufferInfo = &bufferInfo
     };
@@ -114,7 +134,7 @@ void createDescriptorSet(VulkanContext* context) {
 
 void createDescriptorPool(VulkanContext* context) {
     VkDescriptorPoolSize poolSize = {
-        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1
     };
 
@@ -255,8 +275,12 @@ void createLogicalDevice(VulkanContext* context) {
 
 
     /* VkPhysicalDeviceFeatures deviceFeatures = {0}; */
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(context->physicalDevice, &supportedFeatures);
+    
     VkPhysicalDeviceFeatures deviceFeatures = {
-        .wideLines = VK_TRUE
+        .wideLines = VK_TRUE,
+        .pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery  // Overdraw stats
     };
     
     VkDeviceCreateInfo createInfo = {
@@ -312,7 +336,7 @@ void createSwapChain(VulkanContext* context) {
         .imageColorSpace = surfaceFormat.colorSpace,
         .imageExtent = extent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, // TRANSFER_SRC for capture
         .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .preTransform = capabilities.currentTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
@@ -434,6 +458,222 @@ void createRenderPass(VulkanContext* context) {
     }
 }
 
+typedef struct {
+    VkBool32 unlit;
+    VkBool32 alphaMask;
+    VkBool32 ambientOcclusion;
+    VkBool32 sdf;              // Texture alpha is a glyph distance field
+} PipelineVariantConstants;
+
+static const VkSpecializationMapEntry pipelineVariantEntries[4] = {
+    {.constantID = 0, .offset = offsetof(PipelineVariantConstants, unlit),            .size = sizeof(VkBool32)},
+    {.constantID = 1, .offset = offsetof(PipelineVariantConstants, alphaMask),        .size = sizeof(VkBool32)},
+    {.constantID = 2, .offset = offsetof(PipelineVariantConstants, ambientOcclusion), .size = sizeof(VkBool32)},
+    {.constantID = 3, .offset = offsetof(PipelineVariantConstants, sdf),              .size = sizeof(VkBool32)},
+};
+
+// Whether a draw can ever ask for variant v. getPipelineVariant() only adds
+// AO to lit variants and mesh() drops ALPHA_MASK when it sets DEPTH_EQUAL,
+// the depth pre-pass only looks at the bits getDepthPrepassPipeline() keeps.
+static bool pipelineVariantReachable(uint32_t v, bool depthOnly) {
+    if (depthOnly) {
+        return !(v & ~(PIPELINE_VARIANT_ALPHA_MASK | PIPELINE_VARIANT_CULL_BACK | PIPELINE_VARIANT_PACKED));
+    }
+    if ((v & PIPELINE_VARIANT_UNLIT) && (v & PIPELINE_VARIANT_AO)) return false;
+    if ((v & PIPELINE_VARIANT_DEPTH_EQUAL) && (v & PIPELINE_VARIANT_ALPHA_MASK)) return false;
+    return true;
+}
+
+// Build every reachable PIPELINE_VARIANT_* combination of a vertex + fragment
+// pipeline in one call. The fragment stage gets the variant as specialization
+// constants so the unlit/mask/AO branches are compiled out of the shader,
+// cull mode and depth compare are patched into copies of the base state.
+//
+// PACKED variants swap in packedVertShaderModule (packed.vert) and the
+// PackedVertex input layout.
+//
+// depthOnly builds the depth pre-pass flavour instead: color writes off and
+// no fragment stage at all unless the variant has to discard for ALPHA_MASK.
+// Unreachable variants stay VK_NULL_HANDLE.
+static void createPipelineVariants(VulkanContext* context, const VkGraphicsPipelineCreateInfo* base,
+                                   VkShaderModule packedVertShaderModule, VkPipeline* pipelines,
+                                   bool depthOnly) {
+    VkPipelineShaderStageCreateInfo packedVertStage = base->pStages[0];
+    packedVertStage.module = packedVertShaderModule;
+    
+    VkVertexInputBindingDescription packedBinding = {
+        .binding = 0,
+        .stride = sizeof(PackedVertex),
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+    };
+    
+    VkVertexInputAttributeDescription packedAttributes[3] = {
+        {.binding = 0,
+         .location = 0,
+         .format = VK_FORMAT_R16G16B16A16_UNORM,
+         .offset = offsetof(PackedVertex, pos)},
+        {.binding = 0,
+         .location = 1,
+         .format = VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+         .offset = offsetof(PackedVertex, normal)},
+        {.binding = 0,
+         .location = 2,
+         .format = VK_FORMAT_R16G16_SFLOAT,
+         .offset = offsetof(PackedVertex, texCoord)}
+    };
+    
+    VkPipelineVertexInputStateCreateInfo packedVertexInput = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &packedBinding,
+        .vertexAttributeDescriptionCount = 3,
+        .pVertexAttributeDescriptions = packedAttributes
+    };
+    
+    VkGraphicsPipelineCreateInfo pipelineInfos[PIPELINE_VARIANT_COUNT];
+    VkPipelineShaderStageCreateInfo stages[PIPELINE_VARIANT_COUNT][2];
+    PipelineVariantConstants constants[PIPELINE_VARIANT_COUNT];
+    VkSpecializationInfo specializationInfos[PIPELINE_VARIANT_COUNT];
+    VkPipelineRasterizationStateCreateInfo rasterizers[PIPELINE_VARIANT_COUNT];
+    VkPipelineDepthStencilStateCreateInfo depthStencils[PIPELINE_VARIANT_COUNT];
+    uint32_t variantOf[PIPELINE_VARIANT_COUNT];
+    uint32_t count = 0;
+    
+    VkPipelineColorBlendAttachmentState noColorAttachment = {
+        .colorWriteMask = 0,
+        .blendEnable = VK_FALSE,
+    };
+    VkPipelineColorBlendStateCreateInfo noColorBlending = *base->pColorBlendState;
+    noColorBlending.pAttachments = &noColorAttachment;
+    
+    for (uint32_t v = 0; v < PIPELINE_VARIANT_COUNT; v++) {
+        pipelines[v] = VK_NULL_HANDLE;
+        if (!pipelineVariantReachable(v, depthOnly)) continue;
+        
+        uint32_t i = count++;
+        variantOf[i] = v;
+        
+        constants[i] = (PipelineVariantConstants){
+            .unlit            = (v & PIPELINE_VARIANT_UNLIT) ? VK_TRUE : VK_FALSE,
+            .alphaMask        = (v & PIPELINE_VARIANT_ALPHA_MASK) ? VK_TRUE : VK_FALSE,
+            .ambientOcclusion = (v & PIPELINE_VARIANT_AO) ? VK_TRUE : VK_FALSE,
+        };
+        
+        specializationInfos[i] = (VkSpecializationInfo){
+            .mapEntryCount = 4,
+            .pMapEntries = pipelineVariantEntries,
+            .dataSize = sizeof(PipelineVariantConstants),
+            .pData = &constants[i],
+        };
+        
+        stages[i][0] = (v & PIPELINE_VARIANT_PACKED) ? packedVertStage : base->pStages[0];
+        stages[i][1] = base->pStages[1];
+        stages[i][1].pSpecializationInfo = &specializationInfos[i];
+        
+        rasterizers[i] = *base->pRasterizationState;
+        rasterizers[i].cullMode = (v & PIPELINE_VARIANT_CULL_BACK) ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE;
+        
+        depthStencils[i] = *base->pDepthStencilState;
+        if (v & PIPELINE_VARIANT_DEPTH_EQUAL) {
+            // Depth was resolved by the pre-pass, only shade the visible surface
+            depthStencils[i].depthCompareOp = VK_COMPARE_OP_EQUAL;
+            depthStencils[i].depthWriteEnable = VK_FALSE;
+        }
+        
+        pipelineInfos[i] = *base;
+        pipelineInfos[i].pStages = stages[i];
+        pipelineInfos[i].pRasterizationState = &rasterizers[i];
+        pipelineInfos[i].pDepthStencilState = &depthStencils[i];
+        if (v & PIPELINE_VARIANT_PACKED) pipelineInfos[i].pVertexInputState = &packedVertexInput;
+        
+        if (depthOnly) {
+            pipelineInfos[i].pColorBlendState = &noColorBlending;
+            pipelineInfos[i].stageCount = (v & PIPELINE_VARIANT_ALPHA_MASK) ? 2 : 1;
+        }
+    }
+    
+    VkPipeline created[PIPELINE_VARIANT_COUNT];
+    if (vkCreateGraphicsPipelines(context->device, VK_NULL_HANDLE, count,
+                                  pipelineInfos, NULL, created) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create graphics pipeline variants\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        pipelines[variantOf[i]] = created[i];
+    }
+}
+
+// packed.vert, shared by the color and depth pre-pass variants of a layout
+static VkShaderModule createPackedVertShaderModule(VulkanContext* context) {
+    VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = sizeof(packed_vert_spv),
+        .pCode = (const uint32_t*)packed_vert_spv
+    };
+    
+    VkShaderModule packedVertShaderModule;
+    if (vkCreateShaderModule(context->device, &createInfo, NULL, &packedVertShaderModule) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create packed vertex shader module\n");
+        exit(EXIT_FAILURE);
+    }
+    return packedVertShaderModule;
+}
+
+// Copy of base whose fragment stage is specialized for SDF glyphs. Shaders
+// without the SDF constant ignore it.
+static VkPipeline createSDFPipeline(VulkanContext* context, const VkGraphicsPipelineCreateInfo* base,
+                                    bool ambientOcclusion) {
+    PipelineVariantConstants constants = {
+        .unlit = VK_FALSE,
+        .alphaMask = VK_FALSE,
+        .ambientOcclusion = ambientOcclusion ? VK_TRUE : VK_FALSE,
+        .sdf = VK_TRUE,
+    };
+    VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = 4,
+        .pMapEntries = pipelineVariantEntries,
+        .dataSize = sizeof(PipelineVariantConstants),
+        .pData = &constants,
+    };
+    
+    VkPipelineShaderStageCreateInfo stages[2] = {base->pStages[0], base->pStages[1]};
+    stages[1].pSpecializationInfo = &specializationInfo;
+    
+    VkGraphicsPipelineCreateInfo pipelineInfo = *base;
+    pipelineInfo.pStages = stages;
+    
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(context->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create SDF text pipeline\n");
+        exit(EXIT_FAILURE);
+    }
+    return pipeline;
+}
+
+// Pick the color pass variant for a draw, AO follows the global toggle
+VkPipeline getPipelineVariant(bool textured, uint32_t variant) {
+    if (ambientOcclusionEnabled && !(variant & PIPELINE_VARIANT_UNLIT)) {
+        variant |= PIPELINE_VARIANT_AO;
+    }
+    
+    return textured ? context.graphicsPipelineTextured3DVariants[variant]
+                    : context.graphicsPipelineVariants[variant];
+}
+
+// text3D() with an SDF font, lit like variant 0
+VkPipeline getSDFTextPipeline3D(void) {
+    return context.graphicsPipelineTextured3DSDF[ambientOcclusionEnabled ? 1 : 0];
+}
+
+// Only alpha mask, culling and the vertex layout matter for depth
+VkPipeline getDepthPrepassPipeline(bool textured, uint32_t variant) {
+    variant &= PIPELINE_VARIANT_ALPHA_MASK | PIPELINE_VARIANT_CULL_BACK | PIPELINE_VARIANT_PACKED;
+    
+    return textured ? context.depthPrepassTextured3DVariants[variant]
+                    : context.depthPrepassPipelineVariants[variant];
+}
+
 void createTextured2DGraphicsPipeline(VulkanContext* context) {
     // Load shaders from header files
     VkShaderModule vertShaderModule2D;
@@ -483,17 +723,17 @@ void createTextured2DGraphicsPipeline(VulkanContext* context) {
     
     VkPipelineShaderStageCreateInfo shaderStagesTextured[] = {vertShaderStageInfo2D, fragShaderStageInfoTextured};
     
-    // 2D vertex input (same as regular 2D)
+    // 2D instance input (same as regular 2D), one Quad2D per instance
     VkVertexInputBindingDescription bindingDescription2D = {
         .binding = 0,
-        .stride = sizeof(Vertex2D),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        .stride = sizeof(Quad2D),
+        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
     };
     
     VkVertexInputAttributeDescription attributeDescriptions2D[3] = {
-        {.binding = 0, .location = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex2D, pos)},
-        {.binding = 0, .location = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(Vertex2D, color)},
-        {.binding = 0, .location = 2, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex2D, texCoord)}
+        {.binding = 0, .location = 0, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(Quad2D, rect)},
+        {.binding = 0, .location = 1, .format = VK_FORMAT_R16G16B16A16_UNORM, .offset = offsetof(Quad2D, uv)},
+        {.binding = 0, .location = 2, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(Quad2D, color)}
     };
     
     VkPipelineVertexInputStateCreateInfo vertexInputInfo2D = {
@@ -575,6 +815,7 @@ void createTextured2DGraphicsPipeline(VulkanContext* context) {
         .pAttachments = &colorBlendAttachment
     };
     
+    // Disable depth testing for 2D, z layers are drawn in order instead
     VkPipelineDepthStencilStateCreateInfo depthStencil2D = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .depthTestEnable = VK_FALSE,
@@ -625,6 +866,7 @@ void createTextured2DGraphicsPipeline(VulkanContext* context) {
         fprintf(stderr, "Failed to create textured 2D graphics pipeline\n");
         exit(EXIT_FAILURE);
     }
+    context->graphicsPipelineTextured2DSDF = createSDFPipeline(context, &pipelineInfoTextured2D, false);
     
     vkDestroyShaderModule(context->device, fragShaderModuleTextured, NULL);
     vkDestroyShaderModule(context->device, vertShaderModule2D, NULL);
@@ -679,17 +921,17 @@ void create2DGraphicsPipeline(VulkanContext* context) {
     
     VkPipelineShaderStageCreateInfo shaderStages2D[] = {vertShaderStageInfo2D, fragShaderStageInfo2D};
     
-    // 2D vertex input
+    // 2D instance input, one Quad2D per instance expanded by 2D.vert
     VkVertexInputBindingDescription bindingDescription2D = {
         .binding = 0,
-        .stride = sizeof(Vertex2D),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        .stride = sizeof(Quad2D),
+        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
     };
     
     VkVertexInputAttributeDescription attributeDescriptions2D[3] = {
-        {.binding = 0, .location = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex2D, pos)},
-        {.binding = 0, .location = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(Vertex2D, color)},
-        {.binding = 0, .location = 2, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex2D, texCoord)}
+        {.binding = 0, .location = 0, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(Quad2D, rect)},
+        {.binding = 0, .location = 1, .format = VK_FORMAT_R16G16B16A16_UNORM, .offset = offsetof(Quad2D, uv)},
+        {.binding = 0, .location = 2, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(Quad2D, color)}
     };
     
     VkPipelineVertexInputStateCreateInfo vertexInputInfo2D = {
@@ -767,7 +1009,7 @@ void create2DGraphicsPipeline(VulkanContext* context) {
         .pAttachments = &colorBlendAttachment
     };
     
-    // Disable depth testing for 2D
+    // Disable depth testing for 2D, z layers are drawn in order instead
     VkPipelineDepthStencilStateCreateInfo depthStencil2D = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .depthTestEnable = VK_FALSE,
@@ -1006,10 +1248,15 @@ void create3DTexturedGraphicsPipeline(VulkanContext* context) {
         .pDepthStencilState = &depthStencil,
     };
     
-    if (vkCreateGraphicsPipelines(context->device, VK_NULL_HANDLE, 1, &pipelineInfoTextured3D, NULL, &context->graphicsPipelineTextured3D) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create 3D textured graphics pipeline\n");
-        exit(EXIT_FAILURE);
-    }
+    VkShaderModule packedVertShaderModule = createPackedVertShaderModule(context);
+    createPipelineVariants(context, &pipelineInfoTextured3D, packedVertShaderModule,
+                           context->graphicsPipelineTextured3DVariants, false);
+    createPipelineVariants(context, &pipelineInfoTextured3D, packedVertShaderModule,
+                           context->depthPrepassTextured3DVariants, true);
+    vkDestroyShaderModule(context->device, packedVertShaderModule, NULL);
+    context->graphicsPipelineTextured3D = context->graphicsPipelineTextured3DVariants[PIPELINE_VARIANT_AO];
+    context->graphicsPipelineTextured3DSDF[0] = createSDFPipeline(context, &pipelineInfoTextured3D, false);
+    context->graphicsPipelineTextured3DSDF[1] = createSDFPipeline(context, &pipelineInfoTextured3D, true);
     
     vkDestroyShaderModule(context->device, fragShaderModuleTextured, NULL);
     vkDestroyShaderModule(context->device, vertShaderModule, NULL);
@@ -1416,10 +1663,13 @@ void createGraphicsPipeline(VulkanContext* context) {
         .pDepthStencilState = &depthStencil,
     };
     
-    if (vkCreateGraphicsPipelines(context->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &context->graphicsPipeline) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create graphics pipeline\n");
-        exit(EXIT_FAILURE);
-    }
+    VkShaderModule packedVertShaderModule = createPackedVertShaderModule(context);
+    createPipelineVariants(context, &pipelineInfo, packedVertShaderModule,
+                           context->graphicsPipelineVariants, false);
+    createPipelineVariants(context, &pipelineInfo, packedVertShaderModule,
+                           context->depthPrepassPipelineVariants, true);
+    vkDestroyShaderModule(context->device, packedVertShaderModule, NULL);
+    context->graphicsPipeline = context->graphicsPipelineVariants[PIPELINE_VARIANT_AO];
     
     // Clean up shader modules
     vkDestroyShaderModule(context->device, fragShaderModule, NULL);
@@ -1515,7 +1765,7 @@ void createCommandBuffers(VulkanContext* context) {
         
         
         vkCmdBindPipeline(context->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
-        vkCmdBindDescriptorSets(context->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, context->pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+        vkCmdBindDescriptorSets(context->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, context->pipelineLayout, 0, 1, &descriptorSet, 1, &uniformDynamicOffset);
         
         renderer_draw(context->commandBuffers[i]);
         
@@ -1695,8 +1945,20 @@ void drawFrame(VulkanContext* context) {
 
 
 
+// One buffer holds a UniformBufferObject region per frame in flight, each
+// aligned to minUniformBufferOffsetAlignment and selected with a dynamic
+// offset, so writing frame N never touches data frame N-1 is still reading.
 void createUniformBuffer(VulkanContext* context) {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    
+    uniformBufferStride = sizeof(UniformBufferObject);
+    if (alignment > 0) {
+        uniformBufferStride = (uniformBufferStride + alignment - 1) & ~(alignment - 1);
+    }
+    
+    VkDeviceSize bufferSize = uniformBufferStride * MAX_FRAMES_IN_FLIGHT;
     
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -1721,14 +1983,24 @@ void createUniformBuffer(VulkanContext* context) {
     
     vkAllocateMemory(context->device, &allocInfo, NULL, &uniformBufferMemory);
     vkBindBufferMemory(context->device, uniformBuffer, uniformBufferMemory, 0);
+    
+    // Persistently mapped, the memory is coherent so no flushes are needed
+    vkMapMemory(context->device, uniformBufferMemory, 0, bufferSize, 0, &uniformBufferMapped);
+}
+
+// Must only be called after inFlightFences[frameIndex] has been waited on
+void updateUniformBuffer(uint32_t frameIndex, const UniformBufferObject* ubo) {
+    VkDeviceSize offset = uniformBufferStride * frameIndex;
+    memcpy((char*)uniformBufferMapped + offset, ubo, sizeof(UniformBufferObject));
+    uniformDynamicOffset = (uint32_t)offset;
 }
 
 void createDescriptorSetLayout(VulkanContext* context) {
     VkDescriptorSetLayoutBinding uboLayoutBinding = {
         .binding = 0,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1,
-        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
         .pImmutableSamplers = NULL
     };
     
@@ -1755,6 +2027,16 @@ void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex) {
 
     vkBeginCommandBuffer(cmd, &beginInfo);
 
+    uint32_t frameIndex = context->currentFrame;
+    
+    // New glyphs, copied before the render pass samples the atlases
+    fonts_record_uploads(cmd, frameIndex);
+    bool overdrawQueryActive = overdrawStatsEnabled && context->overdrawQueryPool;
+    overdrawQueryIssued[frameIndex] = overdrawQueryActive;
+    if (overdrawQueryActive) {
+        vkCmdResetQueryPool(cmd, context->overdrawQueryPool, frameIndex, 1);
+    }
+
     /* VkClearValue clearValues[2]; */
     /* clearValues[0].color = (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}}; */
     /* clearValues[1].depthStencil = (VkClearDepthStencilValue){1.0f, 0}; */
@@ -1781,17 +2063,27 @@ void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex) {
 
     vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    // Set AO state once globally for all 3D rendering
-    pushConstants.ambientOcclusionEnabled = ambientOcclusionEnabled ? 1 : 0;
-
     // --- RENDER 3D SOLID GEOMETRY (TRIANGLES) ---
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipelineVariant(false, 0));
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context->pipelineLayout,
-                            0, 1, &descriptorSet, 0, NULL);
+                            0, 1, &descriptorSet, 1, &uniformDynamicOffset);
+
+    if (overdrawQueryActive) {
+        vkCmdBeginQuery(cmd, context->overdrawQueryPool, frameIndex, 0);
+    }
+
+    // Lay down depth first so the color pass shades each pixel once
+    if (depthPrepassEnabled) {
+        meshes_draw_depth_prepass(cmd, &scene.meshes);
+    }
 
     // Draw all meshes
     meshes_draw(cmd, &scene.meshes);
 
+    if (overdrawQueryActive) {
+        vkCmdEndQuery(cmd, context->overdrawQueryPool, frameIndex);
+    }
+
     // Or specify each one
     /* Mesh *teapot = get_mesh("teapot"); */
     /* Mesh *cow = get_mesh("cow"); */
@@ -1800,6 +2092,8 @@ void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex) {
 
 
     // Draw immediate mode 3D triangle content (cubes, spheres, etc.)
+    // meshes_draw may have left any variant bound
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipelineVariant(false, 0));
     renderer_draw(cmd);
 
     // --- RENDER 3D TEXTURED GEOMETRY ---
@@ -1809,7 +2103,7 @@ void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex) {
     if (context->graphicsPipelineLine && lineVertexCount > 0) {
         vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipelineLine);
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context->pipelineLayout,
-                                0, 1, &descriptorSet, 0, NULL);
+                                0, 1, &descriptorSet, 1, &uniformDynamicOffset);
         line_renderer_draw(cmd);  // Use the dedicated line renderer
     }
 
@@ -1817,6 +2111,10 @@ void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex) {
     renderer2D_draw(cmd);
 
     vkCmdEndRenderPass(cmd);
+
+    // Screenshot / capture sequence readback, consumed a few frames later
+    capture_record(cmd, imageIndex, frameIndex);
+
     vkEndCommandBuffer(cmd);
 }
 
@@ -1824,6 +2122,14 @@ void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex) {
 void cleanup(VulkanContext* context) {
     vkDeviceWaitIdle(context->device);
     
+    capture_shutdown(context);
+    meshlets_shutdown();
+    occlusion_shutdown();
+    fonts_shutdown();
+    
+    if (context->overdrawQueryPool)
+        vkDestroyQueryPool(context->device, context->overdrawQueryPool, NULL);
+    
     renderer_shutdown();
     line_renderer_shutdown();
     meshes_destroy(context->device, &scene.meshes);
@@ -1869,14 +2175,26 @@ void cleanup(VulkanContext* context) {
     free(context->swapChainImages);
     
     // DESTROY ALL PIPELINES FIRST (before their layouts!)
-    if (context->graphicsPipeline) 
-        vkDestroyPipeline(context->device, context->graphicsPipeline, NULL);
+    for (uint32_t v = 0; v < PIPELINE_VARIANT_COUNT; v++) {
+        if (context->graphicsPipelineVariants[v])
+            vkDestroyPipeline(context->device, context->graphicsPipelineVariants[v], NULL);
+        if (context->graphicsPipelineTextured3DVariants[v])
+            vkDestroyPipeline(context->device, context->graphicsPipelineTextured3DVariants[v], NULL);
+        if (context->depthPrepassPipelineVariants[v])
+            vkDestroyPipeline(context->device, context->depthPrepassPipelineVariants[v], NULL);
+        if (context->depthPrepassTextured3DVariants[v])
+            vkDestroyPipeline(context->device, context->depthPrepassTextured3DVariants[v], NULL);
+    }
     if (context->graphicsPipeline2D) 
         vkDestroyPipeline(context->device, context->graphicsPipeline2D, NULL);
     if (context->graphicsPipelineTextured2D) 
         vkDestroyPipeline(context->device, context->graphicsPipelineTextured2D, NULL);
-    if (context->graphicsPipelineTextured3D) 
-        vkDestroyPipeline(context->device, context->graphicsPipelineTextured3D, NULL);
+    if (context->graphicsPipelineTextured2DSDF) 
+        vkDestroyPipeline(context->device, context->graphicsPipelineTextured2DSDF, NULL);
+    for (uint32_t i = 0; i < 2; i++) {
+        if (context->graphicsPipelineTextured3DSDF[i])
+            vkDestroyPipeline(context->device, context->graphicsPipelineTextured3DSDF[i], NULL);
+    }
     if (context->graphicsPipelineLine) 
         vkDestroyPipeline(context->device, context->graphicsPipelineLine, NULL);
     
@@ -1904,6 +2222,7 @@ void cleanup(VulkanContext* context) {
     if (context->depthImageMemory) vkFreeMemory(context->device, context->depthImageMemory, NULL);
     
     // UNIFORM BUFFER & DESCRIPTORS
+    if (uniformBufferMapped) vkUnmapMemory(context->device, uniformBufferMemory);
     if (uniformBuffer) vkDestroyBuffer(context->device, uniformBuffer, NULL);
     if (uniformBufferMemory) vkFreeMemory(context->device, uniformBufferMemory, NULL);
     if (descriptorPool) vkDestroyDescriptorPool(context->device, descriptorPool, NULL);
@@ -1925,3 +2244,64 @@ void cleanup(VulkanContext* context) {
 void toggle_ambient_occlusion() {
     ambientOcclusionEnabled = !ambientOcclusionEnabled;
 }
+
+void toggle_depth_prepass() {
+    depthPrepassEnabled = !depthPrepassEnabled;
+}
+
+// Overdraw stats: fragment shader invocations of the scene mesh pass
+// divided by the pixel count, one query per frame in flight
+
+void createOverdrawQueryPool(VulkanContext* context) {
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(context->physicalDevice, &features);
+    if (!features.pipelineStatisticsQuery) {
+        fprintf(stderr, "Pipeline statistics queries not supported, overdraw stats disabled\n");
+        return;
+    }
+    
+    VkQueryPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+        .queryCount = MAX_FRAMES_IN_FLIGHT,
+        .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT,
+    };
+    
+    if (vkCreateQueryPool(context->device, &poolInfo, NULL, &context->overdrawQueryPool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create overdraw query pool\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Call after waiting on inFlightFences[frameIndex]
+void readOverdrawStats(uint32_t frameIndex) {
+    static uint64_t invocations = 0;
+    static uint64_t pixels = 0;
+    static double lastReport = 0.0;
+    
+    if (!overdrawQueryIssued[frameIndex]) return;
+    overdrawQueryIssued[frameIndex] = false;
+    
+    uint64_t result = 0;
+    if (vkGetQueryPoolResults(context.device, context.overdrawQueryPool, frameIndex, 1,
+                              sizeof(result), &result, sizeof(result),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    
+    invocations += result;
+    pixels += (uint64_t)context.swapChainExtent.width * context.swapChainExtent.height;
+    
+    double now = glfwGetTime();
+    if (now - lastReport >= 1.0 && pixels > 0) {
+        printf("Overdraw: %.2f fragments/pixel (depth pre-pass %s)\n",
+               (double)invocations / (double)pixels, depthPrepassEnabled ? "ON" : "OFF");
+        invocations = 0;
+        pixels = 0;
+        lastReport = now;
+    }
+}
+
+void toggle_overdraw_stats() {
+    overdrawStatsEnabled = !overdrawStatsEnabled;
+}
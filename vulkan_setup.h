@@ -11,14 +11,37 @@ extern VkDescriptorPool descriptorPool;
 extern VkDescriptorSet descriptorSet;
 extern VkBuffer uniformBuffer;
 extern VkDeviceMemory uniformBufferMemory;
+extern VkDeviceSize uniformBufferStride;
+extern uint32_t uniformDynamicOffset;  // Offset of the current frame's UBO region
 
 extern bool ambientOcclusionEnabled;
+extern bool depthPrepassEnabled;  // Depth-only pass, then shade with depth EQUAL
+extern bool overdrawStatsEnabled;
 
 
+// Per-frame global state, must match the std140 block in the shaders
 typedef struct {
     mat4 vp;
+    vec4 cameraPos;    // xyz = camera world position
+    vec4 lightDir;     // xyz = normalized direction towards the sun
+    vec4 lightColor;   // rgb = sun color
+    vec4 skyColor;     // rgb = hemisphere ambient from above
+    vec4 groundColor;  // rgb = hemisphere ambient from below
+    float time;
+    float deltaTime;
+    float fogDensity;
 } UniformBufferObject;
 
+typedef struct {
+    vec3 sunDirection;
+    vec3 sunColor;
+    vec3 skyColor;
+    vec3 groundColor;
+    float fogDensity;
+} Lighting;
+
+extern Lighting lighting;
+
 
 void create2DDescriptorSetLayout(VulkanContext* context);
 void create2DDescriptorPool(VulkanContext *context);
@@ -37,6 +60,9 @@ void create2DGraphicsPipeline(VulkanContext *context);
 void create3DTexturedGraphicsPipeline(VulkanContext *context);
 void createLineGraphicsPipeline(VulkanContext *context);
 void createGraphicsPipeline(VulkanContext *context);
+VkPipeline getPipelineVariant(bool textured, uint32_t variant);
+VkPipeline getDepthPrepassPipeline(bool textured, uint32_t variant);
+VkPipeline getSDFTextPipeline3D(void);
 void createFramebuffers(VulkanContext *context);
 void createCommandPool(VulkanContext *context);
 void createCommandBuffers(VulkanContext *context);
@@ -45,6 +71,7 @@ void createDepthResources(VulkanContext *context);
 void drawFrame(VulkanContext *context);
 
 void createUniformBuffer(VulkanContext* context);
+void updateUniformBuffer(uint32_t frameIndex, const UniformBufferObject* ubo);
 void createDescriptorSetLayout(VulkanContext *context);
 void clear_background(Color color);
 void recordCommandBuffer(VulkanContext* context, uint32_t imageIndex);
@@ -54,6 +81,11 @@ void cleanup(VulkanContext* context);
 
 
 void toggle_ambient_occlusion();
+void toggle_depth_prepass();
+void toggle_overdraw_stats();
+
+void createOverdrawQueryPool(VulkanContext *context);
+void readOverdrawStats(uint32_t frameIndex);
 
 
 
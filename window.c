@@ -6,6 +6,9 @@
 #include "camera.h"
 #include "theme.h"
 #include "vulkan_setup.h"
+#include "capture.h"
+#include "meshlet.h"
+#include "occlusion.h"
 
 #include <stdio.h>
 
@@ -106,6 +109,10 @@ GLFWwindow* initWindow(int width, int height, const char* title) {
 
     createCommandBuffers(&context);
     createSyncObjects(&context);
+    capture_init(&context);
+    createOverdrawQueryPool(&context);
+    meshlets_init();
+    occlusion_init();
     
     scene_init(&scene);
     
@@ -135,8 +142,6 @@ void beginFrame() {
     delta_time = current_frame - last_frame;
     last_frame = current_frame;
     
-    animate_scene(&scene, current_frame);
-    
     camera_process_keyboard(&camera, context.window, delta_time);
     camera_update(&camera);
 
@@ -144,21 +149,23 @@ void beginFrame() {
         process_editor_movement(&camera, delta_time);
     }
 
-    sort_meshes_by_alpha(&scene.meshes, camera.position); // HERE
+    // Occlusion workers cull the static meshes while the main thread animates
+    mat4 view_projection;
+    glm_mat4_mul(camera.projection_matrix, camera.view_matrix, view_projection);
+    meshes_occlusion_begin(&scene.meshes, view_projection, camera.position);
+    
+    animate_scene(&scene, current_frame);
 
-    // Update camera uniform buffer
-    UniformBufferObject ubo;
-    glm_mat4_mul(camera.projection_matrix, camera.view_matrix, ubo.vp);
-    void *data;
-    vkMapMemory(context.device, uniformBufferMemory, 0, sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(context.device, uniformBufferMemory);
+    sort_meshes_by_alpha(&scene.meshes, camera.position); // HERE
+    
+    occlusion_end();
 
     // Clear all render buffers
     renderer_clear();
     renderer_clear_textured3D();
     line_renderer_clear();
     renderer2D_clear();
+    font_next_frame();
 
 
 
@@ -178,6 +185,26 @@ void endFrame() {
     uint32_t frameIndex = context.currentFrame;
     VkFence inFlightFence = context.inFlightFences[frameIndex];
     vkWaitForFences(context.device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+
+    // Readbacks recorded the last time this fence was used are done now
+    capture_poll(frameIndex);
+    readOverdrawStats(frameIndex);
+
+    // The GPU is done with this frame's UBO region, safe to overwrite it
+    UniformBufferObject ubo = {0};
+    glm_mat4_mul(camera.projection_matrix, camera.view_matrix, ubo.vp);
+    glm_vec4(camera.position, 1.0f, ubo.cameraPos);
+    glm_vec3_normalize_to(lighting.sunDirection, ubo.lightDir);
+    glm_vec4(lighting.sunColor, 1.0f, ubo.lightColor);
+    glm_vec4(lighting.skyColor, 1.0f, ubo.skyColor);
+    glm_vec4(lighting.groundColor, 1.0f, ubo.groundColor);
+    ubo.time = last_frame;
+    ubo.deltaTime = delta_time;
+    ubo.fogDensity = lighting.fogDensity;
+    updateUniformBuffer(frameIndex, &ubo);
+    
+    // Same view projection as the UBO, culled ranges are recorded below
+    meshes_meshlets_cull(&scene.meshes, ubo.vp, camera.position);
         
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(